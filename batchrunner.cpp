@@ -0,0 +1,320 @@
+#include "batchrunner.h"
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QSet>
+#include <QImageReader>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMetaObject>
+#include <QTextStream>
+#include <QThread>
+
+#include <cstring>
+
+#ifndef DEFAULT_TESSDATA_PATH
+#define DEFAULT_TESSDATA_PATH ""
+#endif
+
+namespace {
+
+double roundMs(double ms)
+{
+    return qRound(ms * 1000.0) / 1000.0;
+}
+
+} // namespace
+
+bool BatchRunner::isRequested(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--batch") == 0)
+            return true;
+    }
+    return false;
+}
+
+int BatchRunner::run(const QStringList &arguments)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        QStringLiteral("Recognize text in image files without opening any window."));
+    parser.addHelpOption();
+
+    const QCommandLineOption batchOption(QStringLiteral("batch"),
+        QStringLiteral("Run headless batch OCR on the given files or directories."));
+    const QCommandLineOption jobsOption({QStringLiteral("j"), QStringLiteral("jobs")},
+        QStringLiteral("Number of images decoded and recognized in parallel (default: cores)."),
+        QStringLiteral("N"));
+    const QCommandLineOption outOption({QStringLiteral("o"), QStringLiteral("out")},
+        QStringLiteral("Write one JSON record per image to <file> (default: stdout)."),
+        QStringLiteral("file"));
+    const QCommandLineOption langOption(QStringLiteral("lang"),
+        QStringLiteral("Tesseract language (default: eng)."),
+        QStringLiteral("lang"), QStringLiteral("eng"));
+    const QCommandLineOption languagesOption(QStringLiteral("languages"),
+        QStringLiteral("Other languages the images may be in, comma-separated, or 'installed'. Each image's "
+                       "script picks one; needs osd.traineddata."),
+        QStringLiteral("list"));
+    const QCommandLineOption tessdataOption(QStringLiteral("tessdata"),
+        QStringLiteral("Directory containing the traineddata files."),
+        QStringLiteral("path"), QString::fromUtf8(DEFAULT_TESSDATA_PATH));
+    const QCommandLineOption binarizeOption(QStringLiteral("binarize"),
+        QStringLiteral("Binarization before OCR: none, otsu or sauvola (default: none)."),
+        QStringLiteral("mode"), QStringLiteral("none"));
+    const QCommandLineOption xHeightOption(QStringLiteral("x-height"),
+        QStringLiteral("Rescale each image so its text is this many pixels high (lowercase letters); "
+                       "0 keeps the original resolution (default: 0)."),
+        QStringLiteral("px"), QStringLiteral("0"));
+
+    const QCommandLineOption layoutOption(QStringLiteral("layout"),
+        QStringLiteral("Page layout: auto, page, block, sparse, line or word (default: auto)."),
+        QStringLiteral("layout"), QStringLiteral("auto"));
+    const QCommandLineOption whitelistOption(QStringLiteral("whitelist"),
+        QStringLiteral("Only recognize these characters."),
+        QStringLiteral("chars"));
+
+    parser.addOptions({batchOption, jobsOption, outOption, langOption, languagesOption, tessdataOption,
+                       binarizeOption, xHeightOption, layoutOption, whitelistOption});
+    parser.addPositionalArgument(QStringLiteral("inputs"),
+                                 QStringLiteral("Image files or directories (searched recursively)."),
+                                 QStringLiteral("<dir|files...>"));
+    parser.process(arguments);
+
+    QTextStream err(stderr);
+
+    const QStringList files = collectFiles(parser.positionalArguments());
+    if (files.isEmpty()) {
+        err << "SnipText: no readable images given to --batch" << Qt::endl;
+        return 1;
+    }
+
+    int jobs = QThread::idealThreadCount();
+    if (parser.isSet(jobsOption)) {
+        bool ok = false;
+        jobs = parser.value(jobsOption).toInt(&ok);
+        if (!ok || jobs <= 0) {
+            err << "SnipText: --jobs expects a positive number" << Qt::endl;
+            return 1;
+        }
+    }
+
+    PreprocessOptions preprocess;
+    const QString binarize = parser.value(binarizeOption).toLower();
+    if (binarize == QLatin1String("otsu")) {
+        preprocess.binarization = PreprocessOptions::Binarization::Otsu;
+    } else if (binarize == QLatin1String("sauvola")) {
+        preprocess.binarization = PreprocessOptions::Binarization::Sauvola;
+    } else if (binarize != QLatin1String("none")) {
+        err << "SnipText: unknown --binarize mode " << binarize << Qt::endl;
+        return 1;
+    }
+
+    bool xHeightOk = false;
+    preprocess.targetXHeight = parser.value(xHeightOption).toInt(&xHeightOk);
+    if (!xHeightOk || preprocess.targetXHeight < 0) {
+        err << "SnipText: --x-height expects a pixel count" << Qt::endl;
+        return 1;
+    }
+    preprocess.normalizeTextSize = preprocess.targetXHeight > 0;
+
+    OcrProfile profile = OcrProfile::builtinProfiles().first();
+    const QString layout = parser.value(layoutOption).toLower();
+    profile.layout = OcrProfile::layoutFromName(layout);
+    if (OcrProfile::layoutName(profile.layout) != layout) {
+        err << "SnipText: unknown --layout " << layout << Qt::endl;
+        return 1;
+    }
+    profile.whitelist = parser.value(whitelistOption);
+
+    QStringList languages = parser.value(languagesOption).split(QLatin1Char(','), Qt::SkipEmptyParts);
+    if (languages == QStringList{QStringLiteral("installed")})
+        languages = OcrService::installedLanguages(parser.value(tessdataOption));
+
+    BatchRunner runner(files, jobs);
+    if (!runner.start(parser.value(tessdataOption), parser.value(langOption), languages,
+                      preprocess, profile, parser.value(outOption))) {
+        return 1;
+    }
+    return QCoreApplication::exec();
+}
+
+BatchRunner::BatchRunner(const QStringList &files, int jobs, QObject *parent)
+    : QObject(parent)
+    , m_files(files)
+    , m_jobs(qMax(1, jobs))
+    , m_ocr(m_jobs)
+    , m_inFlight(2 * m_jobs)
+{
+    m_decodePool.setMaxThreadCount(m_jobs);
+
+    connect(&m_ocr, &OcrService::jobTimings,
+            this, [this](quint64 jobId, const OcrJobTimings &timings) {
+                auto it = m_pending.find(jobId);
+                if (it != m_pending.end())
+                    it->timings = timings;
+            });
+    connect(&m_ocr, &OcrService::textReady, this, &BatchRunner::onTextReady);
+}
+
+bool BatchRunner::start(const QString &dataPath, const QString &language, const QStringList &languages,
+                        const PreprocessOptions &preprocess, const OcrProfile &profile,
+                        const QString &outPath)
+{
+    QTextStream err(stderr);
+
+    if (outPath.isEmpty() || outPath == QLatin1String("-")) {
+        m_outFile.open(stdout, QIODevice::WriteOnly);
+    } else {
+        m_outFile.setFileName(outPath);
+        if (!m_outFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            err << "SnipText: cannot write " << outPath << ": " << m_outFile.errorString() << Qt::endl;
+            return false;
+        }
+    }
+
+    m_clock.start();
+    if (!m_ocr.initialize(dataPath, language)) {
+        err << "SnipText: failed to initialize Tesseract (tessdata '" << dataPath
+            << "', language '" << language << "')" << Qt::endl;
+        return false;
+    }
+    m_ocr.setLanguages(languages);
+    m_ocr.setPreprocessOptions(preprocess);
+    m_ocr.setProfile(profile);
+
+    decodeMore();
+    return true;
+}
+
+void BatchRunner::decodeMore()
+{
+    while (m_nextFile < m_files.size() && m_inFlight.tryAcquire())
+        decode(m_nextFile++);
+}
+
+void BatchRunner::decode(int index)
+{
+    m_decodePool.start([this, index]() {
+        QElapsedTimer timer;
+        timer.start();
+        QImageReader reader(m_files.at(index));
+        reader.setAutoTransform(true);
+        const QImage image = reader.read();
+        const double decodeMs = timer.nsecsElapsed() / 1e6;
+        const QString error = image.isNull() ? reader.errorString() : QString();
+
+        QMetaObject::invokeMethod(this, [this, index, image, decodeMs, error]() {
+            onDecoded(index, image, decodeMs, error);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void BatchRunner::onDecoded(int index, const QImage &image, double decodeMs, const QString &error)
+{
+    Pending pending;
+    pending.index = index;
+    pending.path = m_files.at(index);
+    pending.size = image.size();
+    pending.decodeMs = decodeMs;
+
+    if (!error.isEmpty()) {
+        m_inFlight.release();
+        ++m_failed;
+        writeRecord(pending, QString(), error);
+        ++m_completed;
+        decodeMore();
+        finishIfDone();
+        return;
+    }
+
+    // textReady() is queued to this thread, so it is handled only after the
+    // job is in m_pending.
+    m_pending.insert(m_ocr.submit(image), pending);
+}
+
+void BatchRunner::onTextReady(quint64 jobId, const QString &text)
+{
+    const auto it = m_pending.constFind(jobId);
+    if (it == m_pending.constEnd())
+        return;
+
+    const Pending pending = *it;
+    m_pending.erase(it);
+    m_inFlight.release();
+
+    writeRecord(pending, text, QString());
+    ++m_completed;
+    decodeMore();
+    finishIfDone();
+}
+
+void BatchRunner::writeRecord(const Pending &pending, const QString &text, const QString &error)
+{
+    QJsonObject record;
+    record.insert(QStringLiteral("index"), pending.index);
+    record.insert(QStringLiteral("file"), pending.path);
+    record.insert(QStringLiteral("width"), pending.size.width());
+    record.insert(QStringLiteral("height"), pending.size.height());
+    record.insert(QStringLiteral("decode_ms"), roundMs(pending.decodeMs));
+    record.insert(QStringLiteral("convert_ms"), roundMs(pending.timings.convertMs));
+    record.insert(QStringLiteral("preprocess_ms"), roundMs(pending.timings.preprocessMs));
+    record.insert(QStringLiteral("ocr_ms"), roundMs(pending.timings.recognizeMs));
+    if (pending.timings.layout != OcrProfile::Layout::Auto)
+        record.insert(QStringLiteral("layout"), OcrProfile::layoutName(pending.timings.layout));
+    if (error.isEmpty())
+        record.insert(QStringLiteral("text"), text);
+    else
+        record.insert(QStringLiteral("error"), error);
+
+    // One compact UTF-8 JSON object per line (JSON Lines).
+    m_outFile.write(QJsonDocument(record).toJson(QJsonDocument::Compact) + '\n');
+}
+
+void BatchRunner::finishIfDone()
+{
+    if (m_completed < m_files.size())
+        return;
+
+    m_outFile.close();
+
+    const double seconds = m_clock.nsecsElapsed() / 1e9;
+    QTextStream(stderr) << "SnipText: " << m_completed << " images in "
+                        << QString::number(seconds, 'f', 2) << " s ("
+                        << QString::number(m_completed / qMax(seconds, 1e-9), 'f', 1)
+                        << " images/s, " << m_jobs << " jobs, " << m_failed << " failed)"
+                        << Qt::endl;
+
+    QCoreApplication::exit(m_failed > 0 ? 2 : 0);
+}
+
+QStringList BatchRunner::collectFiles(const QStringList &inputs)
+{
+    // Extensions are compared lower-cased, so IMG_0001.JPG is found too.
+    QSet<QString> suffixes;
+    const QList<QByteArray> formats = QImageReader::supportedImageFormats();
+    for (const QByteArray &format : formats)
+        suffixes.insert(QString::fromLatin1(format).toLower());
+
+    QStringList files;
+    for (const QString &input : inputs) {
+        const QFileInfo info(input);
+        if (info.isDir()) {
+            QStringList found;
+            QDirIterator it(info.filePath(), QDir::Files | QDir::Readable, QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                const QString path = it.next();
+                if (suffixes.contains(it.fileInfo().suffix().toLower()))
+                    found << path;
+            }
+            found.sort();
+            files << found;
+        } else if (info.isFile()) {
+            files << info.filePath();
+        }
+    }
+    return files;
+}
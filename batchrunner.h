@@ -0,0 +1,74 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QImage>
+#include <QObject>
+#include <QSemaphore>
+#include <QStringList>
+#include <QThreadPool>
+
+#include "ocrservice.h"
+
+// Headless OCR of image files: `SnipText --batch <dir|files> --jobs N --out results.jsonl`.
+// Runs on a QCoreApplication, so no widgets, screens or display server are
+// involved. Files are decoded on a thread pool and recognized by the regular
+// OcrService pool; one JSON record per image is written as results arrive.
+class BatchRunner : public QObject
+{
+    Q_OBJECT
+public:
+    // True when argv asks for batch mode; checked before any application
+    // object exists, so the GUI can be skipped entirely.
+    static bool isRequested(int argc, char *argv[]);
+    // Parses the arguments, runs the batch and returns the process exit code.
+    static int run(const QStringList &arguments);
+
+private:
+    struct Pending
+    {
+        int index = 0;
+        QString path;
+        QSize size;
+        double decodeMs = 0.0;
+        OcrJobTimings timings;
+    };
+
+    BatchRunner(const QStringList &files, int jobs, QObject *parent = nullptr);
+
+    bool start(const QString &dataPath, const QString &language, const QStringList &languages,
+               const PreprocessOptions &preprocess, const OcrProfile &profile,
+               const QString &outPath);
+    void decodeMore();
+    void decode(int index);
+    void onDecoded(int index, const QImage &image, double decodeMs, const QString &error);
+    void onTextReady(quint64 jobId, const QString &text);
+    void writeRecord(const Pending &pending, const QString &text, const QString &error);
+    void finishIfDone();
+
+    static QStringList collectFiles(const QStringList &inputs);
+
+    QStringList m_files;
+    int m_jobs = 1;
+    // Next file to hand to the decode pool.
+    int m_nextFile = 0;
+
+    OcrService m_ocr;
+    // Bounds decoded-but-unrecognized images so decoding cannot outrun OCR.
+    // Taken on this object's thread before a decode starts, so pool threads
+    // never block on it. Declared before the pool, so it is destroyed only
+    // after the pool has waited for its tasks.
+    QSemaphore m_inFlight;
+    QThreadPool m_decodePool;
+
+    QHash<quint64, Pending> m_pending;
+    int m_completed = 0;
+    int m_failed = 0;
+
+    QFile m_outFile;
+    QElapsedTimer m_clock;
+};
+
+#endif // BATCHRUNNER_H
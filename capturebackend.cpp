@@ -0,0 +1,335 @@
+#include "capturebackend.h"
+
+#include "latencytrace.h"
+
+#include <QCoreApplication>
+#include <QGuiApplication>
+#include <QPainter>
+#include <QPixmap>
+#include <QScreen>
+#include <QSysInfo>
+
+#include <cstring>
+
+#ifdef SNIPTEXT_HAVE_XSHM
+// Xlib defines macros (None, Bool, Status, ...) that collide with Qt names, so
+// it is included after every Qt header.
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#endif
+
+QImage CaptureBackend::grab(QScreen *screen, const QRect &rect)
+{
+    const qint64 startNs = LatencyTrace::now();
+    QImage image = grabRegion(screen, rect);
+    const qint64 endNs = LatencyTrace::now();
+    const double ms = (endNs - startNs) / 1e6;
+    LatencyTrace::instance().record(LatencyTrace::Stage::Grab, startNs, endNs);
+
+    if (!image.isNull()) {
+        ++m_stats.grabs;
+        m_stats.pixels += qint64(image.width()) * image.height();
+        m_stats.totalMs += ms;
+        m_stats.worstMs = qMax(m_stats.worstMs, ms);
+    }
+    return image;
+}
+
+QString CaptureBackend::statsReport() const
+{
+    const QString backend = QString::fromLatin1(name());
+    if (m_stats.grabs == 0)
+        return QCoreApplication::translate("CaptureBackend", "Screen grabs (%1): none yet").arg(backend);
+
+    const double megapixels = m_stats.pixels / 1e6;
+    return QCoreApplication::translate("CaptureBackend",
+                                       "Screen grabs (%1): %2, avg %3 ms, worst %4 ms, %5 ms/MP")
+        .arg(backend)
+        .arg(m_stats.grabs)
+        .arg(m_stats.totalMs / m_stats.grabs, 0, 'f', 2)
+        .arg(m_stats.worstMs, 0, 'f', 2)
+        .arg(megapixels > 0.0 ? m_stats.totalMs / megapixels : 0.0, 0, 'f', 2);
+}
+
+QImage CaptureBackend::grabArea(const QRect &area, qreal *dpr, QHash<QScreen *, QImage> *screenImages)
+{
+    struct Piece
+    {
+        QRect logical;
+        QImage image;
+    };
+
+    // Grab only the part of each screen the area covers; screens it does not
+    // touch are left alone.
+    QList<Piece> pieces;
+    qreal outDpr = 0.0;
+    const QList<QScreen *> screens = QGuiApplication::screens();
+    for (QScreen *screen : screens) {
+        const QRect geometry = screen->geometry();
+        const QRect part = geometry.intersected(area);
+        if (part.isEmpty())
+            continue;
+
+        const QImage image = grab(screen, part.translated(-geometry.topLeft()));
+        if (image.isNull())
+            return QImage();
+
+        outDpr = qMax(outDpr, image.devicePixelRatio());
+        if (screenImages)
+            screenImages->insert(screen, image);
+        pieces.append({part, image});
+    }
+
+    if (pieces.isEmpty())
+        return QImage();
+
+    *dpr = outDpr;
+    if (pieces.size() == 1 && pieces.first().logical == area)
+        return pieces.first().image;
+
+    // Stitch at the highest ratio so no screen loses detail; pieces from
+    // lower-density screens are scaled up by their own ratio. Parts of the
+    // area no screen covers stay black.
+    QImage stitched(qRound(area.width() * outDpr), qRound(area.height() * outDpr), QImage::Format_RGB32);
+    stitched.fill(Qt::black);
+    QPainter p(&stitched);
+    p.setRenderHint(QPainter::SmoothPixmapTransform, true);
+    for (const Piece &piece : std::as_const(pieces)) {
+        const QRectF target(QPointF(piece.logical.topLeft() - area.topLeft()) * outDpr,
+                            QSizeF(piece.logical.size()) * outDpr);
+        p.drawImage(target, piece.image, QRectF(piece.image.rect()));
+    }
+    p.end();
+    return stitched;
+}
+
+QImage QtCaptureBackend::grabScreen(QScreen *screen, const QRect &rect)
+{
+    const QPixmap pixmap = screen->grabWindow(0, rect.x(), rect.y(), rect.width(), rect.height());
+    if (pixmap.isNull())
+        return QImage();
+
+    QImage image = pixmap.toImage();
+    // The pixel size is what matters; not every platform tags the grab with
+    // its ratio.
+    image.setDevicePixelRatio(qreal(image.width()) / rect.width());
+    return image;
+}
+
+QImage QtCaptureBackend::grabRegion(QScreen *screen, const QRect &rect)
+{
+    return grabScreen(screen, rect);
+}
+
+#ifdef SNIPTEXT_HAVE_XSHM
+
+namespace {
+
+bool g_xError = false;
+
+int recordXError(Display *, XErrorEvent *)
+{
+    g_xError = true;
+    return 0;
+}
+
+} // namespace
+
+// Reads the root window of the X server through MIT-SHM: the server writes
+// the requested rectangle straight into a shared-memory segment that is
+// reused across grabs, so a grab costs one copy of the selected pixels.
+class X11ShmCaptureBackend : public CaptureBackend
+{
+public:
+    ~X11ShmCaptureBackend() override;
+
+    // nullptr unless Qt runs on xcb and the server supports MIT-SHM with a
+    // 32-bit TrueColor layout QImage::Format_RGB32 can take as is.
+    static std::unique_ptr<X11ShmCaptureBackend> open();
+
+    const char *name() const override { return "x11-shm"; }
+
+protected:
+    QImage grabRegion(QScreen *screen, const QRect &rect) override;
+
+private:
+    X11ShmCaptureBackend() = default;
+
+    bool reserve(size_t bytes);
+    void releaseSegment();
+
+    Display *m_display = nullptr;
+    Window m_root = 0;
+    Visual *m_visual = nullptr;
+    int m_depth = 0;
+    QRect m_rootRect;
+
+    XShmSegmentInfo m_shm = {};
+    size_t m_capacity = 0;
+};
+
+std::unique_ptr<X11ShmCaptureBackend> X11ShmCaptureBackend::open()
+{
+    if (QGuiApplication::platformName() != QLatin1String("xcb"))
+        return nullptr;
+
+    Display *display = XOpenDisplay(nullptr);
+    if (!display)
+        return nullptr;
+
+    std::unique_ptr<X11ShmCaptureBackend> backend(new X11ShmCaptureBackend);
+    backend->m_display = display;
+
+    const int screen = DefaultScreen(display);
+    backend->m_root = RootWindow(display, screen);
+    backend->m_visual = DefaultVisual(display, screen);
+    backend->m_depth = DefaultDepth(display, screen);
+    backend->m_rootRect = QRect(0, 0, DisplayWidth(display, screen), DisplayHeight(display, screen));
+
+    const Visual *visual = backend->m_visual;
+    const int byteOrder = QSysInfo::ByteOrder == QSysInfo::LittleEndian ? LSBFirst : MSBFirst;
+    if (!XShmQueryExtension(display)
+        || (backend->m_depth != 24 && backend->m_depth != 32)
+        || visual->red_mask != 0xff0000 || visual->green_mask != 0xff00 || visual->blue_mask != 0xff
+        || ImageByteOrder(display) != byteOrder) {
+        return nullptr;
+    }
+    return backend;
+}
+
+X11ShmCaptureBackend::~X11ShmCaptureBackend()
+{
+    releaseSegment();
+    if (m_display)
+        XCloseDisplay(m_display);
+}
+
+bool X11ShmCaptureBackend::reserve(size_t bytes)
+{
+    if (bytes <= m_capacity)
+        return true;
+
+    releaseSegment();
+
+    const int id = shmget(IPC_PRIVATE, bytes, IPC_CREAT | 0600);
+    if (id < 0)
+        return false;
+    void *address = shmat(id, nullptr, 0);
+    if (address == reinterpret_cast<void *>(-1)) {
+        shmctl(id, IPC_RMID, nullptr);
+        return false;
+    }
+
+    m_shm.shmid = id;
+    m_shm.shmaddr = static_cast<char *>(address);
+    m_shm.readOnly = False;
+
+    g_xError = false;
+    XErrorHandler previous = XSetErrorHandler(recordXError);
+    bool attached = XShmAttach(m_display, &m_shm);
+    XSync(m_display, False);
+    attached = attached && !g_xError;
+    XSetErrorHandler(previous);
+
+    // Once both sides are attached the segment can be marked for removal; it
+    // goes away when the last one detaches, even if the process dies.
+    shmctl(id, IPC_RMID, nullptr);
+    if (!attached) {
+        shmdt(address);
+        m_shm = {};
+        return false;
+    }
+
+    m_capacity = bytes;
+    return true;
+}
+
+void X11ShmCaptureBackend::releaseSegment()
+{
+    if (m_capacity == 0)
+        return;
+    XShmDetach(m_display, &m_shm);
+    XSync(m_display, False);
+    shmdt(m_shm.shmaddr);
+    m_shm = {};
+    m_capacity = 0;
+}
+
+QImage X11ShmCaptureBackend::grabRegion(QScreen *screen, const QRect &rect)
+{
+    // Qt keeps a screen's origin in native pixels and scales offsets within
+    // it by the device pixel ratio.
+    const qreal dpr = screen->devicePixelRatio();
+    const QPoint origin = screen->geometry().topLeft();
+    const QRect native(origin.x() + qRound(rect.x() * dpr),
+                       origin.y() + qRound(rect.y() * dpr),
+                       qRound(rect.width() * dpr),
+                       qRound(rect.height() * dpr));
+    if (native.isEmpty() || !m_rootRect.contains(native))
+        return QtCaptureBackend::grabScreen(screen, rect);
+
+    XImage *image = XShmCreateImage(m_display, m_visual, unsigned(m_depth), ZPixmap, nullptr, &m_shm,
+                                    unsigned(native.width()), unsigned(native.height()));
+    if (!image)
+        return QtCaptureBackend::grabScreen(screen, rect);
+
+    QImage result;
+    const size_t bytes = size_t(image->bytes_per_line) * size_t(image->height);
+    if (image->bits_per_pixel == 32 && reserve(bytes)) {
+        image->data = m_shm.shmaddr;
+
+        // A window manager can shrink the root window under us; an X error
+        // here must not take the application down.
+        g_xError = false;
+        XErrorHandler previous = XSetErrorHandler(recordXError);
+        bool ok = XShmGetImage(m_display, m_root, image, native.x(), native.y(), AllPlanes);
+        XSync(m_display, False);
+        ok = ok && !g_xError;
+        XSetErrorHandler(previous);
+
+        if (ok) {
+            // The segment is reused by the next grab, so the pixels are copied
+            // out; this is the only copy a grab makes.
+            result = QImage(native.width(), native.height(), QImage::Format_RGB32);
+            const size_t rowBytes = size_t(native.width()) * 4;
+            for (int y = 0; y < native.height(); ++y)
+                std::memcpy(result.scanLine(y), m_shm.shmaddr + size_t(y) * image->bytes_per_line, rowBytes);
+            result.setDevicePixelRatio(dpr);
+        }
+    }
+
+    // The data belongs to the segment, not to the XImage.
+    image->data = nullptr;
+    XDestroyImage(image);
+
+    return result.isNull() ? QtCaptureBackend::grabScreen(screen, rect) : result;
+}
+
+#endif // SNIPTEXT_HAVE_XSHM
+
+QStringList CaptureBackend::availableBackends()
+{
+    QStringList names;
+#ifdef SNIPTEXT_HAVE_XSHM
+    if (X11ShmCaptureBackend::open())
+        names << QStringLiteral("x11-shm");
+#endif
+    names << QStringLiteral("qt");
+    return names;
+}
+
+std::unique_ptr<CaptureBackend> CaptureBackend::create(const QString &name)
+{
+#ifdef SNIPTEXT_HAVE_XSHM
+    if (name.isEmpty() || name == QLatin1String("x11-shm")) {
+        if (auto backend = X11ShmCaptureBackend::open())
+            return backend;
+    }
+#else
+    Q_UNUSED(name);
+#endif
+    return std::make_unique<QtCaptureBackend>();
+}
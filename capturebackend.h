@@ -0,0 +1,72 @@
+#ifndef CAPTUREBACKEND_H
+#define CAPTUREBACKEND_H
+
+#include <QHash>
+#include <QImage>
+#include <QRect>
+#include <QString>
+#include <QStringList>
+
+#include <memory>
+
+class QScreen;
+
+// Reads screen pixels. grab() takes a rectangle in the screen's logical
+// coordinates and returns only those pixels, at the screen's device pixel
+// ratio, so reading a small selection never copies or converts the whole
+// screen. Used from the GUI thread only.
+class CaptureBackend
+{
+public:
+    struct Stats
+    {
+        int grabs = 0;
+        qint64 pixels = 0;
+        double totalMs = 0.0;
+        double worstMs = 0.0;
+    };
+
+    virtual ~CaptureBackend() = default;
+
+    // Names of the backends usable on this platform, best first. "qt" is
+    // always available.
+    static QStringList availableBackends();
+    // The named backend, or the best available one for an empty or unknown
+    // name.
+    static std::unique_ptr<CaptureBackend> create(const QString &name = QString());
+
+    virtual const char *name() const = 0;
+
+    // Returns a null image on failure. Every call is timed into stats().
+    QImage grab(QScreen *screen, const QRect &rect);
+    // Grabs area of the virtual desktop (logical coordinates), stitching the
+    // screens it touches. *dpr receives the ratio of the result; screenImages
+    // optionally receives each screen's piece.
+    QImage grabArea(const QRect &area, qreal *dpr, QHash<QScreen *, QImage> *screenImages = nullptr);
+
+    const Stats &stats() const { return m_stats; }
+    QString statsReport() const;
+
+protected:
+    CaptureBackend() = default;
+    virtual QImage grabRegion(QScreen *screen, const QRect &rect) = 0;
+
+private:
+    Q_DISABLE_COPY(CaptureBackend)
+
+    Stats m_stats;
+};
+
+// Portable fallback: QScreen::grabWindow() limited to the rectangle.
+class QtCaptureBackend : public CaptureBackend
+{
+public:
+    const char *name() const override { return "qt"; }
+
+    static QImage grabScreen(QScreen *screen, const QRect &rect);
+
+protected:
+    QImage grabRegion(QScreen *screen, const QRect &rect) override;
+};
+
+#endif // CAPTUREBACKEND_H
@@ -0,0 +1,522 @@
+#include "capturehistory.h"
+
+#include "hashing.h"
+
+#include <QBuffer>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImageWriter>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QThread>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <queue>
+
+namespace {
+
+// Log layout: the magic, then one record per entry:
+//   u32 payload size, u32 low half of the payload's XXH64, payload
+// and the payload is
+//   i64 timestamp (ms since epoch), i32 x, y, width, height,
+//   u32 text size, u32 thumbnail size, UTF-8 text, PNG thumbnail.
+// Everything is little-endian. The file is grown ahead of the data and the
+// first record whose size is zero or whose checksum fails ends the log, so a
+// torn append is dropped on the next open.
+constexpr char kMagic[8] = {'S', 'N', 'P', 'H', 'I', 'S', 'T', '1'};
+constexpr qint64 kRecordHeaderSize = 8;
+constexpr qint64 kPayloadHeaderSize = 32;
+constexpr qint64 kInitialCapacity = 1024 * 1024;
+constexpr qint64 kMsPerDay = 24 * 60 * 60 * 1000;
+
+const QSize kThumbnailSize(160, 120);
+// Frames waiting for a thumbnail are full captures; past this many the
+// thumbnail is skipped rather than holding more of them in memory.
+constexpr int kMaxQueuedFrames = 8;
+
+quint32 checksum(const uchar *payload, qint64 size)
+{
+    return quint32(Xxh64::hash(payload, size_t(size)));
+}
+
+} // namespace
+
+CaptureHistory::CaptureHistory(QObject *parent)
+    : QObject(parent)
+{
+    m_thread = QThread::create([this]() { historyLoop(); });
+    m_thread->setObjectName(QStringLiteral("CaptureHistory"));
+    m_thread->start();
+}
+
+CaptureHistory::~CaptureHistory()
+{
+    {
+        QMutexLocker locker(&m_queueMutex);
+        m_stopping = true;
+        m_notEmpty.wakeAll();
+    }
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+
+    closeLog();
+}
+
+void CaptureHistory::open(const QString &filePath)
+{
+    QMutexLocker locker(&m_queueMutex);
+    m_pendingOpen = filePath;
+    m_notEmpty.wakeOne();
+}
+
+void CaptureHistory::setRetention(qint64 maxBytes, int maxDays)
+{
+    QMutexLocker locker(&m_queueMutex);
+    m_maxBytes = qMax<qint64>(0, maxBytes);
+    m_maxDays = qMax(0, maxDays);
+}
+
+void CaptureHistory::clear()
+{
+    QMutexLocker locker(&m_queueMutex);
+    m_queue.clear();
+    m_pendingClear = true;
+    m_notEmpty.wakeOne();
+}
+
+void CaptureHistory::append(const QString &text, const QRect &geometry, const QImage &frame,
+                            const QRect &pixelRect)
+{
+    if (text.trimmed().isEmpty())
+        return;
+
+    Request request;
+    request.text = text;
+    request.geometry = geometry;
+    request.timestamp = QDateTime::currentDateTime();
+
+    QMutexLocker locker(&m_queueMutex);
+    if (m_stopping)
+        return;
+    if (!frame.isNull()) {
+        const int queuedFrames = int(std::count_if(m_queue.cbegin(), m_queue.cend(),
+                                                   [](const Request &r) { return !r.frame.isNull(); }));
+        if (queuedFrames < kMaxQueuedFrames) {
+            request.frame = frame;
+            request.pixelRect = pixelRect.isNull() ? frame.rect() : pixelRect;
+        }
+    }
+    m_queue.enqueue(request);
+    m_notEmpty.wakeOne();
+}
+
+int CaptureHistory::count() const
+{
+    QMutexLocker locker(&m_mutex);
+    return int(m_records.size());
+}
+
+QList<quint32> CaptureHistory::search(const QString &query, int limit) const
+{
+    const QStringList words = tokenize(query);
+
+    QMutexLocker locker(&m_mutex);
+    QList<quint32> result;
+    if (words.isEmpty()) {
+        for (qint64 id = qint64(m_records.size()) - 1; id >= 0 && result.size() < limit; --id)
+            result.append(quint32(id));
+        return result;
+    }
+
+    // Each word's matches are the merged posting lists of the indexed words
+    // it is a prefix of; the per-word sets are intersected.
+    std::vector<quint32> matches;
+    for (int i = 0; i < words.size(); ++i) {
+        std::vector<quint32> wordMatches = prefixMatches(words.at(i));
+        if (i == 0) {
+            matches.swap(wordMatches);
+        } else {
+            std::vector<quint32> intersected;
+            std::set_intersection(matches.begin(), matches.end(), wordMatches.begin(), wordMatches.end(),
+                                  std::back_inserter(intersected));
+            matches.swap(intersected);
+        }
+        if (matches.empty())
+            return result;
+    }
+
+    for (auto it = matches.rbegin(); it != matches.rend() && result.size() < limit; ++it)
+        result.append(*it);
+    return result;
+}
+
+std::vector<quint32> CaptureHistory::prefixMatches(const QString &word) const
+{
+    std::vector<const std::vector<quint32> *> lists;
+    if (word.size() < kMinPrefixLength) {
+        // A one-letter prefix would merge nearly the whole index.
+        const auto it = m_postings.find(word);
+        if (it != m_postings.end())
+            lists.push_back(&it->second);
+    } else {
+        for (auto it = m_postings.lower_bound(word);
+             it != m_postings.end() && it->first.startsWith(word); ++it) {
+            lists.push_back(&it->second);
+        }
+    }
+    if (lists.empty())
+        return {};
+    if (lists.size() == 1)
+        return *lists.front();
+
+    // k-way merge of the sorted lists: the heap holds the next id of each,
+    // so every posting is visited once.
+    using Cursor = std::pair<quint32, size_t>;
+    std::priority_queue<Cursor, std::vector<Cursor>, std::greater<Cursor>> heap;
+    std::vector<size_t> positions(lists.size(), 0);
+    size_t total = 0;
+    for (size_t i = 0; i < lists.size(); ++i) {
+        heap.emplace(lists[i]->front(), i);
+        total += lists[i]->size();
+    }
+    std::vector<quint32> merged;
+    merged.reserve(total);
+    while (!heap.empty()) {
+        const Cursor next = heap.top();
+        heap.pop();
+        if (merged.empty() || merged.back() != next.first)
+            merged.push_back(next.first);
+        const std::vector<quint32> &list = *lists[next.second];
+        if (++positions[next.second] < list.size())
+            heap.emplace(list[positions[next.second]], next.second);
+    }
+    return merged;
+}
+
+CaptureHistory::Entry CaptureHistory::entry(quint32 id) const
+{
+    QMutexLocker locker(&m_mutex);
+    Entry entry;
+    if (id >= m_records.size())
+        return entry;
+
+    const Record &record = m_records[id];
+    entry.id = id;
+    entry.timestamp = QDateTime::fromMSecsSinceEpoch(record.timestampMs);
+    entry.geometry = record.geometry;
+    entry.text = QString::fromUtf8(reinterpret_cast<const char *>(payload(record)) + kPayloadHeaderSize,
+                                   int(record.textSize));
+    entry.hasThumbnail = record.thumbnailSize > 0;
+    return entry;
+}
+
+QImage CaptureHistory::thumbnail(quint32 id) const
+{
+    QMutexLocker locker(&m_mutex);
+    if (id >= m_records.size() || m_records[id].thumbnailSize == 0)
+        return QImage();
+
+    const Record &record = m_records[id];
+    const uchar *data = payload(record) + kPayloadHeaderSize + record.textSize;
+    return QImage::fromData(data, int(record.thumbnailSize), "PNG");
+}
+
+const uchar *CaptureHistory::payload(const Record &record) const
+{
+    return m_map + record.offset + kRecordHeaderSize;
+}
+
+void CaptureHistory::historyLoop()
+{
+    for (;;) {
+        QString openPath;
+        bool clearLog = false;
+        Request request;
+        {
+            QMutexLocker locker(&m_queueMutex);
+            while (!m_stopping && m_pendingOpen.isEmpty() && !m_pendingClear && m_queue.isEmpty())
+                m_notEmpty.wait(&m_queueMutex);
+            // Entries accepted before shutting down are still written.
+            if (!m_pendingOpen.isEmpty()) {
+                openPath = m_pendingOpen;
+                m_pendingOpen.clear();
+            } else if (m_pendingClear) {
+                clearLog = true;
+                m_pendingClear = false;
+            } else if (!m_queue.isEmpty()) {
+                request = m_queue.dequeue();
+            } else {
+                break;
+            }
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        if (!openPath.isEmpty()) {
+            if (m_map && m_file.fileName() == openPath)
+                continue;
+            if (openLog(openPath)) {
+                enforceRetention();
+                emit loaded(count(), timer.nsecsElapsed() / 1e6);
+            } else {
+                qWarning("SnipText: could not open the capture history at %s", qPrintable(openPath));
+            }
+        } else if (clearLog) {
+            if (m_map && compact(m_end))
+                emit loaded(count(), timer.nsecsElapsed() / 1e6);
+        } else {
+            write(request);
+            if (enforceRetention())
+                emit loaded(count(), timer.nsecsElapsed() / 1e6);
+        }
+    }
+}
+
+bool CaptureHistory::openLog(const QString &filePath)
+{
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
+
+    {
+        QMutexLocker locker(&m_mutex);
+        closeLog();
+    }
+
+    m_file.setFileName(filePath);
+    if (!m_file.open(QIODevice::ReadWrite))
+        return false;
+
+    qint64 size = m_file.size();
+    if (size == 0) {
+        if (m_file.write(kMagic, sizeof(kMagic)) != qint64(sizeof(kMagic)))
+            return false;
+        m_file.flush();
+        size = sizeof(kMagic);
+    }
+
+    uchar *map = m_file.map(0, size);
+    if (!map || size < qint64(sizeof(kMagic)) || std::memcmp(map, kMagic, sizeof(kMagic)) != 0) {
+        // Not a history log; leave it alone rather than overwrite it.
+        if (map)
+            m_file.unmap(map);
+        m_file.close();
+        return false;
+    }
+
+    // Index everything up to the first incomplete record. This runs without
+    // m_mutex, so searches meanwhile see an empty history instead of waiting.
+    std::vector<Record> records;
+    Postings postings;
+    qint64 offset = sizeof(kMagic);
+    while (offset + kRecordHeaderSize + kPayloadHeaderSize <= size) {
+        const uchar *header = map + offset;
+        const qint64 payloadSize = qFromLittleEndian<quint32>(header);
+        if (payloadSize < kPayloadHeaderSize || offset + kRecordHeaderSize + payloadSize > size)
+            break;
+        const uchar *data = header + kRecordHeaderSize;
+        if (checksum(data, payloadSize) != qFromLittleEndian<quint32>(header + 4))
+            break;
+
+        Record record;
+        record.offset = offset;
+        record.timestampMs = qFromLittleEndian<qint64>(data);
+        record.geometry = QRect(qFromLittleEndian<qint32>(data + 8), qFromLittleEndian<qint32>(data + 12),
+                                qFromLittleEndian<qint32>(data + 16), qFromLittleEndian<qint32>(data + 20));
+        record.textSize = qFromLittleEndian<quint32>(data + 24);
+        record.thumbnailSize = qFromLittleEndian<quint32>(data + 28);
+        if (kPayloadHeaderSize + qint64(record.textSize) + record.thumbnailSize != payloadSize)
+            break;
+
+        records.push_back(record);
+        index(&postings, quint32(records.size() - 1),
+              tokenize(QString::fromUtf8(reinterpret_cast<const char *>(data) + kPayloadHeaderSize,
+                                         int(record.textSize))));
+        offset += kRecordHeaderSize + payloadSize;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_map = map;
+    m_capacity = size;
+    m_end = offset;
+    m_records.swap(records);
+    m_postings.swap(postings);
+    return true;
+}
+
+void CaptureHistory::closeLog()
+{
+    // Drop the unused tail the file was grown by.
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = nullptr;
+        m_file.resize(m_end);
+    }
+    if (m_file.isOpen())
+        m_file.close();
+    m_records.clear();
+    m_postings.clear();
+    m_capacity = 0;
+    m_end = 0;
+}
+
+bool CaptureHistory::enforceRetention()
+{
+    qint64 maxBytes = 0;
+    int maxDays = 0;
+    {
+        QMutexLocker locker(&m_queueMutex);
+        maxBytes = m_maxBytes;
+        maxDays = m_maxDays;
+    }
+    if (!m_map || m_records.empty())
+        return false;
+
+    const qint64 oldestMs = maxDays > 0 ? QDateTime::currentMSecsSinceEpoch() - maxDays * kMsPerDay
+                                        : std::numeric_limits<qint64>::min();
+    const bool tooLarge = maxBytes > 0 && m_end > maxBytes;
+    if (!tooLarge && m_records.front().timestampMs >= oldestMs)
+        return false;
+
+    // Trimming to three quarters of the cap keeps the log from being
+    // rewritten on every append once it is full.
+    const qint64 targetBytes = maxBytes > 0 ? maxBytes / 4 * 3 : std::numeric_limits<qint64>::max();
+    size_t first = 0;
+    while (first < m_records.size()
+           && (m_records[first].timestampMs < oldestMs
+               || qint64(sizeof(kMagic)) + m_end - m_records[first].offset > targetBytes)) {
+        ++first;
+    }
+    return compact(first < m_records.size() ? m_records[first].offset : m_end);
+}
+
+bool CaptureHistory::compact(qint64 keepFrom)
+{
+    // Records hold no offsets, so the kept tail is copied verbatim behind a
+    // new magic. QSaveFile only replaces the log once the copy is complete.
+    const QString filePath = m_file.fileName();
+    QSaveFile out(filePath);
+    if (!out.open(QIODevice::WriteOnly))
+        return false;
+    out.write(kMagic, sizeof(kMagic));
+    out.write(reinterpret_cast<const char *>(m_map + keepFrom), m_end - keepFrom);
+
+    {
+        QMutexLocker locker(&m_mutex);
+        closeLog();
+    }
+    // On failure the old log is untouched and simply opened again.
+    const bool committed = out.commit();
+    return openLog(filePath) && committed;
+}
+
+void CaptureHistory::write(const Request &request)
+{
+    QByteArray thumbnail;
+    if (!request.frame.isNull()) {
+        QImage image = request.frame.copy(request.pixelRect);
+        if (image.width() > kThumbnailSize.width() || image.height() > kThumbnailSize.height())
+            image = image.scaled(kThumbnailSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        QBuffer buffer(&thumbnail);
+        buffer.open(QIODevice::WriteOnly);
+        QImageWriter writer(&buffer, "PNG");
+        if (!writer.write(image))
+            thumbnail.clear();
+    }
+
+    const QByteArray text = request.text.toUtf8();
+    const QStringList words = tokenize(request.text);
+    const qint64 payloadSize = kPayloadHeaderSize + text.size() + thumbnail.size();
+
+    QMutexLocker locker(&m_mutex);
+    if (!m_map || !reserve(kRecordHeaderSize + payloadSize))
+        return;
+
+    uchar *header = m_map + m_end;
+    uchar *data = header + kRecordHeaderSize;
+    qToLittleEndian<qint64>(request.timestamp.toMSecsSinceEpoch(), data);
+    qToLittleEndian<qint32>(request.geometry.x(), data + 8);
+    qToLittleEndian<qint32>(request.geometry.y(), data + 12);
+    qToLittleEndian<qint32>(request.geometry.width(), data + 16);
+    qToLittleEndian<qint32>(request.geometry.height(), data + 20);
+    qToLittleEndian<quint32>(quint32(text.size()), data + 24);
+    qToLittleEndian<quint32>(quint32(thumbnail.size()), data + 28);
+    std::memcpy(data + kPayloadHeaderSize, text.constData(), size_t(text.size()));
+    std::memcpy(data + kPayloadHeaderSize + text.size(), thumbnail.constData(), size_t(thumbnail.size()));
+    // The size goes in last; until then the record reads as the end of the log.
+    qToLittleEndian<quint32>(checksum(data, payloadSize), header + 4);
+    qToLittleEndian<quint32>(quint32(payloadSize), header);
+
+    Record record;
+    record.offset = m_end;
+    record.timestampMs = request.timestamp.toMSecsSinceEpoch();
+    record.geometry = request.geometry;
+    record.textSize = quint32(text.size());
+    record.thumbnailSize = quint32(thumbnail.size());
+    m_records.push_back(record);
+    m_end += kRecordHeaderSize + payloadSize;
+
+    const quint32 id = quint32(m_records.size() - 1);
+    index(&m_postings, id, words);
+    locker.unlock();
+
+    emit entryAdded(id);
+}
+
+bool CaptureHistory::reserve(qint64 bytes)
+{
+    // The zeroed tail past m_end also terminates the log when it is scanned.
+    if (m_end + bytes + kRecordHeaderSize <= m_capacity)
+        return true;
+
+    qint64 capacity = qMax(m_capacity, kInitialCapacity);
+    while (m_end + bytes + kRecordHeaderSize > capacity)
+        capacity *= 2;
+
+    m_file.unmap(m_map);
+    m_map = nullptr;
+    if (!m_file.resize(capacity)) {
+        m_map = m_file.map(0, m_capacity);
+        return false;
+    }
+    m_map = m_file.map(0, capacity);
+    if (!m_map) {
+        m_file.close();
+        m_records.clear();
+        m_postings.clear();
+        return false;
+    }
+    m_capacity = capacity;
+    return true;
+}
+
+void CaptureHistory::index(Postings *postings, quint32 id, QStringList words)
+{
+    words.sort();
+    words.removeDuplicates();
+    // Ids grow monotonically, so every posting list stays sorted.
+    for (const QString &word : std::as_const(words))
+        (*postings)[word].push_back(id);
+}
+
+QStringList CaptureHistory::tokenize(const QString &text)
+{
+    QStringList words;
+    QString word;
+    for (const QChar c : text) {
+        if (c.isLetterOrNumber()) {
+            word.append(c.toLower());
+        } else if (!word.isEmpty()) {
+            words.append(word);
+            word.clear();
+        }
+    }
+    if (!word.isEmpty())
+        words.append(word);
+    return words;
+}
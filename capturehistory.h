@@ -0,0 +1,136 @@
+#ifndef CAPTUREHISTORY_H
+#define CAPTUREHISTORY_H
+
+#include <QDateTime>
+#include <QFile>
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QQueue>
+#include <QRect>
+#include <QString>
+#include <QWaitCondition>
+
+#include <map>
+#include <vector>
+
+class QThread;
+
+// Persistent history of recognized captures. Entries go into an append-only
+// log file that is memory-mapped: appends are copies into the mapping and
+// reads come straight from it. An inverted index from lower-cased words to
+// entry ids is built when the log is opened and extended with every append,
+// so search() intersects a few posting lists instead of scanning the text.
+// Entries past the size or age limit are dropped oldest first by rewriting
+// the log, which renumbers the rest; loaded() is emitted again when it does.
+//
+// append() only queues the entry; thumbnailing, writing and indexing happen
+// on the history thread, so the capture path never waits for the disk.
+class CaptureHistory : public QObject
+{
+    Q_OBJECT
+public:
+    struct Entry
+    {
+        quint32 id = 0;
+        QDateTime timestamp;
+        // Selection in virtual desktop coordinates.
+        QRect geometry;
+        QString text;
+        bool hasThumbnail = false;
+    };
+
+    explicit CaptureHistory(QObject *parent = nullptr);
+    // Writes the entries that are already queued before returning.
+    ~CaptureHistory() override;
+
+    // Opens (or creates) the log on the history thread and indexes it; the
+    // entries become searchable once loaded() is emitted.
+    void open(const QString &filePath);
+    // Caps the log at maxBytes and drops entries older than maxDays; 0
+    // disables a limit. Applied on open and as the log grows.
+    void setRetention(qint64 maxBytes, int maxDays);
+    // Drops every entry, including the ones still queued.
+    void clear();
+
+    // Queues text with its selection. When frame is not null, pixelRect of it
+    // is scaled down into a thumbnail on the history thread.
+    void append(const QString &text, const QRect &geometry,
+                const QImage &frame = QImage(), const QRect &pixelRect = QRect());
+
+    // Ids of the entries containing every word of query, newest first; each
+    // query word of kMinPrefixLength or more characters also matches words it
+    // is a prefix of, shorter ones only themselves. An empty query lists the
+    // newest entries.
+    QList<quint32> search(const QString &query, int limit = 200) const;
+    Entry entry(quint32 id) const;
+    QImage thumbnail(quint32 id) const;
+    int count() const;
+
+    static constexpr int kMinPrefixLength = 2;
+
+signals:
+    // Both are emitted from the history thread.
+    void loaded(int entries, double elapsedMs);
+    void entryAdded(quint32 id);
+
+private:
+    struct Request
+    {
+        QString text;
+        QRect geometry;
+        QDateTime timestamp;
+        QImage frame;
+        QRect pixelRect;
+    };
+
+    // Where an entry lives in the log.
+    struct Record
+    {
+        qint64 offset = 0;
+        qint64 timestampMs = 0;
+        QRect geometry;
+        quint32 textSize = 0;
+        quint32 thumbnailSize = 0;
+    };
+
+    using Postings = std::map<QString, std::vector<quint32>>;
+
+    void historyLoop();
+    bool openLog(const QString &filePath);
+    void closeLog();
+    void write(const Request &request);
+    bool reserve(qint64 bytes);
+    bool enforceRetention();
+    bool compact(qint64 keepFrom);
+    std::vector<quint32> prefixMatches(const QString &word) const;
+    static void index(Postings *postings, quint32 id, QStringList words);
+    static QStringList tokenize(const QString &text);
+    const uchar *payload(const Record &record) const;
+
+    QThread *m_thread = nullptr;
+
+    // Guards the request queue. m_notEmpty wakes the history thread.
+    QMutex m_queueMutex;
+    QWaitCondition m_notEmpty;
+    QQueue<Request> m_queue;
+    QString m_pendingOpen;
+    bool m_pendingClear = false;
+    bool m_stopping = false;
+    qint64 m_maxBytes = 0;
+    int m_maxDays = 0;
+
+    // Guards the log, the records and the index; held by the history thread
+    // while it changes them and by search() and entry() while they read. Only
+    // the history thread changes them, so it reads them without the lock.
+    mutable QMutex m_mutex;
+    QFile m_file;
+    uchar *m_map = nullptr;
+    qint64 m_capacity = 0;
+    qint64 m_end = 0;
+    std::vector<Record> m_records;
+    Postings m_postings;
+};
+
+#endif // CAPTUREHISTORY_H
@@ -1,10 +1,11 @@
 #include "capturesession.h"
 
+#include "capturebackend.h"
+#include "latencytrace.h"
 #include "selectionoverlay.h"
 
 #include <QCursor>
 #include <QGuiApplication>
-#include <QPixmap>
 #include <QScreen>
 #include <QTimer>
 #include <QtMath>
@@ -14,6 +15,11 @@ CaptureSession::CaptureSession(QObject *parent)
 {
 }
 
+void CaptureSession::setBackend(CaptureBackend *backend)
+{
+    m_backend = backend;
+}
+
 void CaptureSession::setOverlayColor(const QColor &color)
 {
     m_overlayColor = color;
@@ -29,157 +35,225 @@ void CaptureSession::setMultiSelectionEnabled(bool enabled)
     m_multiSelectionEnabled = enabled;
     if (!enabled) {
         m_snapshot = QImage();
+        m_snapshotRect = QRect();
         m_snapshotDpr = 1.0;
         m_hasSnapshot = false;
     }
 }
 
+void CaptureSession::setRetainSnapshot(bool retain)
+{
+    m_retainSnapshot = retain;
+}
+
+void CaptureSession::setShowFrameTimes(bool show)
+{
+    m_showFrameTimes = show;
+}
+
+void CaptureSession::setFreezeFrame(bool freeze)
+{
+    m_freezeFrame = freeze;
+}
+
 void CaptureSession::start()
 {
     if (m_active)
         return;
 
     m_active = true;
+    m_startNs = LatencyTrace::now();
 
-    // Choose and store the screen under the cursor; fall back to primary.
+    // Remember the screen under the cursor; fall back to primary.
     m_screen = QGuiApplication::screenAt(QCursor::pos());
     if (!m_screen)
         m_screen = QGuiApplication::primaryScreen();
 
-    if (!m_screen) {
+    if (!m_screen || !m_backend) {
         emit captureFailed(tr("No screen available."), true);
         m_active = false;
         return;
     }
 
+    m_desktopRect = QRect();
+    const QList<QScreen *> screens = QGuiApplication::screens();
+    for (QScreen *screen : screens)
+        m_desktopRect = m_desktopRect.united(screen->geometry());
+
     beginOverlay();
 }
 
+bool CaptureSession::grabSnapshot(QHash<QScreen *, QImage> *screenImages)
+{
+    qreal dpr = 1.0;
+    m_snapshot = m_backend->grabArea(m_desktopRect, &dpr, screenImages);
+    if (m_snapshot.isNull()) {
+        emit captureFailed(tr("Failed to capture the screen."), true);
+        m_active = false;
+        return false;
+    }
+
+    m_snapshotRect = m_snapshot.rect();
+    m_snapshotDpr = dpr;
+    m_hasSnapshot = true;
+    return true;
+}
+
 void CaptureSession::beginOverlay()
 {
     cleanupOverlay();
 
-    if (m_multiSelectionEnabled) {
-        if (!m_screen) {
-            emit captureFailed(tr("No screen available."), true);
-            m_active = false;
+    QHash<QScreen *, QImage> frozen;
+    if (m_multiSelectionEnabled || m_freezeFrame) {
+        if (!grabSnapshot(&frozen))
             return;
-        }
 
-        const QPixmap snap = m_screen->grabWindow(0);
-        if (snap.isNull()) {
-            emit captureFailed(tr("Failed to capture the screen."), true);
-            m_active = false;
-            return;
+        if (m_multiSelectionEnabled) {
+            // Receivers convert what they need now; without screenshots
+            // nothing else needs the color pixels, so the session lets go of
+            // them.
+            emit snapshotReady(m_snapshot);
+            if (!m_retainSnapshot)
+                m_snapshot = QImage();
         }
-
-        m_snapshot = snap.toImage();
-        m_snapshotDpr = snap.devicePixelRatio();
-        m_hasSnapshot = !m_snapshot.isNull();
+        if (!m_freezeFrame)
+            frozen.clear();
     } else {
         m_snapshot = QImage();
+        m_snapshotRect = QRect();
         m_snapshotDpr = 1.0;
         m_hasSnapshot = false;
     }
 
-    // Create a transient overlay (top-level window).
-    m_overlay = new SelectionOverlay;
-    m_overlay->setColor(m_overlayColor);
-    m_overlay->setMultiSelectionEnabled(m_multiSelectionEnabled);
-    m_overlay->setAttribute(Qt::WA_DeleteOnClose, true);
-    m_overlay->setGeometry(m_screen->geometry());
-    m_overlay->show();
-
-    // When selection finishes, hide overlay, defer grab, then save.
-    connect(m_overlay, &SelectionOverlay::selectionFinished,
-            this, [this](const QRect &logicalRect) {
-                if (logicalRect.isNull()) {
+    // One transient overlay (top-level window) per screen; the one under the
+    // cursor is shown last so it ends up with focus.
+    QList<QScreen *> screens = QGuiApplication::screens();
+    screens.removeOne(m_screen);
+    screens.append(m_screen);
+    for (QScreen *screen : std::as_const(screens)) {
+        auto *overlay = new SelectionOverlay;
+        overlay->setBackground(frozen.value(screen));
+        overlay->setColor(m_overlayColor);
+        overlay->setMultiSelectionEnabled(m_multiSelectionEnabled);
+        overlay->setShowFrameTimes(m_showFrameTimes);
+        overlay->setAttribute(Qt::WA_DeleteOnClose, true);
+        overlay->setGeometry(screen->geometry());
+        m_overlays.append(overlay);
+
+        // Mirror a drag onto the other screens so it can cross monitors.
+        connect(overlay, &SelectionOverlay::selectionChanged,
+                this, [this, source = overlay](const QRect &rect) {
+                    for (const QPointer<SelectionOverlay> &peer : std::as_const(m_overlays)) {
+                        if (peer && peer != source)
+                            peer->showPeerSelection(rect);
+                    }
+                });
+
+        // When selection finishes, hide overlays, defer grab, then save.
+        connect(overlay, &SelectionOverlay::selectionFinished,
+                this, [this, source = overlay](const QRect &logicalRect) {
+                    m_releaseNs = LatencyTrace::now();
+                    if (logicalRect.isNull()) {
+                        cleanupOverlay();
+                        m_active = false;
+                        return;
+                    }
+
+                    if (m_multiSelectionEnabled) {
+                        for (const QPointer<SelectionOverlay> &peer : std::as_const(m_overlays)) {
+                            if (peer && peer != source)
+                                peer->addPeerSelection(logicalRect);
+                        }
+                    }
+
+                    // A grabbed frame already exists, so there is nothing to wait for.
+                    if (m_hasSnapshot) {
+                        performCapture(logicalRect);
+                        return;
+                    }
+
+                    // Ensure overlays are not captured.
+                    if (!m_multiSelectionEnabled) {
+                        for (const QPointer<SelectionOverlay> &peer : std::as_const(m_overlays)) {
+                            if (peer)
+                                peer->hide();
+                        }
+                    }
+
+                    // Give the compositor time to remove them from the frame.
+                    QTimer::singleShot(m_captureDelayMs, this, [this, logicalRect]() {
+                        performCapture(logicalRect);
+                    });
+                });
+
+        // If user cancels, just close/hide the overlays.
+        connect(overlay, &SelectionOverlay::selectionCanceled,
+                this, [this]() {
+                    cleanupOverlay();
+                    m_active = false;
+                    emit captureFailed(QString(), false);
+                });
+
+        connect(overlay, &SelectionOverlay::finishRequested,
+                this, [this]() {
+                    if (!m_multiSelectionEnabled)
+                        return;
                     cleanupOverlay();
                     m_active = false;
-                    return;
-                }
-
-                // Ensure overlay is not captured.
-                if (!m_multiSelectionEnabled) {
-                    if (m_overlay)
-                        m_overlay->hide();
-                }
-
-                // Give the compositor time to remove it from the frame.
-                QTimer::singleShot(m_captureDelayMs, this, [this, logicalRect]() {
-                    performCapture(logicalRect);
+                    emit multiCaptureFinished();
                 });
-            });
-
-    // If user cancels, just close/hide the overlay.
-    connect(m_overlay, &SelectionOverlay::selectionCanceled,
-            this, [this]() {
-                cleanupOverlay();
-                m_active = false;
-                emit captureFailed(QString(), false);
-            });
-
-    connect(m_overlay, &QObject::destroyed,
-            this, [this]() {
-                m_overlay = nullptr;
-            });
-
-    connect(m_overlay, &SelectionOverlay::finishRequested,
-            this, [this]() {
-                if (!m_multiSelectionEnabled)
-                    return;
-                cleanupOverlay();
-                m_active = false;
-                emit multiCaptureFinished();
-            });
+    }
+
+    for (const QPointer<SelectionOverlay> &overlay : std::as_const(m_overlays))
+        overlay->show();
+    LatencyTrace::instance().record(LatencyTrace::Stage::OverlayShown, m_startNs, LatencyTrace::now());
 }
 
 void CaptureSession::performCapture(const QRect &selectionLogical)
 {
     QImage sourceImage;
-    qreal dpr = 1.0;
+    QRect sourceRect;
+    QRect pixelRect;
 
-    if (m_multiSelectionEnabled && m_hasSnapshot) {
+    if (m_hasSnapshot) {
         sourceImage = m_snapshot;
-        dpr = m_snapshotDpr;
-    } else {
-        if (m_overlay)
-            m_overlay->hide();
-
-        if (!m_screen) {
-            emit captureFailed(tr("No screen available."), true);
-            cleanupOverlay();
-            m_active = false;
-            return;
+        sourceRect = m_snapshotRect;
+
+        // The selection rectangle comes from the overlays in "logical" coordinates (DPI-independent).
+        // The snapshot uses real screen pixels. On Retina/HiDPI displays, 1 logical unit
+        // can equal 2 or more physical pixels. Multiply by devicePixelRatio (dpr) to match them.
+        const QRect local = selectionLogical.translated(-m_desktopRect.topLeft());
+        pixelRect = QRect(
+            qRound(local.x()      * m_snapshotDpr),
+            qRound(local.y()      * m_snapshotDpr),
+            qRound(local.width()  * m_snapshotDpr),
+            qRound(local.height() * m_snapshotDpr)
+            );
+    } else if (m_desktopRect.intersects(selectionLogical)) {
+        for (const QPointer<SelectionOverlay> &overlay : std::as_const(m_overlays)) {
+            if (overlay)
+                overlay->hide();
         }
 
-        const QPixmap snap = m_screen->grabWindow(0);
-        if (snap.isNull()) {
+        qreal dpr = 1.0;
+        sourceImage = m_backend->grabArea(selectionLogical, &dpr);
+        if (sourceImage.isNull()) {
             emit captureFailed(tr("Failed to capture the screen."), true);
             cleanupOverlay();
             m_active = false;
             return;
         }
-
-        sourceImage = snap.toImage();
-        dpr = snap.devicePixelRatio();
+        sourceRect = sourceImage.rect();
+        pixelRect = sourceRect;
     }
 
-    // The selection rectangle comes from the overlay in "logical" coordinates (DPI-independent).
-    // The screenshot pixmap uses real screen pixels. On Retina/HiDPI displays, 1 logical unit
-    // can equal 2 or more physical pixels. Multiply by devicePixelRatio (dpr) to match them.
-    const QRect pixelRect(
-        qRound(selectionLogical.x()      * dpr),
-        qRound(selectionLogical.y()      * dpr),
-        qRound(selectionLogical.width()  * dpr),
-        qRound(selectionLogical.height() * dpr)
-        );
-
-    if (!sourceImage.rect().contains(pixelRect)) {
+    if (!sourceRect.contains(pixelRect)) {
         emit captureFailed(tr("Selection is out of bounds."), false);
         if (m_multiSelectionEnabled) {
-            if (m_overlay)
-                m_overlay->removeLastSelection();
+            for (const QPointer<SelectionOverlay> &overlay : std::as_const(m_overlays)) {
+                if (overlay)
+                    overlay->removeLastSelection();
+            }
         } else {
             cleanupOverlay();
         }
@@ -187,14 +261,11 @@ void CaptureSession::performCapture(const QRect &selectionLogical)
         return;
     }
 
-    emit captureReady(sourceImage.copy(pixelRect));
+    LatencyTrace::instance().record(LatencyTrace::Stage::ReleaseToCapture, m_releaseNs, LatencyTrace::now());
+    m_lastSelection = selectionLogical;
+    emit captureReady(sourceImage, pixelRect);
 
-    if (m_multiSelectionEnabled) {
-        if (m_overlay) {
-            m_overlay->show();
-            m_overlay->update();
-        }
-    } else {
+    if (!m_multiSelectionEnabled) {
         cleanupOverlay();
         m_active = false;
     }
@@ -202,11 +273,13 @@ void CaptureSession::performCapture(const QRect &selectionLogical)
 
 void CaptureSession::cleanupOverlay()
 {
-    if (m_overlay) {
-        m_overlay->close();
-        m_overlay = nullptr;
+    for (const QPointer<SelectionOverlay> &overlay : std::as_const(m_overlays)) {
+        if (overlay)
+            overlay->close();
     }
+    m_overlays.clear();
     m_snapshot = QImage();
+    m_snapshotRect = QRect();
     m_snapshotDpr = 1.0;
     m_hasSnapshot = false;
 }
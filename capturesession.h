@@ -3,40 +3,76 @@
 
 #include <QObject>
 #include <QColor>
+#include <QHash>
 #include <QImage>
+#include <QList>
 #include <QPointer>
 #include <QRect>
 
+class CaptureBackend;
 class QScreen;
 class SelectionOverlay;
 
-// Handles the lifetime of a selection overlay and emits the cropped frame once
-// the compositor has removed the overlay from the captured screen.
+// Handles the lifetime of the selection overlays, one per screen, and emits the
+// cropped frame once the compositor has removed them from the captured screens.
+// Selections live in virtual desktop coordinates and may span monitors.
 class CaptureSession : public QObject
 {
     Q_OBJECT
 public:
     explicit CaptureSession(QObject *parent = nullptr);
 
+    // Reads the screen pixels; must be set before start().
+    void setBackend(CaptureBackend *backend);
     void setOverlayColor(const QColor &color);
     void setCaptureDelay(int delayMs);
     void setMultiSelectionEnabled(bool enabled);
     bool multiSelectionEnabled() const { return m_multiSelectionEnabled; }
+    // Whether a multi-selection session keeps the color snapshot for
+    // captureReady(). When off, the snapshot is handed out once through
+    // snapshotReady() and captureReady() carries a null frame.
+    void setRetainSnapshot(bool retain);
+    // Shows the overlay's frame-time counter while dragging.
+    void setShowFrameTimes(bool show);
+    // Freeze-frame mode: the screen is grabbed before the overlay appears and
+    // the overlay is drawn over that frozen frame, so a selection is cropped
+    // from it immediately instead of hiding the overlay and waiting for the
+    // compositor before grabbing.
+    void setFreezeFrame(bool freeze);
+    bool freezeFrame() const { return m_freezeFrame; }
+
+    // The latest selection, in virtual desktop coordinates.
+    QRect lastSelection() const { return m_lastSelection; }
+
+    // When the latest selection was released, on LatencyTrace's clock.
+    qint64 lastReleaseNs() const { return m_releaseNs; }
 
     void start();
 
 signals:
-    void captureReady(const QImage &image);
+    // frame is either the session's snapshot of the desktop (shared, not
+    // copied) or just the selection stitched from the screens it touches;
+    // pixelRect is the selection in frame pixels. Consumers crop only what
+    // they need.
+    void captureReady(const QImage &frame, const QRect &pixelRect);
+    // Multi-selection only: the frame every selection of the session is cut
+    // from, emitted once when the session starts.
+    void snapshotReady(const QImage &frame);
     void captureFailed(const QString &errorMessage, bool fatal);
     void multiCaptureFinished();
 
 private:
     void beginOverlay();
+    bool grabSnapshot(QHash<QScreen *, QImage> *screenImages);
     void performCapture(const QRect &logicalRect);
     void cleanupOverlay();
 
-    // Screen chosen for the current capture session.
+    CaptureBackend *m_backend = nullptr;
+
+    // Screen under the cursor when the session started; its overlay gets focus.
     QScreen *m_screen = nullptr;
+    // Bounding rectangle of all screens, in logical coordinates.
+    QRect m_desktopRect;
 
     // Color used for the live overlay border/fill.
     QColor m_overlayColor = QColor("red");
@@ -44,14 +80,25 @@ private:
     // Time to wait before grabbing so the overlay is no longer visible.
     int m_captureDelayMs = 0;
 
-    // The top-level overlay widget, owned/lifetime-managed by the session.
-    QPointer<SelectionOverlay> m_overlay;
+    // The top-level overlay widgets, one per screen, owned/lifetime-managed by
+    // the session.
+    QList<QPointer<SelectionOverlay>> m_overlays;
 
     // Guards against running multiple captures at once.
     bool m_active = false;
 
     bool m_multiSelectionEnabled = false;
+    bool m_retainSnapshot = true;
+    bool m_showFrameTimes = false;
+    bool m_freezeFrame = false;
+    // start() and the latest mouse release, on LatencyTrace's clock.
+    qint64 m_startNs = 0;
+    qint64 m_releaseNs = 0;
+    QRect m_lastSelection;
+    // Snapshot of the whole desktop (m_desktopRect) at m_snapshotDpr.
     QImage m_snapshot;
+    // Bounds of the snapshot, kept when its pixels are not.
+    QRect m_snapshotRect;
     qreal m_snapshotDpr = 1.0;
     bool m_hasSnapshot = false;
 };
@@ -0,0 +1,125 @@
+#include "grayimage.h"
+
+#include "hashing.h"
+#include "imagekernels.h"
+
+#include <QImage>
+#include <QRect>
+
+#include <algorithm>
+
+namespace {
+
+// Allocations up to this size are always kept.
+constexpr size_t kKeepBytes = 4 * 1024 * 1024;
+// Larger ones are given back once a resize needs less than 1/kShrinkFactor of them.
+constexpr size_t kShrinkFactor = 4;
+
+} // namespace
+
+GrayImage::GrayImage(int width, int height)
+{
+    resize(width, height);
+}
+
+void GrayImage::resize(int width, int height)
+{
+    m_width = qMax(0, width);
+    m_height = qMax(0, height);
+    // Pad rows to 32 bytes so every scanline starts on a SIMD-friendly offset.
+    m_stride = (qsizetype(m_width) + 31) & ~qsizetype(31);
+    const size_t needed = size_t(m_stride) * size_t(m_height);
+    if (m_data.size() > kKeepBytes && m_data.size() > kShrinkFactor * needed)
+        std::vector<uchar>(needed).swap(m_data);
+    else if (m_data.size() < needed)
+        m_data.resize(needed);
+}
+
+void GrayImage::release()
+{
+    std::vector<uchar>().swap(m_data);
+    m_width = 0;
+    m_height = 0;
+    m_stride = 0;
+}
+
+bool GrayImage::loadFrom(const QImage &frame, const QRect &rect)
+{
+    if (frame.isNull())
+        return false;
+
+    const QRect area = rect.isNull() ? frame.rect() : rect;
+    if (area.isEmpty() || !frame.rect().contains(area))
+        return false;
+
+    resize(area.width(), area.height());
+
+    switch (frame.format()) {
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied: {
+        // Screen grabs are opaque, so premultiplication does not affect luma.
+        const uchar *origin = frame.constScanLine(area.top()) + qsizetype(area.left()) * 4;
+        ImageKernels::xrgb32ToGray(origin, frame.bytesPerLine(),
+                                   area.width(), area.height(),
+                                   bits(), m_stride);
+        return true;
+    }
+    case QImage::Format_Grayscale8:
+        for (int y = 0; y < area.height(); ++y) {
+            std::copy_n(frame.constScanLine(area.top() + y) + area.left(),
+                        area.width(),
+                        scanLine(y));
+        }
+        return true;
+    default: {
+        // Uncommon grab formats: convert only the selected block, then reuse the fast path.
+        const QImage block = frame.copy(area).convertToFormat(QImage::Format_RGB32);
+        ImageKernels::xrgb32ToGray(block.constBits(), block.bytesPerLine(),
+                                   block.width(), block.height(),
+                                   bits(), m_stride);
+        return true;
+    }
+    }
+}
+
+bool GrayImage::copyFrom(const GrayImage &source, const QRect &rect)
+{
+    if (source.isNull() || &source == this)
+        return false;
+
+    const QRect area = rect.isNull() ? source.rect() : rect;
+    if (area.isEmpty() || !source.rect().contains(area))
+        return false;
+
+    resize(area.width(), area.height());
+    for (int y = 0; y < area.height(); ++y) {
+        std::copy_n(source.constScanLine(area.top() + y) + area.left(),
+                    area.width(),
+                    scanLine(y));
+    }
+    return true;
+}
+
+quint64 GrayImage::contentHash(quint64 seed) const
+{
+    return contentHash(rect(), seed);
+}
+
+quint64 GrayImage::contentHash(const QRect &rect, quint64 seed) const
+{
+    const QRect area = rect.intersected(this->rect());
+    Xxh64 hash(seed);
+    hash.updateValue(qint32(area.width()));
+    hash.updateValue(qint32(area.height()));
+    for (int y = area.top(); y <= area.bottom(); ++y)
+        hash.update(constScanLine(y) + area.left(), size_t(area.width()));
+    return hash.digest();
+}
+
+QImage GrayImage::view() const
+{
+    if (isNull())
+        return {};
+    return QImage(constBits(), m_width, m_height, m_stride, QImage::Format_Grayscale8);
+}
@@ -0,0 +1,61 @@
+#ifndef GRAYIMAGE_H
+#define GRAYIMAGE_H
+
+#include <QRect>
+#include <QtGlobal>
+
+#include <vector>
+
+class QImage;
+
+// 8-bit luminance buffer handed to Tesseract. Unlike QImage it keeps its
+// allocation across resizes, so a worker can reuse one buffer for every
+// capture instead of allocating a full frame each time.
+class GrayImage
+{
+public:
+    GrayImage() = default;
+    GrayImage(int width, int height);
+
+    // Changes the dimensions. The pixels are undefined afterwards. The
+    // allocation is reused, unless it is far larger than needed, so one huge
+    // capture does not pin its memory for the life of the buffer.
+    void resize(int width, int height);
+    // Drops the pixels and gives the memory back.
+    void release();
+
+    // Fused crop + grayscale conversion: reads the rect (in frame pixels)
+    // straight out of frame and writes luminance into this buffer. A null rect
+    // converts the whole frame. Returns false for null or out-of-bounds input.
+    bool loadFrom(const QImage &frame, const QRect &rect);
+    // Copies rect of an already converted buffer (no color conversion).
+    bool copyFrom(const GrayImage &source, const QRect &rect);
+
+    bool isNull() const { return m_width <= 0 || m_height <= 0; }
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    qsizetype bytesPerLine() const { return m_stride; }
+    QRect rect() const { return QRect(0, 0, m_width, m_height); }
+
+    uchar *bits() { return m_data.data(); }
+    const uchar *constBits() const { return m_data.data(); }
+    uchar *scanLine(int y) { return m_data.data() + y * m_stride; }
+    const uchar *constScanLine(int y) const { return m_data.data() + y * m_stride; }
+
+    // XXH64 of the dimensions and visible pixels (row padding excluded).
+    quint64 contentHash(quint64 seed = 0) const;
+    // Same as contentHash() of a copy of rect, without copying.
+    quint64 contentHash(const QRect &rect, quint64 seed = 0) const;
+
+    // Shallow Format_Grayscale8 view of the buffer; only valid while this
+    // object is alive and not resized.
+    QImage view() const;
+
+private:
+    std::vector<uchar> m_data;
+    int m_width = 0;
+    int m_height = 0;
+    qsizetype m_stride = 0;
+};
+
+#endif // GRAYIMAGE_H
@@ -0,0 +1,151 @@
+#include "hashing.h"
+
+#include <cstring>
+
+namespace {
+
+constexpr quint64 kPrime1 = 11400714785074694791ULL;
+constexpr quint64 kPrime2 = 14029467366897019727ULL;
+constexpr quint64 kPrime3 = 1609587929392839161ULL;
+constexpr quint64 kPrime4 = 9650029242287828579ULL;
+constexpr quint64 kPrime5 = 2870177450012600261ULL;
+
+inline quint64 rotl(quint64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+// Unaligned little-endian loads; memcpy compiles to a single mov.
+inline quint64 read64(const unsigned char *p)
+{
+    quint64 v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline quint32 read32(const unsigned char *p)
+{
+    quint32 v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline quint64 round(quint64 acc, quint64 input)
+{
+    acc += input * kPrime2;
+    acc = rotl(acc, 31);
+    return acc * kPrime1;
+}
+
+inline quint64 mergeRound(quint64 acc, quint64 value)
+{
+    acc ^= round(0, value);
+    return acc * kPrime1 + kPrime4;
+}
+
+} // namespace
+
+Xxh64::Xxh64(quint64 seed)
+{
+    reset(seed);
+}
+
+void Xxh64::reset(quint64 seed)
+{
+    m_seed = seed;
+    m_acc[0] = seed + kPrime1 + kPrime2;
+    m_acc[1] = seed + kPrime2;
+    m_acc[2] = seed;
+    m_acc[3] = seed - kPrime1;
+    m_totalLength = 0;
+    m_buffered = 0;
+}
+
+void Xxh64::update(const void *data, size_t length)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    const unsigned char *const end = p + length;
+    m_totalLength += length;
+
+    if (m_buffered + length < 32) {
+        std::memcpy(m_buffer + m_buffered, p, length);
+        m_buffered += length;
+        return;
+    }
+
+    if (m_buffered > 0) {
+        const size_t fill = 32 - m_buffered;
+        std::memcpy(m_buffer + m_buffered, p, fill);
+        p += fill;
+        for (int i = 0; i < 4; ++i)
+            m_acc[i] = round(m_acc[i], read64(m_buffer + 8 * i));
+        m_buffered = 0;
+    }
+
+    quint64 v0 = m_acc[0];
+    quint64 v1 = m_acc[1];
+    quint64 v2 = m_acc[2];
+    quint64 v3 = m_acc[3];
+    while (end - p >= 32) {
+        v0 = round(v0, read64(p));
+        v1 = round(v1, read64(p + 8));
+        v2 = round(v2, read64(p + 16));
+        v3 = round(v3, read64(p + 24));
+        p += 32;
+    }
+    m_acc[0] = v0;
+    m_acc[1] = v1;
+    m_acc[2] = v2;
+    m_acc[3] = v3;
+
+    m_buffered = size_t(end - p);
+    std::memcpy(m_buffer, p, m_buffered);
+}
+
+quint64 Xxh64::digest() const
+{
+    quint64 h;
+    if (m_totalLength >= 32) {
+        h = rotl(m_acc[0], 1) + rotl(m_acc[1], 7) + rotl(m_acc[2], 12) + rotl(m_acc[3], 18);
+        for (int i = 0; i < 4; ++i)
+            h = mergeRound(h, m_acc[i]);
+    } else {
+        h = m_seed + kPrime5;
+    }
+    h += m_totalLength;
+
+    const unsigned char *p = m_buffer;
+    size_t remaining = m_buffered;
+    while (remaining >= 8) {
+        h ^= round(0, read64(p));
+        h = rotl(h, 27) * kPrime1 + kPrime4;
+        p += 8;
+        remaining -= 8;
+    }
+    if (remaining >= 4) {
+        h ^= quint64(read32(p)) * kPrime1;
+        h = rotl(h, 23) * kPrime2 + kPrime3;
+        p += 4;
+        remaining -= 4;
+    }
+    while (remaining > 0) {
+        h ^= (*p) * kPrime5;
+        h = rotl(h, 11) * kPrime1;
+        ++p;
+        --remaining;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+quint64 Xxh64::hash(const void *data, size_t length, quint64 seed)
+{
+    Xxh64 state(seed);
+    state.update(data, length);
+    return state.digest();
+}
@@ -0,0 +1,31 @@
+#ifndef HASHING_H
+#define HASHING_H
+
+#include <QtGlobal>
+
+// Streaming XXH64 (https://github.com/Cyan4973/xxHash): a non-cryptographic
+// hash running at memory bandwidth, used to fingerprint captured pixels.
+// Feeding data in several update() calls gives the same digest as hashing
+// the concatenation at once, so strided images can be hashed row by row.
+class Xxh64
+{
+public:
+    explicit Xxh64(quint64 seed = 0);
+
+    void reset(quint64 seed = 0);
+    void update(const void *data, size_t length);
+    template <typename T>
+    void updateValue(const T &value) { update(&value, sizeof(value)); }
+    quint64 digest() const;
+
+    static quint64 hash(const void *data, size_t length, quint64 seed = 0);
+
+private:
+    quint64 m_acc[4];
+    quint64 m_seed = 0;
+    quint64 m_totalLength = 0;
+    unsigned char m_buffer[32];
+    size_t m_buffered = 0;
+};
+
+#endif // HASHING_H
@@ -0,0 +1,109 @@
+#include "historywindow.h"
+
+#include "capturehistory.h"
+
+#include <QClipboard>
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QLabel>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QPixmap>
+#include <QPlainTextEdit>
+#include <QSplitter>
+#include <QTimer>
+#include <QVBoxLayout>
+
+HistoryWindow::HistoryWindow(CaptureHistory *history, QWidget *parent)
+    : QWidget(parent, Qt::Window)
+    , m_history(history)
+{
+    setWindowTitle(tr("Capture History"));
+    resize(720, 480);
+
+    m_searchEdit = new QLineEdit(this);
+    m_searchEdit->setPlaceholderText(tr("Search captured text"));
+    m_searchEdit->setClearButtonEnabled(true);
+
+    m_list = new QListWidget(this);
+    m_list->setIconSize(QSize(80, 60));
+    m_list->setUniformItemSizes(true);
+
+    m_text = new QPlainTextEdit(this);
+    m_text->setReadOnly(true);
+
+    m_status = new QLabel(this);
+
+    auto *splitter = new QSplitter(this);
+    splitter->addWidget(m_list);
+    splitter->addWidget(m_text);
+    splitter->setStretchFactor(1, 1);
+
+    auto *layout = new QVBoxLayout(this);
+    layout->addWidget(m_searchEdit);
+    layout->addWidget(splitter, 1);
+    layout->addWidget(m_status);
+
+    m_refreshTimer = new QTimer(this);
+    m_refreshTimer->setSingleShot(true);
+    m_refreshTimer->setInterval(100);
+
+    connect(m_searchEdit, &QLineEdit::textChanged, this, &HistoryWindow::runSearch);
+    connect(m_list, &QListWidget::currentRowChanged, this, &HistoryWindow::showEntry);
+    connect(m_list, &QListWidget::itemActivated, this, &HistoryWindow::copyEntry);
+    connect(m_refreshTimer, &QTimer::timeout, this, &HistoryWindow::runSearch);
+    connect(m_history, &CaptureHistory::entryAdded, m_refreshTimer, qOverload<>(&QTimer::start));
+    // Dropping old entries renumbers the rest, so cached icons go with them.
+    connect(m_history, &CaptureHistory::loaded, this, [this]() {
+        m_icons.clear();
+        m_refreshTimer->start();
+    });
+
+    runSearch();
+}
+
+void HistoryWindow::runSearch()
+{
+    QElapsedTimer timer;
+    timer.start();
+    const QList<quint32> ids = m_history->search(m_searchEdit->text());
+    const double searchMs = timer.nsecsElapsed() / 1e6;
+
+    m_list->clear();
+    m_text->clear();
+    for (const quint32 id : ids) {
+        const CaptureHistory::Entry entry = m_history->entry(id);
+        const QString firstLine = entry.text.section('\n', 0, 0).simplified();
+        auto *item = new QListWidgetItem(entry.timestamp.toString(QStringLiteral("yyyy-MM-dd HH:mm"))
+                                             + '\n' + firstLine.left(80),
+                                         m_list);
+        item->setData(Qt::UserRole, id);
+        if (entry.hasThumbnail) {
+            auto icon = m_icons.find(id);
+            if (icon == m_icons.end())
+                icon = m_icons.insert(id, QIcon(QPixmap::fromImage(m_history->thumbnail(id))));
+            item->setIcon(*icon);
+        }
+    }
+
+    m_status->setText(tr("%n result(s) of %1 in %2 ms", nullptr, ids.size())
+                          .arg(m_history->count())
+                          .arg(searchMs, 0, 'f', 2));
+    if (m_list->count() > 0)
+        m_list->setCurrentRow(0);
+}
+
+void HistoryWindow::showEntry()
+{
+    const QListWidgetItem *item = m_list->currentItem();
+    m_text->setPlainText(item ? m_history->entry(item->data(Qt::UserRole).toUInt()).text : QString());
+}
+
+void HistoryWindow::copyEntry()
+{
+    const QListWidgetItem *item = m_list->currentItem();
+    if (!item)
+        return;
+    if (QClipboard *cb = QGuiApplication::clipboard())
+        cb->setText(m_history->entry(item->data(Qt::UserRole).toUInt()).text, QClipboard::Clipboard);
+}
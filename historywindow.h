@@ -0,0 +1,40 @@
+#ifndef HISTORYWINDOW_H
+#define HISTORYWINDOW_H
+
+#include <QHash>
+#include <QIcon>
+#include <QWidget>
+
+class QLabel;
+class QLineEdit;
+class QListWidget;
+class QPlainTextEdit;
+class QTimer;
+
+class CaptureHistory;
+
+// Browses the capture history. The list is searched again on every keystroke;
+// double-clicking an entry copies its text to the clipboard.
+class HistoryWindow : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit HistoryWindow(CaptureHistory *history, QWidget *parent = nullptr);
+
+private:
+    void runSearch();
+    void showEntry();
+    void copyEntry();
+
+    CaptureHistory *m_history;
+    QLineEdit *m_searchEdit;
+    QListWidget *m_list;
+    QPlainTextEdit *m_text;
+    QLabel *m_status;
+    // Coalesces the refreshes of entries added in a burst.
+    QTimer *m_refreshTimer;
+    // Decoded thumbnails, until the history is reloaded.
+    QHash<quint32, QIcon> m_icons;
+};
+
+#endif // HISTORYWINDOW_H
@@ -0,0 +1,709 @@
+#include "imagekernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#  define SNIPTEXT_X86 1
+#  include <immintrin.h>
+#  if defined(_MSC_VER) && !defined(__clang__)
+#    include <intrin.h>
+#    define SNIPTEXT_TARGET_AVX2
+#  else
+#    define SNIPTEXT_TARGET_AVX2 __attribute__((target("avx2")))
+#  endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  define SNIPTEXT_NEON 1
+#  include <arm_neon.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// Y = (77 R + 150 G + 29 B + 128) >> 8; the weights sum to 256 so white maps to 255.
+constexpr int kWeightR = 77;
+constexpr int kWeightG = 150;
+constexpr int kWeightB = 29;
+
+inline uchar lumaOf(quint32 px)
+{
+    const quint32 r = (px >> 16) & 0xff;
+    const quint32 g = (px >> 8) & 0xff;
+    const quint32 b = px & 0xff;
+    return uchar((r * kWeightR + g * kWeightG + b * kWeightB + 128) >> 8);
+}
+
+void grayRowScalar(const quint32 *src, uchar *dst, int width)
+{
+    for (int x = 0; x < width; ++x)
+        dst[x] = lumaOf(src[x]);
+}
+
+#if defined(SNIPTEXT_X86)
+
+// 16-bit lanes are enough: the weighted sum never exceeds 65535, so the
+// multiply/add wrap-around is harmless and a logical shift recovers the result.
+inline __m128i lumaEpi16Sse2(__m128i r, __m128i g, __m128i b)
+{
+    __m128i sum = _mm_mullo_epi16(r, _mm_set1_epi16(kWeightR));
+    sum = _mm_add_epi16(sum, _mm_mullo_epi16(g, _mm_set1_epi16(kWeightG)));
+    sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi16(kWeightB)));
+    sum = _mm_add_epi16(sum, _mm_set1_epi16(128));
+    return _mm_srli_epi16(sum, 8);
+}
+
+// Eight pixels -> eight 16-bit luma values.
+inline __m128i luma8Sse2(const quint32 *src)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    const __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+    const __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 4));
+
+    const __m128i b = _mm_packs_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+    const __m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask),
+                                      _mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+    const __m128i r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask),
+                                      _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+    return lumaEpi16Sse2(r, g, b);
+}
+
+void grayRowSse2(const quint32 *src, uchar *dst, int width)
+{
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const __m128i lo = luma8Sse2(src + x);
+        const __m128i hi = luma8Sse2(src + x + 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), _mm_packus_epi16(lo, hi));
+    }
+    for (; x + 8 <= width; x += 8) {
+        const __m128i lo = luma8Sse2(src + x);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + x), _mm_packus_epi16(lo, lo));
+    }
+    grayRowScalar(src + x, dst + x, width - x);
+}
+
+SNIPTEXT_TARGET_AVX2 void grayRowAvx2(const quint32 *src, uchar *dst, int width)
+{
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    const __m256i wr = _mm256_set1_epi16(kWeightR);
+    const __m256i wg = _mm256_set1_epi16(kWeightG);
+    const __m256i wb = _mm256_set1_epi16(kWeightB);
+    const __m256i round = _mm256_set1_epi16(128);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const __m256i p0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + x));
+        const __m256i p1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + x + 8));
+
+        // The packs work per 128-bit lane, leaving the pixels ordered as
+        // 0-3, 8-11, 4-7, 12-15; the permute below restores the order.
+        const __m256i b = _mm256_packs_epi32(_mm256_and_si256(p0, mask),
+                                             _mm256_and_si256(p1, mask));
+        const __m256i g = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 8), mask),
+                                             _mm256_and_si256(_mm256_srli_epi32(p1, 8), mask));
+        const __m256i r = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 16), mask),
+                                             _mm256_and_si256(_mm256_srli_epi32(p1, 16), mask));
+
+        __m256i sum = _mm256_mullo_epi16(r, wr);
+        sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(g, wg));
+        sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(b, wb));
+        sum = _mm256_srli_epi16(_mm256_add_epi16(sum, round), 8);
+        sum = _mm256_permute4x64_epi64(sum, _MM_SHUFFLE(3, 1, 2, 0));
+
+        const __m128i packed = _mm_packus_epi16(_mm256_castsi256_si128(sum),
+                                                _mm256_extracti128_si256(sum, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), packed);
+    }
+    grayRowSse2(src + x, dst + x, width - x);
+}
+
+bool cpuHasAvx2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4] = {};
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#elif defined(SNIPTEXT_NEON)
+
+void grayRowNeon(const quint32 *src, uchar *dst, int width)
+{
+    const uint8x8_t wr = vdup_n_u8(kWeightR);
+    const uint8x8_t wg = vdup_n_u8(kWeightG);
+    const uint8x8_t wb = vdup_n_u8(kWeightB);
+
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        // Little-endian xRGB is stored as B, G, R, X bytes.
+        const uint8x8x4_t px = vld4_u8(reinterpret_cast<const uint8_t *>(src + x));
+        uint16x8_t sum = vmull_u8(px.val[2], wr);
+        sum = vmlal_u8(sum, px.val[1], wg);
+        sum = vmlal_u8(sum, px.val[0], wb);
+        vst1_u8(dst + x, vrshrn_n_u16(sum, 8));
+    }
+    grayRowScalar(src + x, dst + x, width - x);
+}
+
+#endif
+
+// Sixteen-lane byte operations shared by the 8-bit kernels. Every kernel also
+// has a scalar tail that uses the uchar overloads, so the filter code below is
+// written once for both.
+inline uchar minv(uchar a, uchar b) { return a < b ? a : b; }
+inline uchar maxv(uchar a, uchar b) { return a > b ? a : b; }
+
+#if defined(SNIPTEXT_X86)
+#  define SNIPTEXT_HAVE_U8X16 1
+using U8x16 = __m128i;
+inline U8x16 load16(const uchar *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+inline void store16(uchar *p, U8x16 v) { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v); }
+inline U8x16 splat16(uchar v) { return _mm_set1_epi8(char(v)); }
+inline U8x16 minv(U8x16 a, U8x16 b) { return _mm_min_epu8(a, b); }
+inline U8x16 maxv(U8x16 a, U8x16 b) { return _mm_max_epu8(a, b); }
+inline U8x16 xorv(U8x16 a, U8x16 b) { return _mm_xor_si128(a, b); }
+// 0xff where a > b.
+inline U8x16 greaterv(U8x16 a, U8x16 b) { return _mm_xor_si128(_mm_cmpeq_epi8(_mm_max_epu8(b, a), b), _mm_set1_epi8(-1)); }
+#elif defined(SNIPTEXT_NEON)
+#  define SNIPTEXT_HAVE_U8X16 1
+using U8x16 = uint8x16_t;
+inline U8x16 load16(const uchar *p) { return vld1q_u8(p); }
+inline void store16(uchar *p, U8x16 v) { vst1q_u8(p, v); }
+inline U8x16 splat16(uchar v) { return vdupq_n_u8(v); }
+inline U8x16 minv(U8x16 a, U8x16 b) { return vminq_u8(a, b); }
+inline U8x16 maxv(U8x16 a, U8x16 b) { return vmaxq_u8(a, b); }
+inline U8x16 xorv(U8x16 a, U8x16 b) { return veorq_u8(a, b); }
+inline U8x16 greaterv(U8x16 a, U8x16 b) { return vcgtq_u8(a, b); }
+#endif
+
+// Sorts a pair in place so that a <= b.
+template <typename T>
+inline void sortPair(T &a, T &b)
+{
+    const T lo = minv(a, b);
+    b = maxv(a, b);
+    a = lo;
+}
+
+// Median of nine with the classic 19 compare-exchange network.
+template <typename T>
+inline T median9(T p0, T p1, T p2, T p3, T p4, T p5, T p6, T p7, T p8)
+{
+    sortPair(p1, p2); sortPair(p4, p5); sortPair(p7, p8);
+    sortPair(p0, p1); sortPair(p3, p4); sortPair(p6, p7);
+    sortPair(p1, p2); sortPair(p4, p5); sortPair(p7, p8);
+    sortPair(p0, p3); sortPair(p5, p8); sortPair(p4, p7);
+    sortPair(p3, p6); sortPair(p1, p4); sortPair(p2, p5);
+    sortPair(p4, p7); sortPair(p4, p2); sortPair(p6, p4);
+    sortPair(p4, p2);
+    return p4;
+}
+
+using GrayRowFn = void (*)(const quint32 *, uchar *, int);
+
+struct Dispatch
+{
+    GrayRowFn grayRow = grayRowScalar;
+    const char *name = "scalar";
+};
+
+Dispatch detectDispatch()
+{
+    Dispatch d;
+#if defined(SNIPTEXT_X86)
+    if (cpuHasAvx2()) {
+        d.grayRow = grayRowAvx2;
+        d.name = "avx2";
+    } else {
+        // SSE2 is part of the x86-64 baseline.
+        d.grayRow = grayRowSse2;
+        d.name = "sse2";
+    }
+#elif defined(SNIPTEXT_NEON)
+    d.grayRow = grayRowNeon;
+    d.name = "neon";
+#endif
+    return d;
+}
+
+const Dispatch &dispatch()
+{
+    static const Dispatch d = detectDispatch();
+    return d;
+}
+
+} // namespace
+
+void ImageKernels::xrgb32ToGray(const uchar *src, qsizetype srcStride,
+                                int width, int height,
+                                uchar *dst, qsizetype dstStride)
+{
+    const GrayRowFn grayRow = dispatch().grayRow;
+    for (int y = 0; y < height; ++y) {
+        grayRow(reinterpret_cast<const quint32 *>(src + y * srcStride),
+                dst + y * dstStride,
+                width);
+    }
+}
+
+void ImageKernels::histogram(const uchar *src, qsizetype stride, int width, int height,
+                             quint32 hist[256])
+{
+    // Four sub-histograms hide the store-to-load dependency on runs of equal pixels.
+    std::vector<quint32> sub(4 * 256, 0);
+    for (int y = 0; y < height; ++y) {
+        const uchar *row = src + y * stride;
+        int x = 0;
+        for (; x + 4 <= width; x += 4) {
+            ++sub[row[x]];
+            ++sub[256 + row[x + 1]];
+            ++sub[512 + row[x + 2]];
+            ++sub[768 + row[x + 3]];
+        }
+        for (; x < width; ++x)
+            ++sub[row[x]];
+    }
+    for (int i = 0; i < 256; ++i)
+        hist[i] = sub[i] + sub[256 + i] + sub[512 + i] + sub[768 + i];
+}
+
+int ImageKernels::otsuThreshold(const quint32 hist[256])
+{
+    double total = 0.0;
+    double sum = 0.0;
+    for (int i = 0; i < 256; ++i) {
+        total += hist[i];
+        sum += double(i) * hist[i];
+    }
+    if (total <= 0.0)
+        return 127;
+
+    double weightBg = 0.0;
+    double sumBg = 0.0;
+    double bestVariance = -1.0;
+    int best = 127;
+    for (int t = 0; t < 256; ++t) {
+        weightBg += hist[t];
+        if (weightBg <= 0.0)
+            continue;
+        const double weightFg = total - weightBg;
+        if (weightFg <= 0.0)
+            break;
+        sumBg += double(t) * hist[t];
+        const double meanBg = sumBg / weightBg;
+        const double meanFg = (sum - sumBg) / weightFg;
+        const double variance = weightBg * weightFg * (meanBg - meanFg) * (meanBg - meanFg);
+        if (variance > bestVariance) {
+            bestVariance = variance;
+            best = t;
+        }
+    }
+    return best;
+}
+
+int ImageKernels::percentile(const quint32 hist[256], double fraction)
+{
+    double total = 0.0;
+    for (int i = 0; i < 256; ++i)
+        total += hist[i];
+
+    const double target = total * fraction;
+    double running = 0.0;
+    for (int i = 0; i < 256; ++i) {
+        running += hist[i];
+        if (running >= target && running > 0.0)
+            return i;
+    }
+    return 255;
+}
+
+void ImageKernels::stretchContrast(uchar *data, qsizetype stride, int width, int height,
+                                   int low, int high)
+{
+    low = qBound(0, low, 255);
+    high = qBound(low + 1, high, 256);
+    // 8.8 fixed-point gain; (x - low) * scale >> 8 maps high onto 255.
+    const int scale = qMin(65535, (255 * 256 + (high - low) - 1) / (high - low));
+
+#if defined(SNIPTEXT_X86)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lowv = _mm_set1_epi8(char(low));
+    const __m128i scalev = _mm_set1_epi16(short(quint16(scale)));
+    const __m128i max8 = _mm_set1_epi16(255);
+    // Unsigned min(v, 255) without SSE4.1: v - max(v - 255, 0).
+    const auto clamp8 = [max8](__m128i v) { return _mm_subs_epu16(v, _mm_subs_epu16(v, max8)); };
+#else
+    uchar lut[256];
+    for (int i = 0; i < 256; ++i)
+        lut[i] = uchar(qMin(255, (qMax(0, i - low) * scale) >> 8));
+#endif
+
+    for (int y = 0; y < height; ++y) {
+        uchar *row = data + y * stride;
+        int x = 0;
+#if defined(SNIPTEXT_X86)
+        for (; x + 16 <= width; x += 16) {
+            const __m128i v = _mm_subs_epu8(load16(row + x), lowv);
+            // Unpacking against zero puts each byte in the high half, i.e.
+            // v << 8, so mulhi yields (v * scale) >> 8 directly. That can
+            // reach 65279, which packus would read as negative, so it is
+            // clamped to 255 first.
+            const __m128i lo = clamp8(_mm_mulhi_epu16(_mm_unpacklo_epi8(zero, v), scalev));
+            const __m128i hi = clamp8(_mm_mulhi_epu16(_mm_unpackhi_epi8(zero, v), scalev));
+            store16(row + x, _mm_packus_epi16(lo, hi));
+        }
+        for (; x < width; ++x)
+            row[x] = uchar(qMin(255, (qMax(0, row[x] - low) * scale) >> 8));
+#else
+        for (; x < width; ++x)
+            row[x] = lut[row[x]];
+#endif
+    }
+}
+
+void ImageKernels::invert(uchar *data, qsizetype stride, int width, int height)
+{
+    for (int y = 0; y < height; ++y) {
+        uchar *row = data + y * stride;
+        int x = 0;
+#if defined(SNIPTEXT_HAVE_U8X16)
+        const U8x16 ones = splat16(0xff);
+        for (; x + 16 <= width; x += 16)
+            store16(row + x, xorv(load16(row + x), ones));
+#endif
+        for (; x < width; ++x)
+            row[x] = uchar(255 - row[x]);
+    }
+}
+
+void ImageKernels::threshold(uchar *data, qsizetype stride, int width, int height, int threshold)
+{
+    threshold = qBound(0, threshold, 255);
+    for (int y = 0; y < height; ++y) {
+        uchar *row = data + y * stride;
+        int x = 0;
+#if defined(SNIPTEXT_HAVE_U8X16)
+        const U8x16 t = splat16(uchar(threshold));
+        for (; x + 16 <= width; x += 16)
+            store16(row + x, greaterv(load16(row + x), t));
+#endif
+        for (; x < width; ++x)
+            row[x] = row[x] > threshold ? 255 : 0;
+    }
+}
+
+void ImageKernels::median3x3(const uchar *src, qsizetype srcStride, int width, int height,
+                             uchar *dst, qsizetype dstStride)
+{
+    if (width <= 0 || height <= 0)
+        return;
+
+    // Rows padded by one replicated pixel on each side so the inner loop needs
+    // no bounds checks.
+    std::vector<uchar> padded(3 * size_t(width + 2));
+    auto fillPadded = [&](int slot, int y) {
+        uchar *p = padded.data() + slot * (width + 2);
+        const uchar *row = src + qBound(0, y, height - 1) * srcStride;
+        std::memcpy(p + 1, row, size_t(width));
+        p[0] = row[0];
+        p[width + 1] = row[width - 1];
+    };
+
+    for (int y = 0; y < height; ++y) {
+        fillPadded(0, y - 1);
+        fillPadded(1, y);
+        fillPadded(2, y + 1);
+        const uchar *a = padded.data();
+        const uchar *b = a + (width + 2);
+        const uchar *c = b + (width + 2);
+        uchar *out = dst + y * dstStride;
+
+        int x = 0;
+#if defined(SNIPTEXT_HAVE_U8X16)
+        for (; x + 16 <= width; x += 16) {
+            store16(out + x, median9(load16(a + x), load16(a + x + 1), load16(a + x + 2),
+                                     load16(b + x), load16(b + x + 1), load16(b + x + 2),
+                                     load16(c + x), load16(c + x + 1), load16(c + x + 2)));
+        }
+#endif
+        for (; x < width; ++x) {
+            out[x] = median9(a[x], a[x + 1], a[x + 2],
+                             b[x], b[x + 1], b[x + 2],
+                             c[x], c[x + 1], c[x + 2]);
+        }
+    }
+}
+
+void ImageKernels::inkProjection(const uchar *src, qsizetype stride, int width, int height,
+                                 int threshold, quint32 *rowCounts, quint32 *colCounts)
+{
+    if (width <= 0 || height <= 0)
+        return;
+
+    threshold = qBound(0, threshold, 255);
+    if (colCounts)
+        std::fill(colCounts, colCounts + width, 0u);
+
+    // Branchless compares over contiguous rows; the compiler vectorizes both
+    // the row sum and the column accumulation.
+    for (int y = 0; y < height; ++y) {
+        const uchar *row = src + y * stride;
+        if (rowCounts) {
+            quint32 count = 0;
+            for (int x = 0; x < width; ++x)
+                count += quint32(row[x] <= threshold);
+            rowCounts[y] = count;
+        }
+        if (colCounts) {
+            for (int x = 0; x < width; ++x)
+                colCounts[x] += quint32(row[x] <= threshold);
+        }
+    }
+}
+
+namespace {
+
+// Q14 fixed-point filter weights; every output pixel sums to exactly 1 << 14.
+constexpr int kWeightBits = 14;
+
+// Source indices and weights of each output pixel along one axis, `taps` of
+// each. Indices are clamped to the source, so edges replicate.
+struct FilterTable
+{
+    int taps = 0;
+    std::vector<int> index;
+    std::vector<qint16> weight;
+};
+
+// Keys cubic with a = -0.5 (Catmull-Rom).
+double cubicWeight(double t)
+{
+    t = std::abs(t);
+    if (t < 1.0)
+        return (1.5 * t - 2.5) * t * t + 1.0;
+    if (t < 2.0)
+        return ((-0.5 * t + 2.5) * t - 4.0) * t + 2.0;
+    return 0.0;
+}
+
+FilterTable filterTable(int srcSize, int dstSize)
+{
+    FilterTable table;
+    const double scale = double(dstSize) / double(srcSize);
+    // Shrinking averages the 1 / scale source pixels under each output
+    // pixel; growing interpolates between the four nearest.
+    table.taps = scale < 1.0 ? int(std::ceil(1.0 / scale)) + 1 : 4;
+    table.index.resize(size_t(dstSize) * table.taps);
+    table.weight.resize(size_t(dstSize) * table.taps);
+
+    std::vector<double> weights(size_t(table.taps));
+    for (int i = 0; i < dstSize; ++i) {
+        int first = 0;
+        double sum = 0.0;
+        if (scale < 1.0) {
+            const double begin = i / scale;
+            const double end = (i + 1) / scale;
+            first = int(std::floor(begin));
+            for (int k = 0; k < table.taps; ++k) {
+                const double overlap = std::min(end, double(first + k + 1)) - std::max(begin, double(first + k));
+                weights[size_t(k)] = std::max(0.0, overlap);
+                sum += weights[size_t(k)];
+            }
+        } else {
+            const double center = (i + 0.5) / scale - 0.5;
+            first = int(std::floor(center)) - 1;
+            for (int k = 0; k < table.taps; ++k) {
+                weights[size_t(k)] = cubicWeight(center - (first + k));
+                sum += weights[size_t(k)];
+            }
+        }
+
+        // Rounding error goes to the heaviest tap, so flat areas stay flat.
+        int total = 0;
+        int heaviest = 0;
+        for (int k = 0; k < table.taps; ++k) {
+            const size_t at = size_t(i) * table.taps + k;
+            table.index[at] = qBound(0, first + k, srcSize - 1);
+            table.weight[at] = qint16(std::lround(weights[size_t(k)] / sum * (1 << kWeightBits)));
+            total += table.weight[at];
+            if (table.weight[at] > table.weight[size_t(i) * table.taps + heaviest])
+                heaviest = k;
+        }
+        table.weight[size_t(i) * table.taps + heaviest] += qint16((1 << kWeightBits) - total);
+    }
+    return table;
+}
+
+inline uchar clampPixel(int sum)
+{
+    return uchar(qBound(0, (sum + (1 << (kWeightBits - 1))) >> kWeightBits, 255));
+}
+
+// dst[x] = sum of weights[k] * rows[k][x] over taps rows.
+void blendRows(const uchar *const *rows, const qint16 *weights, int taps, uchar *dst, int width)
+{
+    int x = 0;
+#if defined(SNIPTEXT_X86)
+    // Two rows at a time: interleaving them as 16-bit lanes lets one
+    // pmaddwd apply both weights.
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(1 << (kWeightBits - 1));
+    for (; x + 8 <= width; x += 8) {
+        __m128i lo = round;
+        __m128i hi = round;
+        for (int k = 0; k < taps; k += 2) {
+            const __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(rows[k] + x)), zero);
+            __m128i b = zero;
+            quint32 pair = quint16(weights[k]);
+            if (k + 1 < taps) {
+                b = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(rows[k + 1] + x)), zero);
+                pair |= quint32(quint16(weights[k + 1])) << 16;
+            }
+            const __m128i w = _mm_set1_epi32(int(pair));
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+        }
+        const __m128i packed = _mm_packs_epi32(_mm_srai_epi32(lo, kWeightBits), _mm_srai_epi32(hi, kWeightBits));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + x), _mm_packus_epi16(packed, packed));
+    }
+#elif defined(SNIPTEXT_NEON)
+    for (; x + 8 <= width; x += 8) {
+        int32x4_t lo = vdupq_n_s32(0);
+        int32x4_t hi = vdupq_n_s32(0);
+        for (int k = 0; k < taps; ++k) {
+            const int16x8_t v = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(rows[k] + x)));
+            lo = vmlal_n_s16(lo, vget_low_s16(v), weights[k]);
+            hi = vmlal_n_s16(hi, vget_high_s16(v), weights[k]);
+        }
+        const int16x8_t packed = vcombine_s16(vqrshrn_n_s32(lo, kWeightBits), vqrshrn_n_s32(hi, kWeightBits));
+        vst1_u8(dst + x, vqmovun_s16(packed));
+    }
+#endif
+    for (; x < width; ++x) {
+        int sum = 0;
+        for (int k = 0; k < taps; ++k)
+            sum += weights[k] * rows[k][x];
+        dst[x] = clampPixel(sum);
+    }
+}
+
+} // namespace
+
+void ImageKernels::resample(const uchar *src, qsizetype srcStride, int srcWidth, int srcHeight,
+                            uchar *dst, qsizetype dstStride, int dstWidth, int dstHeight)
+{
+    if (srcWidth <= 0 || srcHeight <= 0 || dstWidth <= 0 || dstHeight <= 0)
+        return;
+
+    const FilterTable columns = filterTable(srcWidth, dstWidth);
+    const FilterTable rows = filterTable(srcHeight, dstHeight);
+
+    // Horizontal pass into a dstWidth x srcHeight buffer, then the vertical
+    // pass blends whole rows of it, which is where the vector code runs.
+    std::vector<uchar> horizontal(size_t(dstWidth) * srcHeight);
+    for (int y = 0; y < srcHeight; ++y) {
+        const uchar *in = src + y * srcStride;
+        uchar *out = horizontal.data() + size_t(y) * dstWidth;
+        const int *index = columns.index.data();
+        const qint16 *weight = columns.weight.data();
+        for (int x = 0; x < dstWidth; ++x, index += columns.taps, weight += columns.taps) {
+            int sum = 0;
+            for (int k = 0; k < columns.taps; ++k)
+                sum += weight[k] * in[index[k]];
+            out[x] = clampPixel(sum);
+        }
+    }
+
+    std::vector<const uchar *> taps(size_t(rows.taps));
+    for (int y = 0; y < dstHeight; ++y) {
+        for (int k = 0; k < rows.taps; ++k)
+            taps[size_t(k)] = horizontal.data() + size_t(rows.index[size_t(y) * rows.taps + k]) * dstWidth;
+        blendRows(taps.data(), rows.weight.data() + size_t(y) * rows.taps, rows.taps, dst + y * dstStride, dstWidth);
+    }
+}
+
+void ImageKernels::sauvola(uchar *data, qsizetype stride, int width, int height, int window, float k)
+{
+    if (width <= 0 || height <= 0)
+        return;
+
+    const int radius = qMax(1, window / 2);
+
+    // Running column sums over the vertical window, updated by one row in and
+    // one row out per output row. All loops run over contiguous arrays without
+    // branches, so the compiler vectorizes them.
+    std::vector<quint32> colSum(size_t(width), 0);
+    std::vector<quint32> colSqSum(size_t(width), 0);
+    std::vector<uchar> source(size_t(width) * height);
+    for (int y = 0; y < height; ++y)
+        std::memcpy(source.data() + size_t(y) * width, data + y * stride, size_t(width));
+
+    auto addRow = [&](int y, int sign) {
+        const uchar *row = source.data() + size_t(y) * width;
+        for (int x = 0; x < width; ++x) {
+            const quint32 v = row[x];
+            colSum[x] += quint32(sign) * v;
+            colSqSum[x] += quint32(sign) * v * v;
+        }
+    };
+
+    for (int y = 0; y < qMin(radius, height); ++y)
+        addRow(y, 1);
+
+    std::vector<float> limit(static_cast<size_t>(width));
+    for (int y = 0; y < height; ++y) {
+        if (y + radius < height)
+            addRow(y + radius, 1);
+        if (y - radius - 1 >= 0)
+            addRow(y - radius - 1, -1);
+
+        const int top = qMax(0, y - radius);
+        const int bottom = qMin(height - 1, y + radius);
+        const int rows = bottom - top + 1;
+
+        // Horizontal sliding window over the column sums.
+        quint64 sum = 0;
+        quint64 sqSum = 0;
+        for (int x = 0; x < qMin(radius, width); ++x) {
+            sum += colSum[x];
+            sqSum += colSqSum[x];
+        }
+        for (int x = 0; x < width; ++x) {
+            if (x + radius < width) {
+                sum += colSum[x + radius];
+                sqSum += colSqSum[x + radius];
+            }
+            if (x - radius - 1 >= 0) {
+                sum -= colSum[x - radius - 1];
+                sqSum -= colSqSum[x - radius - 1];
+            }
+            const int cols = qMin(width - 1, x + radius) - qMax(0, x - radius) + 1;
+            const float n = float(rows * cols);
+            const float mean = float(sum) / n;
+            const float variance = qMax(0.0f, float(sqSum) / n - mean * mean);
+            limit[x] = mean * (1.0f + k * (std::sqrt(variance) / 128.0f - 1.0f));
+        }
+
+        const uchar *in = source.data() + size_t(y) * width;
+        uchar *out = data + y * stride;
+        for (int x = 0; x < width; ++x)
+            out[x] = float(in[x]) > limit[x] ? 255 : 0;
+    }
+}
+
+const char *ImageKernels::instructionSet()
+{
+    return dispatch().name;
+}
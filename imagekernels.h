@@ -0,0 +1,64 @@
+#ifndef IMAGEKERNELS_H
+#define IMAGEKERNELS_H
+
+#include <QtGlobal>
+
+// Low-level pixel kernels used on the capture-to-OCR path. They work on raw
+// scanlines so they can read straight out of a grabbed frame without an
+// intermediate QImage. The best instruction set available at runtime is picked
+// automatically (AVX2/SSE2 on x86, NEON on ARM, scalar otherwise).
+namespace ImageKernels {
+
+// Converts a width x height block of 32-bit pixels in QImage::Format_RGB32 /
+// ARGB32 memory layout to 8-bit luminance (BT.601 weights). src points at the
+// top-left pixel of the block, so cropping is just pointer arithmetic.
+void xrgb32ToGray(const uchar *src, qsizetype srcStride,
+                  int width, int height,
+                  uchar *dst, qsizetype dstStride);
+
+// Fills hist[256] with the pixel counts of an 8-bit block.
+void histogram(const uchar *src, qsizetype stride, int width, int height, quint32 hist[256]);
+
+// Threshold that best separates the two classes of hist (Otsu's method).
+// Pixels above the returned value belong to the bright class.
+int otsuThreshold(const quint32 hist[256]);
+
+// Smallest value v such that at least fraction of all pixels are <= v.
+int percentile(const quint32 hist[256], double fraction);
+
+// In-place linear stretch of [low, high] onto [0, 255], clamping outside values.
+void stretchContrast(uchar *data, qsizetype stride, int width, int height, int low, int high);
+
+// In-place 255 - x.
+void invert(uchar *data, qsizetype stride, int width, int height);
+
+// In-place binarization: x > threshold becomes 255, everything else 0.
+void threshold(uchar *data, qsizetype stride, int width, int height, int threshold);
+
+// 3x3 median filter; border pixels use the replicated edge. src and dst must
+// not overlap.
+void median3x3(const uchar *src, qsizetype srcStride, int width, int height,
+               uchar *dst, qsizetype dstStride);
+
+// In-place Sauvola binarization with a square window of the given size:
+// T = mean * (1 + k * (stddev / 128 - 1)). Expects dark text on light ground.
+void sauvola(uchar *data, qsizetype stride, int width, int height, int window, float k);
+
+// Counts the pixels <= threshold ("ink" on a light background) of every row
+// into rowCounts[height] and of every column into colCounts[width]. Either
+// output may be null.
+void inkProjection(const uchar *src, qsizetype stride, int width, int height, int threshold,
+                   quint32 *rowCounts, quint32 *colCounts);
+
+// Resamples a srcWidth x srcHeight block into dstWidth x dstHeight: area
+// averaging along an axis that shrinks, bicubic (Catmull-Rom) along one that
+// grows. The vertical pass is vectorized. src and dst must not overlap.
+void resample(const uchar *src, qsizetype srcStride, int srcWidth, int srcHeight,
+              uchar *dst, qsizetype dstStride, int dstWidth, int dstHeight);
+
+// Name of the instruction set the kernels dispatch to, for logs and benchmarks.
+const char *instructionSet();
+
+} // namespace ImageKernels
+
+#endif // IMAGEKERNELS_H
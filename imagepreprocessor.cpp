@@ -0,0 +1,230 @@
+#include "imagepreprocessor.h"
+
+#include "imagekernels.h"
+
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Rows with fewer ink pixels are treated as blank (specks, a stray cursor).
+constexpr quint32 kMinRowInk = 2;
+// Ink runs outside this range are not text lines: noise, or images.
+constexpr int kMinLineHeight = 3;
+constexpr int kMaxLineHeight = 400;
+// Text within this factor of the target is left at its captured size; the
+// resampling would cost more than it gains.
+constexpr double kScaleTolerance = 1.2;
+constexpr double kMinScale = 0.25;
+constexpr double kMaxScale = 4.0;
+// Upscaling stops at this many output pixels.
+constexpr double kMaxScaledPixels = 24.0 * 1024 * 1024;
+
+} // namespace
+
+bool PreprocessOptions::operator==(const PreprocessOptions &other) const
+{
+    return normalizeContrast == other.normalizeContrast
+        && fixPolarity == other.fixPolarity
+        && denoise == other.denoise
+        && binarization == other.binarization
+        && sauvolaWindow == other.sauvolaWindow
+        && sauvolaK == other.sauvolaK
+        && normalizeTextSize == other.normalizeTextSize
+        && targetXHeight == other.targetXHeight;
+}
+
+QString PreprocessTimings::stepName(Step step)
+{
+    switch (step) {
+    case Scale:
+        return QStringLiteral("scale");
+    case Contrast:
+        return QStringLiteral("contrast");
+    case Polarity:
+        return QStringLiteral("polarity");
+    case Denoise:
+        return QStringLiteral("denoise");
+    case Binarize:
+        return QStringLiteral("binarize");
+    case StepCount:
+        break;
+    }
+    return {};
+}
+
+PreprocessTimings ImagePreprocessor::process(GrayImage &image, double scale)
+{
+    PreprocessTimings timings;
+    if (image.isNull())
+        return timings;
+
+    QElapsedTimer timer;
+    if (scale != 1.0) {
+        timer.start();
+        const int scaledWidth = qMax(1, qRound(image.width() * scale));
+        const int scaledHeight = qMax(1, qRound(image.height() * scale));
+        m_scratch.resize(scaledWidth, scaledHeight);
+        ImageKernels::resample(image.constBits(), image.bytesPerLine(), image.width(), image.height(),
+                               m_scratch.bits(), m_scratch.bytesPerLine(), scaledWidth, scaledHeight);
+        std::swap(image, m_scratch);
+        timings.ms[PreprocessTimings::Scale] = timer.nsecsElapsed() / 1e6;
+    }
+
+    const int width = image.width();
+    const int height = image.height();
+    const qsizetype stride = image.bytesPerLine();
+
+    quint32 hist[256];
+    bool histValid = false;
+
+    auto refreshHistogram = [&]() {
+        if (!histValid) {
+            ImageKernels::histogram(image.constBits(), stride, width, height, hist);
+            histValid = true;
+        }
+    };
+
+    if (m_options.normalizeContrast) {
+        timer.start();
+        refreshHistogram();
+        // Ignore the extreme 0.5% on either side so a few stray pixels (cursor,
+        // icons) do not defeat the stretch.
+        const int low = ImageKernels::percentile(hist, 0.005);
+        const int high = ImageKernels::percentile(hist, 0.995);
+        if (high - low >= 16 && (low > 0 || high < 255)) {
+            ImageKernels::stretchContrast(image.bits(), stride, width, height, low, high);
+            histValid = false;
+        }
+        timings.ms[PreprocessTimings::Contrast] = timer.nsecsElapsed() / 1e6;
+    }
+
+    if (m_options.fixPolarity) {
+        timer.start();
+        refreshHistogram();
+        // The background is the larger of the two Otsu classes. If it is the
+        // dark one, the text is light-on-dark and gets inverted.
+        const int split = ImageKernels::otsuThreshold(hist);
+        quint64 dark = 0;
+        quint64 total = 0;
+        for (int i = 0; i < 256; ++i) {
+            total += hist[i];
+            if (i <= split)
+                dark += hist[i];
+        }
+        if (dark * 2 > total) {
+            ImageKernels::invert(image.bits(), stride, width, height);
+            histValid = false;
+        }
+        timings.ms[PreprocessTimings::Polarity] = timer.nsecsElapsed() / 1e6;
+    }
+
+    if (m_options.denoise) {
+        timer.start();
+        m_scratch.resize(width, height);
+        ImageKernels::median3x3(image.constBits(), stride, width, height,
+                                m_scratch.bits(), m_scratch.bytesPerLine());
+        std::swap(image, m_scratch);
+        histValid = false;
+        timings.ms[PreprocessTimings::Denoise] = timer.nsecsElapsed() / 1e6;
+    }
+
+    switch (m_options.binarization) {
+    case PreprocessOptions::Binarization::None:
+        break;
+    case PreprocessOptions::Binarization::Otsu:
+        timer.start();
+        refreshHistogram();
+        ImageKernels::threshold(image.bits(), image.bytesPerLine(), width, height,
+                                ImageKernels::otsuThreshold(hist));
+        timings.ms[PreprocessTimings::Binarize] = timer.nsecsElapsed() / 1e6;
+        break;
+    case PreprocessOptions::Binarization::Sauvola:
+        timer.start();
+        ImageKernels::sauvola(image.bits(), image.bytesPerLine(), width, height,
+                              m_options.sauvolaWindow, m_options.sauvolaK);
+        timings.ms[PreprocessTimings::Binarize] = timer.nsecsElapsed() / 1e6;
+        break;
+    }
+
+    return timings;
+}
+
+int ImagePreprocessor::estimateXHeight(const GrayImage &image, const QRect &region)
+{
+    const QRect rect = region.intersected(image.rect());
+    if (rect.width() < kMinLineHeight || rect.height() < kMinLineHeight)
+        return 0;
+
+    const uchar *origin = image.constScanLine(rect.top()) + rect.left();
+    const qsizetype stride = image.bytesPerLine();
+    quint32 hist[256];
+    ImageKernels::histogram(origin, stride, rect.width(), rect.height(), hist);
+    const int split = ImageKernels::otsuThreshold(hist);
+    quint64 dark = 0;
+    quint64 total = 0;
+    for (int i = 0; i < 256; ++i) {
+        total += hist[i];
+        if (i <= split)
+            dark += hist[i];
+    }
+    // Ink is the smaller Otsu class, so light-on-dark text needs no inversion.
+    const bool lightInk = dark * 2 > total;
+
+    std::vector<quint32> ink(size_t(rect.height()));
+    ImageKernels::inkProjection(origin, stride, rect.width(), rect.height(), split, ink.data(), nullptr);
+    if (lightInk) {
+        for (quint32 &count : ink)
+            count = quint32(rect.width()) - count;
+    }
+
+    // Every run of inked rows is one text line. Its x-height zone is where
+    // the ink is densest: ascenders and descenders only add a few strokes,
+    // so the rows with at least half the line's peak ink are counted.
+    std::vector<int> heights;
+    int y = 0;
+    while (y < rect.height()) {
+        if (ink[size_t(y)] < kMinRowInk) {
+            ++y;
+            continue;
+        }
+        const int top = y;
+        quint32 peak = 0;
+        while (y < rect.height() && ink[size_t(y)] >= kMinRowInk)
+            peak = std::max(peak, ink[size_t(y++)]);
+        const int lineHeight = y - top;
+        if (lineHeight < kMinLineHeight || lineHeight > kMaxLineHeight)
+            continue;
+        int core = 0;
+        for (int row = top; row < y; ++row)
+            core += ink[size_t(row)] * 2 >= peak ? 1 : 0;
+        heights.push_back(core);
+    }
+    if (heights.empty())
+        return 0;
+
+    // The median line ignores headings and footnotes.
+    std::nth_element(heights.begin(), heights.begin() + heights.size() / 2, heights.end());
+    return heights[heights.size() / 2];
+}
+
+double ImagePreprocessor::textScale(const GrayImage &image, const QRect &region, int targetXHeight)
+{
+    if (targetXHeight <= 0)
+        return 1.0;
+    const int xHeight = estimateXHeight(image, region);
+    if (xHeight <= 0)
+        return 1.0;
+
+    double scale = qBound(kMinScale, double(targetXHeight) / xHeight, kMaxScale);
+    const double pixels = double(region.width()) * double(region.height());
+    if (pixels * scale * scale > kMaxScaledPixels)
+        scale = std::sqrt(kMaxScaledPixels / pixels);
+    if (scale * kScaleTolerance >= 1.0 && scale <= kScaleTolerance)
+        return 1.0;
+    return scale;
+}
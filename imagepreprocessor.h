@@ -0,0 +1,81 @@
+#ifndef IMAGEPREPROCESSOR_H
+#define IMAGEPREPROCESSOR_H
+
+#include "grayimage.h"
+
+#include <QRect>
+#include <QString>
+
+#include <array>
+
+// Which preprocessing steps run between capture and recognition. Clean,
+// high-contrast, dark-on-light input lets Tesseract skip most of its own
+// thresholding work and misreads less anti-aliased UI text.
+struct PreprocessOptions
+{
+    enum class Binarization {
+        None,
+        Otsu,    // one global threshold; fast, fine for flat UI backgrounds
+        Sauvola  // local threshold; handles gradients and mixed backgrounds
+    };
+
+    // Every step is off by default, so captures reach Tesseract unchanged
+    // unless the user opts in.
+
+    // Rescale so the dominant x-height becomes targetXHeight pixels, which
+    // keeps OCR cost and accuracy the same at any device pixel ratio.
+    bool normalizeTextSize = false;
+    int targetXHeight = 16;
+    bool normalizeContrast = false;
+    bool fixPolarity = false;    // turn light-on-dark text into dark-on-light
+    bool denoise = false;        // 3x3 median
+    Binarization binarization = Binarization::None;
+    int sauvolaWindow = 25;
+    float sauvolaK = 0.2f;
+
+    bool operator==(const PreprocessOptions &other) const;
+    bool operator!=(const PreprocessOptions &other) const { return !(*this == other); }
+};
+
+// Time spent in each step of one run, in milliseconds; 0 for skipped steps.
+struct PreprocessTimings
+{
+    enum Step {
+        Scale,
+        Contrast,
+        Polarity,
+        Denoise,
+        Binarize,
+        StepCount
+    };
+
+    std::array<double, StepCount> ms{};
+
+    static QString stepName(Step step);
+};
+
+// Runs the enabled steps in place on a grayscale buffer. Keeps its scratch
+// buffer between runs, so one instance should be owned per thread.
+class ImagePreprocessor
+{
+public:
+    void setOptions(const PreprocessOptions &options) { m_options = options; }
+    const PreprocessOptions &options() const { return m_options; }
+
+    // Resamples image by scale first (see textScale()), then runs the steps.
+    PreprocessTimings process(GrayImage &image, double scale = 1.0);
+
+    // Height in pixels of the lowercase letters of the dominant text size in
+    // region, from the ink projection of its rows; 0 when no text line is
+    // found. Works for either polarity.
+    static int estimateXHeight(const GrayImage &image, const QRect &region);
+    // Factor that brings the text of region to targetXHeight, or exactly 1.0
+    // when it is already close or no text is found.
+    static double textScale(const GrayImage &image, const QRect &region, int targetXHeight);
+
+private:
+    PreprocessOptions m_options;
+    GrayImage m_scratch;
+};
+
+#endif // IMAGEPREPROCESSOR_H
@@ -0,0 +1,211 @@
+#include "latencytrace.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QStringList>
+#include <QThread>
+#include <QtAlgorithms>
+
+#include <cmath>
+
+namespace {
+
+// Events kept for the Chrome trace; at a few events per capture this covers
+// a long session.
+const size_t kMaxEvents = size_t(1) << 16;
+
+const QElapsedTimer &clock()
+{
+    static const QElapsedTimer timer = []() {
+        QElapsedTimer t;
+        t.start();
+        return t;
+    }();
+    return timer;
+}
+
+} // namespace
+
+LatencyTrace &LatencyTrace::instance()
+{
+    static LatencyTrace trace;
+    return trace;
+}
+
+const char *LatencyTrace::stageName(Stage stage)
+{
+    switch (stage) {
+    case Stage::OverlayShown:       return "overlay_shown";
+    case Stage::ReleaseToCapture:   return "release_to_capture";
+    case Stage::Grab:               return "grab";
+    case Stage::Convert:            return "crop_convert";
+    case Stage::SetImage:           return "tess_set_image";
+    case Stage::Recognize:          return "tess_recognize";
+    case Stage::Clipboard:          return "clipboard_set";
+    case Stage::ReleaseToClipboard: return "release_to_clipboard";
+    case Stage::SaveScreenshot:     return "save_screenshot";
+    case Stage::StageCount:         break;
+    }
+    return "unknown";
+}
+
+qint64 LatencyTrace::now()
+{
+    return clock().nsecsElapsed();
+}
+
+int LatencyTrace::bucketIndex(quint64 us)
+{
+    if (us < quint64(kSubBuckets))
+        return int(us);
+    const int exponent = 63 - int(qCountLeadingZeroBits(us));
+    const int sub = int((us >> (exponent - 3)) & (kSubBuckets - 1));
+    return qMin(kBuckets - 1, (exponent - 2) * kSubBuckets + sub);
+}
+
+double LatencyTrace::bucketValueUs(int index)
+{
+    if (index < kSubBuckets)
+        return index;
+    const int exponent = index / kSubBuckets + 2;
+    const int sub = index % kSubBuckets;
+    const double width = std::ldexp(1.0, exponent - 3);
+    return (kSubBuckets + sub) * width + width / 2.0;
+}
+
+void LatencyTrace::record(Stage stage, qint64 startNs, qint64 endNs, quint64 jobId)
+{
+    const qint64 durationNs = qMax<qint64>(0, endNs - startNs);
+    const quint64 us = quint64(durationNs / 1000);
+
+    Histogram &histogram = m_histograms[size_t(stage)];
+    histogram.counts[size_t(bucketIndex(us))].fetch_add(1, std::memory_order_relaxed);
+    histogram.total.fetch_add(1, std::memory_order_relaxed);
+    quint64 max = histogram.maxUs.load(std::memory_order_relaxed);
+    while (us > max && !histogram.maxUs.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+    }
+
+    if (!tracing())
+        return;
+
+    const Event event = {stage, startNs, durationNs, quintptr(QThread::currentThreadId()), jobId};
+    QMutexLocker locker(&m_eventsMutex);
+    if (m_events.size() < kMaxEvents) {
+        m_events.push_back(event);
+    } else {
+        m_events[m_nextEvent] = event;
+        m_nextEvent = (m_nextEvent + 1) % kMaxEvents;
+    }
+}
+
+LatencyTrace::Percentiles LatencyTrace::percentiles(Stage stage) const
+{
+    const Histogram &histogram = m_histograms[size_t(stage)];
+    std::array<quint32, kBuckets> counts;
+    quint64 total = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+        counts[size_t(i)] = histogram.counts[size_t(i)].load(std::memory_order_relaxed);
+        total += counts[size_t(i)];
+    }
+
+    Percentiles result;
+    result.count = total;
+    if (total == 0)
+        return result;
+    result.maxMs = histogram.maxUs.load(std::memory_order_relaxed) / 1000.0;
+
+    auto valueAt = [&](double fraction) {
+        const quint64 rank = qMax<quint64>(1, quint64(std::ceil(fraction * double(total))));
+        quint64 seen = 0;
+        for (int i = 0; i < kBuckets; ++i) {
+            seen += counts[size_t(i)];
+            if (seen >= rank)
+                return qMin(bucketValueUs(i) / 1000.0, result.maxMs);
+        }
+        return result.maxMs;
+    };
+    result.p50Ms = valueAt(0.50);
+    result.p95Ms = valueAt(0.95);
+    result.p99Ms = valueAt(0.99);
+    return result;
+}
+
+QString LatencyTrace::report() const
+{
+    QStringList lines;
+    for (int i = 0; i < int(Stage::StageCount); ++i) {
+        const Stage stage = Stage(i);
+        const Percentiles p = percentiles(stage);
+        if (p.count == 0)
+            continue;
+        lines << QCoreApplication::translate("LatencyTrace",
+                                             "%1: %2 samples, p50 %3 ms, p95 %4 ms, p99 %5 ms, max %6 ms")
+                     .arg(QString::fromLatin1(stageName(stage)))
+                     .arg(p.count)
+                     .arg(p.p50Ms, 0, 'f', 2)
+                     .arg(p.p95Ms, 0, 'f', 2)
+                     .arg(p.p99Ms, 0, 'f', 2)
+                     .arg(p.maxMs, 0, 'f', 2);
+    }
+    if (lines.isEmpty())
+        return QCoreApplication::translate("LatencyTrace", "No latency samples yet.");
+    return lines.join('\n');
+}
+
+void LatencyTrace::setTracing(bool enabled)
+{
+    m_tracing.store(enabled, std::memory_order_relaxed);
+}
+
+bool LatencyTrace::writeChromeTrace(const QString &filePath) const
+{
+    std::vector<Event> events;
+    {
+        QMutexLocker locker(&m_eventsMutex);
+        events.reserve(m_events.size());
+        // Oldest first once the ring has wrapped.
+        for (size_t i = 0; i < m_events.size(); ++i)
+            events.push_back(m_events[(m_nextEvent + i) % m_events.size()]);
+    }
+
+    // Complete ("X") events in microseconds; threads get small stable ids in
+    // order of appearance.
+    const qint64 pid = QCoreApplication::applicationPid();
+    QHash<quintptr, int> threads;
+    QJsonArray traceEvents;
+    for (const Event &event : events) {
+        const auto thread = threads.constFind(event.thread);
+        const int tid = thread != threads.constEnd() ? thread.value()
+                                                     : *threads.insert(event.thread, threads.size() + 1);
+        QJsonObject object;
+        object.insert(QStringLiteral("name"), QString::fromLatin1(stageName(event.stage)));
+        object.insert(QStringLiteral("cat"), QStringLiteral("sniptext"));
+        object.insert(QStringLiteral("ph"), QStringLiteral("X"));
+        object.insert(QStringLiteral("ts"), event.startNs / 1000.0);
+        object.insert(QStringLiteral("dur"), event.durationNs / 1000.0);
+        object.insert(QStringLiteral("pid"), pid);
+        object.insert(QStringLiteral("tid"), tid);
+        if (event.jobId != 0) {
+            QJsonObject args;
+            args.insert(QStringLiteral("job"), qint64(event.jobId));
+            object.insert(QStringLiteral("args"), args);
+        }
+        traceEvents.append(object);
+    }
+
+    QJsonObject root;
+    root.insert(QStringLiteral("traceEvents"), traceEvents);
+    root.insert(QStringLiteral("displayTimeUnit"), QStringLiteral("ms"));
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    const QByteArray json = QJsonDocument(root).toJson(QJsonDocument::Compact);
+    return file.write(json) == json.size();
+}
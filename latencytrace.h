@@ -0,0 +1,114 @@
+#ifndef LATENCYTRACE_H
+#define LATENCYTRACE_H
+
+#include <QMutex>
+#include <QString>
+#include <QtGlobal>
+
+#include <array>
+#include <atomic>
+#include <vector>
+
+// Process-wide latency recorder for the capture path. Every stage span goes
+// into a lock-free log-bucketed histogram (about 6% resolution) that yields
+// p50/p95/p99. While tracing is on, spans are also kept in a bounded ring of
+// events that can be written as Chrome trace JSON (chrome://tracing,
+// Perfetto). Safe to call from any thread.
+class LatencyTrace
+{
+public:
+    enum class Stage {
+        OverlayShown,       // capture started -> overlays on screen
+        ReleaseToCapture,   // mouse release -> captured pixels available
+        Grab,               // one screen grab
+        Convert,            // crop + grayscale (+ cache lookup)
+        SetImage,           // Tesseract SetImage
+        Recognize,          // Tesseract recognition
+        Clipboard,          // clipboard set
+        ReleaseToClipboard, // mouse release -> text on the clipboard
+        SaveScreenshot,     // encode + write of a screenshot
+        StageCount
+    };
+
+    struct Percentiles
+    {
+        quint64 count = 0;
+        double p50Ms = 0.0;
+        double p95Ms = 0.0;
+        double p99Ms = 0.0;
+        double maxMs = 0.0;
+    };
+
+    static LatencyTrace &instance();
+    static const char *stageName(Stage stage);
+
+    // Monotonic clock all spans are measured on, in nanoseconds.
+    static qint64 now();
+
+    void record(Stage stage, qint64 startNs, qint64 endNs, quint64 jobId = 0);
+
+    Percentiles percentiles(Stage stage) const;
+    // One line per stage that has samples.
+    QString report() const;
+
+    // Spans are kept for the trace only while enabled; the oldest are
+    // dropped beyond the ring capacity.
+    void setTracing(bool enabled);
+    bool tracing() const { return m_tracing.load(std::memory_order_relaxed); }
+    bool writeChromeTrace(const QString &filePath) const;
+
+private:
+    LatencyTrace() = default;
+    Q_DISABLE_COPY(LatencyTrace)
+
+    // 8 sub-buckets per power of two of microseconds, up to about 2^40 us.
+    static constexpr int kSubBuckets = 8;
+    static constexpr int kBuckets = kSubBuckets * 40;
+    static int bucketIndex(quint64 us);
+    static double bucketValueUs(int index);
+
+    struct Histogram
+    {
+        std::array<std::atomic<quint32>, kBuckets> counts{};
+        std::atomic<quint64> total{0};
+        std::atomic<quint64> maxUs{0};
+    };
+
+    struct Event
+    {
+        Stage stage;
+        qint64 startNs;
+        qint64 durationNs;
+        quintptr thread;
+        quint64 jobId;
+    };
+
+    std::array<Histogram, size_t(Stage::StageCount)> m_histograms;
+
+    std::atomic<bool> m_tracing{false};
+    mutable QMutex m_eventsMutex;
+    std::vector<Event> m_events;
+    size_t m_nextEvent = 0;
+};
+
+// Records the lifetime of the scope as one span of stage.
+class LatencyScope
+{
+public:
+    explicit LatencyScope(LatencyTrace::Stage stage, quint64 jobId = 0)
+        : m_stage(stage)
+        , m_jobId(jobId)
+        , m_startNs(LatencyTrace::now())
+    {
+    }
+    ~LatencyScope() { LatencyTrace::instance().record(m_stage, m_startNs, LatencyTrace::now(), m_jobId); }
+
+private:
+    Q_DISABLE_COPY(LatencyScope)
+
+    LatencyTrace::Stage m_stage;
+    quint64 m_jobId;
+    qint64 m_startNs;
+};
+
+#endif // LATENCYTRACE_H
@@ -1,11 +1,35 @@
+#include "batchrunner.h"
 #include "mainwindow.h"
+#include "ocrclient.h"
+#include "ocrdaemon.h"
 
 #include <QApplication>
+#include <QCoreApplication>
+#include <QElapsedTimer>
 
 int main(int argc, char *argv[])
 {
+    // Startup metrics include creating the application object.
+    QElapsedTimer startupTimer;
+    startupTimer.start();
+
+    // Headless batch mode only needs a core application: no widgets, screens
+    // or display server, so it also runs on servers and in CI.
+    if (BatchRunner::isRequested(argc, argv)) {
+        QCoreApplication app(argc, argv);
+        return BatchRunner::run(app.arguments());
+    }
+    if (OcrDaemon::isRequested(argc, argv)) {
+        QCoreApplication app(argc, argv);
+        return OcrDaemon::run(app.arguments());
+    }
+    if (OcrClient::isRequested(argc, argv)) {
+        QCoreApplication app(argc, argv);
+        return OcrClient::run(app.arguments());
+    }
+
     QApplication a(argc, argv);
-    MainWindow w;
+    MainWindow w(startupTimer);
     w.show();
     return a.exec();
 }
@@ -1,7 +1,14 @@
 #include "mainwindow.h"
+#include "capturebackend.h"
+#include "capturehistory.h"
 #include "capturesession.h"
+#include "historywindow.h"
+#include "latencytrace.h"
 #include "ocrservice.h"
+#include "regionwatcher.h"
+#include "screenshotwriter.h"
 #include <QPushButton>
+#include <QHBoxLayout>
 #include <QVBoxLayout>
 #include <QGuiApplication>
 #include <QMessageBox>
@@ -13,7 +20,6 @@
 #include <QColorDialog>
 #include <QFileDialog>
 #include <QImage>
-#include <QDateTime>
 #include <QSettings>
 #include <QShortcut>
 #include <QInputDialog>
@@ -22,6 +28,18 @@
 #include <QDialogButtonBox>
 #include <QFormLayout>
 #include <QKeySequenceEdit>
+#include <QActionGroup>
+#include <QStatusBar>
+#include <QTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QPair>
+#include <QComboBox>
+#include <QSpinBox>
+#include <QPlainTextEdit>
+#include <QLoggingCategory>
+
+#include <utility>
 
 #ifndef DEFAULT_TESSDATA_PATH
 #define DEFAULT_TESSDATA_PATH ""
@@ -29,6 +47,26 @@
 // DEFAULT_TESSDATA_PATH is injected via CMake so the app knows where tessdata lives
 // without hardcoding the path in the source.
 
+// Startup timings; QT_LOGGING_RULES="sniptext.startup.info=true" prints them.
+Q_LOGGING_CATEGORY(lcStartup, "sniptext.startup", QtWarningMsg)
+
+static QString tessdataPath()
+{
+    return QString::fromUtf8(DEFAULT_TESSDATA_PATH);
+}
+
+static QString ocrCacheFilePath()
+{
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation))
+        .filePath(QStringLiteral("ocr-cache.bin"));
+}
+
+static QString historyFilePath()
+{
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation))
+        .filePath(QStringLiteral("history.log"));
+}
+
 static QString desktopSavePath()
 {
     QString path = QStandardPaths::writableLocation(QStandardPaths::DesktopLocation);
@@ -45,14 +83,29 @@ void MainWindow::initGUI()
     setCentralWidget(cw);
 
     m_newShotBtn = new QPushButton(tr("New Screenshot"), cw);
+    m_watchBtn = new QPushButton(tr("Watch Region"), cw);
+    m_watchBtn->setToolTip(tr("Select a region and keep its text up to date while it changes."));
+
+    m_preview = new QPlainTextEdit(cw);
+    m_preview->setReadOnly(true);
+    m_preview->setPlaceholderText(tr("Recognized text appears here."));
+    m_preview->setMaximumBlockCount(500);
+
+    auto *buttons = new QHBoxLayout;
+    buttons->addStretch(1);
+    buttons->addWidget(m_newShotBtn);
+    buttons->addWidget(m_watchBtn);
+    buttons->addStretch(1);
 
     auto *layout = new QVBoxLayout;
-    layout->addWidget(m_newShotBtn, 0, Qt::AlignCenter);
-    layout->addStretch(1);
+    layout->addLayout(buttons);
+    layout->addWidget(m_preview, 1);
     cw->setLayout(layout);
 
     connect(m_newShotBtn, &QPushButton::clicked,
             this, &MainWindow::onNewScreenshot);
+    connect(m_watchBtn, &QPushButton::clicked,
+            this, &MainWindow::onWatchRegion);
 
     m_shortcutHandler = new QShortcut(QKeySequence(m_captureShortcut), this);
     connect(m_shortcutHandler, &QShortcut::activated,
@@ -89,6 +142,38 @@ void MainWindow::initGUI()
 
     settingsMenu->addAction(selectFolderAct);
 
+    auto formatMenu = settingsMenu->addMenu(tr("Screenshot Format"));
+    formatMenu->setEnabled(m_saveScreenshot);
+    auto formatGroup = new QActionGroup(formatMenu);
+    const ScreenshotWriter::Format formats[] = {ScreenshotWriter::Format::Png,
+                                                ScreenshotWriter::Format::Qoi};
+    for (const ScreenshotWriter::Format format : formats) {
+        auto formatAct = new QAction(ScreenshotWriter::formatName(format), formatGroup);
+        formatAct->setCheckable(true);
+        formatAct->setChecked(m_screenshotWriter->format() == format);
+        connect(formatAct, &QAction::triggered, this, [this, format]() {
+            m_screenshotWriter->setFormat(format);
+            m_settings->setValue("screenshotFormat", ScreenshotWriter::formatName(format));
+        });
+        formatMenu->addAction(formatAct);
+    }
+    formatMenu->addSeparator();
+
+    auto compressionAct = new QAction(tr("PNG Compression Level..."), formatMenu);
+    connect(compressionAct, &QAction::triggered, this, [this]() {
+        bool ok = false;
+        const int level = QInputDialog::getInt(this, tr("PNG Compression"),
+                                               tr("Level (0 = fastest, 9 = smallest):"),
+                                               m_screenshotWriter->pngCompression(),
+                                               0, 9, 1, &ok);
+        if (!ok)
+            return;
+
+        m_screenshotWriter->setPngCompression(level);
+        m_settings->setValue("pngCompression", level);
+    });
+    formatMenu->addAction(compressionAct);
+
     auto multiAreaAct = new QAction(tr("Capture Multiple Areas"));
     multiAreaAct->setCheckable(true);
     multiAreaAct->setChecked(m_captureMultipleAreas);
@@ -98,6 +183,194 @@ void MainWindow::initGUI()
     });
     settingsMenu->addAction(multiAreaAct);
 
+    auto preprocessMenu = settingsMenu->addMenu(tr("Preprocessing"));
+    auto addPreprocessToggle = [this, preprocessMenu](const QString &text, bool PreprocessOptions::*flag) {
+        auto act = new QAction(text, preprocessMenu);
+        act->setCheckable(true);
+        act->setChecked(m_preprocess.*flag);
+        connect(act, &QAction::toggled, this, [this, flag](bool on) {
+            m_preprocess.*flag = on;
+            applyPreprocessOptions();
+        });
+        preprocessMenu->addAction(act);
+    };
+    addPreprocessToggle(tr("Normalize Text Size"), &PreprocessOptions::normalizeTextSize);
+    addPreprocessToggle(tr("Normalize Contrast"), &PreprocessOptions::normalizeContrast);
+    addPreprocessToggle(tr("Fix Light-on-Dark Text"), &PreprocessOptions::fixPolarity);
+    addPreprocessToggle(tr("Denoise"), &PreprocessOptions::denoise);
+    preprocessMenu->addSeparator();
+
+    auto binarizationGroup = new QActionGroup(preprocessMenu);
+    const QPair<QString, PreprocessOptions::Binarization> binarizations[] = {
+        {tr("No Binarization"), PreprocessOptions::Binarization::None},
+        {tr("Otsu Binarization"), PreprocessOptions::Binarization::Otsu},
+        {tr("Sauvola Binarization"), PreprocessOptions::Binarization::Sauvola},
+    };
+    for (const auto &entry : binarizations) {
+        const PreprocessOptions::Binarization mode = entry.second;
+        auto act = new QAction(entry.first, binarizationGroup);
+        act->setCheckable(true);
+        act->setChecked(m_preprocess.binarization == mode);
+        connect(act, &QAction::triggered, this, [this, mode]() {
+            m_preprocess.binarization = mode;
+            applyPreprocessOptions();
+        });
+        preprocessMenu->addAction(act);
+    }
+
+    auto detectScriptAct = new QAction(tr("Detect Script Among Installed Languages"));
+    detectScriptAct->setCheckable(true);
+    detectScriptAct->setChecked(m_detectScript);
+    connect(detectScriptAct, &QAction::toggled, this, [this](bool on) {
+        m_detectScript = on;
+        m_settings->setValue("detectScript", m_detectScript);
+        applyLanguages();
+    });
+
+    auto languagesAct = new QAction(tr("OCR Languages..."));
+    connect(languagesAct, &QAction::triggered, this, [this]() {
+        bool ok = false;
+        const QString text = QInputDialog::getText(
+            this, tr("OCR Languages"),
+            tr("Tesseract languages, separated by spaces; the first one is the default.\n"
+               "With several, each capture's script picks the first listed language\n"
+               "written in it (empty: English):"),
+            QLineEdit::Normal, m_ocrLanguages.join(QLatin1Char(' ')), &ok);
+        if (!ok)
+            return;
+        m_ocrLanguages = text.split(QLatin1Char(' '), Qt::SkipEmptyParts);
+        m_settings->setValue("ocrLanguages", m_ocrLanguages);
+        applyLanguages();
+    });
+
+    m_profileMenu = settingsMenu->addMenu(tr("OCR Profile"));
+    populateProfileMenu();
+    settingsMenu->addAction(languagesAct);
+    settingsMenu->addAction(detectScriptAct);
+
+    auto streamAct = new QAction(tr("Stream Text of Large Captures"));
+    streamAct->setCheckable(true);
+    streamAct->setChecked(m_streamOcr);
+    connect(streamAct, &QAction::toggled, this, [this](bool on) {
+        m_streamOcr = on;
+        m_ocrService->setStreamingEnabled(on);
+        m_settings->setValue("streamingOcr", m_streamOcr);
+    });
+    settingsMenu->addAction(streamAct);
+
+    auto persistCacheAct = new QAction(tr("Keep OCR Cache Between Sessions"));
+    persistCacheAct->setCheckable(true);
+    persistCacheAct->setChecked(m_persistOcrCache);
+    connect(persistCacheAct, &QAction::toggled, this, [this](bool on) {
+        m_persistOcrCache = on;
+        m_settings->setValue("ocrCache/persist", m_persistOcrCache);
+        if (!on)
+            QFile::remove(ocrCacheFilePath());
+    });
+
+    auto clearCacheAct = new QAction(tr("Clear OCR Cache"));
+    connect(clearCacheAct, &QAction::triggered, this, [this]() {
+        m_ocrService->cache().clear();
+        QFile::remove(ocrCacheFilePath());
+    });
+
+    auto historyAct = new QAction(tr("Capture History..."));
+    connect(historyAct, &QAction::triggered, this, [this]() {
+        if (!m_historyWindow)
+            m_historyWindow = new HistoryWindow(m_history, this);
+        m_historyWindow->show();
+        m_historyWindow->raise();
+        m_historyWindow->activateWindow();
+    });
+
+    auto keepHistoryAct = new QAction(tr("Keep Capture History"));
+    keepHistoryAct->setCheckable(true);
+    keepHistoryAct->setChecked(m_keepHistory);
+    connect(keepHistoryAct, &QAction::toggled, this, [this](bool on) {
+        m_keepHistory = on;
+        m_settings->setValue("history/enabled", m_keepHistory);
+        if (on)
+            m_history->open(historyFilePath());
+    });
+
+    auto clearHistoryAct = new QAction(tr("Clear Capture History"));
+    connect(clearHistoryAct, &QAction::triggered, this, [this]() {
+        if (QMessageBox::question(this, tr("Clear Capture History"),
+                                  tr("Delete every entry of the capture history?"))
+            == QMessageBox::Yes) {
+            m_history->clear();
+        }
+    });
+
+    auto historyThumbnailsAct = new QAction(tr("Store History Thumbnails"));
+    historyThumbnailsAct->setCheckable(true);
+    historyThumbnailsAct->setChecked(m_historyThumbnails);
+    connect(historyThumbnailsAct, &QAction::toggled, this, [this](bool on) {
+        m_historyThumbnails = on;
+        m_settings->setValue("history/thumbnails", m_historyThumbnails);
+    });
+
+    auto freezeAct = new QAction(tr("Freeze Screen While Selecting"));
+    freezeAct->setCheckable(true);
+    freezeAct->setChecked(m_freezeFrame);
+    connect(freezeAct, &QAction::toggled, this, [this](bool on) {
+        m_freezeFrame = on;
+        m_settings->setValue("freezeFrame", m_freezeFrame);
+    });
+
+    auto watchIntervalAct = new QAction(tr("Watch Interval..."));
+    connect(watchIntervalAct, &QAction::triggered, this, [this]() {
+        bool ok = false;
+        const int interval = QInputDialog::getInt(this, tr("Watch Interval"),
+                                                  tr("Check the watched region every (ms):"),
+                                                  m_watchIntervalMs, 100, 600000, 100, &ok);
+        if (!ok)
+            return;
+        m_watchIntervalMs = interval;
+        m_watcher->setInterval(m_watchIntervalMs);
+        m_settings->setValue("watchIntervalMs", m_watchIntervalMs);
+    });
+
+    auto frameTimesAct = new QAction(tr("Show Overlay Frame Times"));
+    frameTimesAct->setCheckable(true);
+    frameTimesAct->setChecked(m_showOverlayFrameTimes);
+    connect(frameTimesAct, &QAction::toggled, this, [this](bool on) {
+        m_showOverlayFrameTimes = on;
+        m_settings->setValue("overlayFrameTimes", m_showOverlayFrameTimes);
+    });
+
+    auto statsAct = new QAction(tr("OCR Statistics..."));
+    connect(statsAct, &QAction::triggered, this, [this]() {
+        QMessageBox::information(this, tr("OCR Statistics"),
+                                 startupReport() + "\n" + m_captureBackend->statsReport()
+                                     + "\n" + m_watcher->statsReport()
+                                     + "\n\n" + m_ocrService->statsReport());
+    });
+
+    auto latencyAct = new QAction(tr("Latency Histograms..."));
+    connect(latencyAct, &QAction::triggered, this, [this]() {
+        QMessageBox::information(this, tr("Latency Histograms"), LatencyTrace::instance().report());
+    });
+
+    auto traceAct = new QAction(tr("Record Trace"));
+    traceAct->setCheckable(true);
+    traceAct->setChecked(LatencyTrace::instance().tracing());
+    connect(traceAct, &QAction::toggled, this, [this](bool on) {
+        LatencyTrace::instance().setTracing(on);
+        m_settings->setValue("latencyTrace", on);
+    });
+
+    auto exportTraceAct = new QAction(tr("Export Trace..."));
+    connect(exportTraceAct, &QAction::triggered, this, [this]() {
+        const QString filePath = QFileDialog::getSaveFileName(this, tr("Export Trace"),
+                                                              QDir(m_dir).filePath("sniptext_trace.json"),
+                                                              tr("Chrome trace (*.json)"));
+        if (filePath.isEmpty())
+            return;
+        if (!LatencyTrace::instance().writeChromeTrace(filePath))
+            QMessageBox::warning(this, tr("Warning"), tr("Failed to write the trace to:\n%1").arg(filePath));
+    });
+
     auto shortcutAct = new QAction(tr("Change Capture Shortcut..."));
     connect(shortcutAct, &QAction::triggered, this, [this]() {
         QDialog dialog(this);
@@ -129,28 +402,50 @@ void MainWindow::initGUI()
     });
     settingsMenu->addAction(shortcutAct);
 
+    settingsMenu->addSeparator();
+    settingsMenu->addAction(persistCacheAct);
+    settingsMenu->addAction(clearCacheAct);
+    settingsMenu->addAction(historyAct);
+    settingsMenu->addAction(keepHistoryAct);
+    settingsMenu->addAction(historyThumbnailsAct);
+    settingsMenu->addAction(clearHistoryAct);
+    settingsMenu->addAction(statsAct);
+    settingsMenu->addAction(latencyAct);
+    settingsMenu->addAction(traceAct);
+    settingsMenu->addAction(exportTraceAct);
+    settingsMenu->addAction(freezeAct);
+    settingsMenu->addAction(watchIntervalAct);
+    settingsMenu->addAction(frameTimesAct);
+
     // This connect() is placed below the action definition because it should go into
     // the menu first, but we also need to access an action that is defined after it in the slot.
-    connect(saveScreenshotAct, &QAction::toggled, this, [this, selectFolderAct](bool on){
+    connect(saveScreenshotAct, &QAction::toggled, this, [this, selectFolderAct, formatMenu](bool on){
         m_saveScreenshot = on;
         selectFolderAct->setEnabled(on);
+        formatMenu->setEnabled(on);
         m_settings->setValue("alsoSaveScreenshot", m_saveScreenshot);
     });
 
     setWindowTitle("SnipText");
 }
 
-MainWindow::MainWindow(QWidget *parent)
+MainWindow::MainWindow(const QElapsedTimer &startupTimer, QWidget *parent)
     : QMainWindow(parent)
     , m_newShotBtn(nullptr)
     , m_color(QColor("red"))
     , m_saveScreenshot(true)
     , m_captureMultipleAreas(false)
+    , m_persistOcrCache(false)
     , m_shortcutHandler(nullptr)
-    , m_ocrService(new OcrService)
+    , m_ocrService(new OcrService(0, this))
+    , m_screenshotWriter(new ScreenshotWriter(this))
+    , m_history(new CaptureHistory(this))
     , m_settings(new QSettings("MySoft", "SnipText", this))
 {
+    m_startupTimer = startupTimer;
     m_dir = desktopSavePath();
+    // An empty name picks the fastest backend the platform supports.
+    m_captureBackend = CaptureBackend::create(m_settings->value("captureBackend").toString());
 
     if (m_settings) {
         const QColor color = m_settings->value("overlayColor").value<QColor>();
@@ -168,24 +463,165 @@ MainWindow::MainWindow(QWidget *parent)
             m_captureMultipleAreas = m_settings->value("multiCaptureEnabled").toBool();
 
         m_captureShortcut = m_settings->value("captureShortcut", QStringLiteral("Ctrl+Shift+S")).toString();
+
+        if (m_settings->value("screenshotFormat").toString()
+            == ScreenshotWriter::formatName(ScreenshotWriter::Format::Qoi))
+            m_screenshotWriter->setFormat(ScreenshotWriter::Format::Qoi);
+
+        if (m_settings->contains("pngCompression"))
+            m_screenshotWriter->setPngCompression(m_settings->value("pngCompression").toInt());
+
+        m_settings->beginGroup("preprocess");
+        m_preprocess.normalizeTextSize = m_settings->value("normalizeTextSize", m_preprocess.normalizeTextSize).toBool();
+        m_preprocess.targetXHeight = qBound(8, m_settings->value("targetXHeight", m_preprocess.targetXHeight).toInt(), 64);
+        m_preprocess.normalizeContrast = m_settings->value("normalizeContrast", m_preprocess.normalizeContrast).toBool();
+        m_preprocess.fixPolarity = m_settings->value("fixPolarity", m_preprocess.fixPolarity).toBool();
+        m_preprocess.denoise = m_settings->value("denoise", m_preprocess.denoise).toBool();
+        m_preprocess.binarization = PreprocessOptions::Binarization(
+            qBound(0, m_settings->value("binarization", int(m_preprocess.binarization)).toInt(), 2));
+        m_settings->endGroup();
+
+        m_profileName = m_settings->value("ocrProfile").toString();
+        m_streamOcr = m_settings->value("streamingOcr", m_streamOcr).toBool();
+        m_showOverlayFrameTimes = m_settings->value("overlayFrameTimes", m_showOverlayFrameTimes).toBool();
+        m_freezeFrame = m_settings->value("freezeFrame", m_freezeFrame).toBool();
+        m_ocrLanguages = m_settings->value("ocrLanguages").toStringList();
+        m_detectScript = m_settings->value("detectScript", m_detectScript).toBool();
+        m_watchIntervalMs = m_settings->value("watchIntervalMs", m_watchIntervalMs).toInt();
+        LatencyTrace::instance().setTracing(m_settings->value("latencyTrace", false).toBool()
+                                            || qEnvironmentVariableIsSet("SNIPTEXT_TRACE"));
+
+        m_keepHistory = m_settings->value("history/enabled", m_keepHistory).toBool();
+        m_historyThumbnails = m_settings->value("history/thumbnails", m_historyThumbnails).toBool();
+        m_history->setRetention(qint64(m_settings->value("history/maxMB", 64).toInt()) * 1024 * 1024,
+                                m_settings->value("history/maxDays", 90).toInt());
+
+        m_persistOcrCache = m_settings->value("ocrCache/persist", m_persistOcrCache).toBool();
+        if (m_settings->contains("ocrCache/maxMB"))
+            m_ocrService->cache().setMaxBytes(qsizetype(m_settings->value("ocrCache/maxMB").toInt()) * 1024 * 1024);
     }
+    m_ocrService->setPreprocessOptions(m_preprocess);
+    m_ocrService->setStreamingEnabled(m_streamOcr);
+    loadProfiles();
+    selectProfile(m_profileName);
+    if (m_persistOcrCache)
+        m_ocrService->cache().load(ocrCacheFilePath());
     if (m_captureShortcut.isEmpty())
         m_captureShortcut = QStringLiteral("Ctrl+Shift+S");
+    // Loaded and indexed on the history thread. Without history the log is
+    // only opened when one was kept before, so its entries stay browsable.
+    if (m_keepHistory || QFile::exists(historyFilePath()))
+        m_history->open(historyFilePath());
+
+    m_watcher = new RegionWatcher(m_captureBackend.get(), m_ocrService, this);
+    m_watcher->setInterval(m_watchIntervalMs);
 
     initGUI();
 
-    // Create and init Tesseract once.
-    const QString tessdataPath = QString::fromUtf8(DEFAULT_TESSDATA_PATH);
-    if (!m_ocrService->initialize(tessdataPath, "eng")) {
-        QMessageBox::critical(this, tr("Tesseract"),
-                              tr("Failed to initialize Tesseract. Check tessdata path."));
-    }
+    connect(m_ocrService, &OcrService::textReady,
+            this, &MainWindow::onTextReady);
+    connect(m_ocrService, &OcrService::partialText,
+            this, &MainWindow::onPartialText);
+
+    connect(m_watcher, &RegionWatcher::textChanged,
+            this, [this](const QString &text) {
+                m_preview->setPlainText(text);
+                statusBar()->showMessage(tr("Watched region changed"), 3000);
+            });
+    connect(m_watcher, &RegionWatcher::watchFailed,
+            this, [this](const QString &error) {
+                stopWatching();
+                handleCaptureError(error, false);
+            });
+
+    connect(m_screenshotWriter, &ScreenshotWriter::saved,
+            this, [this](const QString &filePath, double encodeMs, qint64 bytes) {
+                statusBar()->showMessage(tr("Saved %1 (%2 KiB, encoded in %3 ms)")
+                                             .arg(QFileInfo(filePath).fileName())
+                                             .arg(bytes / 1024)
+                                             .arg(encodeMs, 0, 'f', 1),
+                                         5000);
+            });
+    connect(m_screenshotWriter, &ScreenshotWriter::saveFailed,
+            this, [this](const QString &filePath) {
+                QMessageBox::critical(this, tr("Error"),
+                                      tr("Failed to save screenshot to:\n%1").arg(filePath));
+            });
+
+    connect(m_ocrService, &OcrService::initialized,
+            this, &MainWindow::onOcrInitialized);
+
+    // Load Tesseract in the background so the window and the capture shortcut
+    // are usable right away; early captures wait in the OCR queue.
+    applyLanguages();
+    statusBar()->showMessage(tr("Loading OCR engine..."));
 }
 
 MainWindow::~MainWindow()
 {
+    if (m_persistOcrCache)
+        m_ocrService->cache().save(ocrCacheFilePath());
+
+    // SNIPTEXT_TRACE=<file> records a Chrome trace of the whole session.
+    const QString tracePath = qEnvironmentVariable("SNIPTEXT_TRACE");
+    if (!tracePath.isEmpty() && !LatencyTrace::instance().writeChromeTrace(tracePath))
+        qWarning("SnipText: cannot write trace to %s", qUtf8Printable(tracePath));
+
+    // Stop the OCR workers and flush pending screenshots before the rest of
+    // the window goes away.
     delete m_ocrService;
     m_ocrService = nullptr;
+    delete m_screenshotWriter;
+    m_screenshotWriter = nullptr;
+    delete m_history;
+    m_history = nullptr;
+}
+
+void MainWindow::showEvent(QShowEvent *event)
+{
+    QMainWindow::showEvent(event);
+    if (m_windowShownMs < 0) {
+        m_windowShownMs = m_startupTimer.elapsed();
+        qCInfo(lcStartup, "window shown after %lld ms", m_windowShownMs);
+    }
+}
+
+void MainWindow::onOcrInitialized(bool ok, double elapsedMs)
+{
+    if (!ok && m_ocrService->isReady()) {
+        // A failed swap leaves the engines in service alone.
+        statusBar()->clearMessage();
+        QMessageBox::warning(this, tr("Tesseract"),
+                             tr("Failed to load \"%1\"; captures keep using \"%2\".")
+                                 .arg(m_ocrLanguage, m_ocrService->language()));
+        m_ocrLanguage = m_ocrService->language();
+        return;
+    }
+    if (!ok) {
+        statusBar()->clearMessage();
+        QMessageBox::critical(this, tr("Tesseract"),
+                              tr("Failed to initialize Tesseract. Check tessdata path."));
+        return;
+    }
+
+    if (m_engineReadyMs < 0) {
+        m_engineReadyMs = m_startupTimer.elapsed();
+        qCInfo(lcStartup, "OCR engine ready after %lld ms (engine load %.0f ms)",
+               m_engineReadyMs, elapsedMs);
+    }
+    statusBar()->showMessage(tr("OCR engine ready (loaded in %1 ms)").arg(elapsedMs, 0, 'f', 0), 5000);
+}
+
+QString MainWindow::startupReport() const
+{
+    QStringList lines;
+    if (m_windowShownMs >= 0)
+        lines << tr("Window shown after: %1 ms").arg(m_windowShownMs);
+    if (m_engineReadyMs >= 0)
+        lines << tr("OCR engine ready after: %1 ms").arg(m_engineReadyMs);
+    else
+        lines << tr("OCR engine: not ready");
+    return lines.join('\n');
 }
 
 void MainWindow::onNewScreenshot()
@@ -195,38 +631,168 @@ void MainWindow::onNewScreenshot()
         return;
 
     if (m_captureMultipleAreas)
-        m_multiCaptureTexts.clear();
+        resetMultiCapture();
+
+    session->start();
+}
+
+void MainWindow::onWatchRegion()
+{
+    if (m_watcher->isActive()) {
+        stopWatching();
+        return;
+    }
+    if (!m_ocrService->acceptsJobs()) {
+        handleCaptureError(tr("The OCR engine is not available."), false);
+        return;
+    }
+
+    // The region is picked with an ordinary single-selection session; its
+    // pixels are not recognized as a capture, the watcher grabs them itself.
+    auto *session = new CaptureSession(this);
+    session->setBackend(m_captureBackend.get());
+    session->setOverlayColor(m_color);
+    session->setCaptureDelay(m_captureDelayMs);
+    session->setFreezeFrame(m_freezeFrame);
+    session->setShowFrameTimes(m_showOverlayFrameTimes);
+
+    connect(session, &CaptureSession::captureReady,
+            this, [this, session]() {
+                // A freeze-frame overlay is still on screen at this point;
+                // give the compositor the usual time before the first grab.
+                // The watcher is active, and Stop Watching cancels it, from
+                // here on.
+                m_watcher->start(session->lastSelection(), m_captureDelayMs);
+                m_watchBtn->setText(tr("Stop Watching"));
+                statusBar()->showMessage(tr("Watching region every %1 ms").arg(m_watchIntervalMs), 3000);
+                session->deleteLater();
+            });
+    connect(session, &CaptureSession::captureFailed,
+            this, [this, session](const QString &error, bool fatal) {
+                session->deleteLater();
+                handleCaptureError(error, fatal);
+            });
 
     session->start();
 }
 
-void MainWindow::processCapturedImage(const QImage &image, bool multiCapture)
+void MainWindow::stopWatching()
+{
+    m_watcher->stop();
+    m_watchBtn->setText(tr("Watch Region"));
+}
+
+void MainWindow::processCapturedImage(const QImage &frame, const QRect &pixelRect, bool multiCapture,
+                                      const QRect &selection, qint64 releasedAtNs)
+{
+    if (m_ocrService && m_ocrService->acceptsJobs()) {
+        // Recognition runs on the OCR workers; the text arrives in onTextReady().
+        // Captures taken while the engine is still loading wait in its queue.
+        if (!m_ocrService->isReady())
+            statusBar()->showMessage(tr("Waiting for the OCR engine to finish loading..."));
+        quint64 jobId = 0;
+        if (multiCapture && m_multiCaptureSnapshot != 0)
+            jobId = m_ocrService->submitRegion(m_multiCaptureSnapshot, pixelRect);
+        else if (!frame.isNull())
+            jobId = m_ocrService->submit(frame, pixelRect);
+
+        if (jobId != 0 && multiCapture) {
+            m_multiCaptureJobs.append(jobId);
+            m_multiCaptureTexts.append(QString());
+            ++m_multiCapturePending;
+        } else if (jobId != 0) {
+            m_clipboardJobs.insert(jobId);
+        }
+
+        if (jobId != 0) {
+            CaptureInfo info;
+            info.selection = selection;
+            info.releasedAtNs = releasedAtNs;
+            if (m_keepHistory && m_historyThumbnails) {
+                info.frame = frame;
+                info.pixelRect = pixelRect;
+            }
+            m_captures.insert(jobId, info);
+        }
+    }
+
+    // Without screenshots a multi-capture session drops its color frame.
+    if (m_saveScreenshot && !frame.isNull())
+        saveScreenshot(frame, pixelRect);
+}
+
+void MainWindow::onPartialText(quint64 jobId, const QString &text)
 {
-    QString text;
-    if (m_ocrService && m_ocrService->isReady())
-        text = m_ocrService->extractText(image);
-
-    if (!text.isEmpty()) {
-        if (multiCapture) {
-            m_multiCaptureTexts.append(text);
-        } else {
-            if (QClipboard *cb = QGuiApplication::clipboard())
-                cb->setText(text, QClipboard::Clipboard);
+    const bool clipboardJob = m_clipboardJobs.contains(jobId);
+    if (!clipboardJob && !m_multiCaptureJobs.contains(jobId))
+        return;
+
+    m_preview->setPlainText(text);
+    statusBar()->showMessage(tr("Recognizing... %n line(s) so far", nullptr, int(text.count('\n')) + 1),
+                             3000);
+
+    // A single capture's clipboard fills in as the text arrives; multi-capture
+    // text is only copied once every region is done.
+    if (clipboardJob) {
+        if (QClipboard *cb = QGuiApplication::clipboard())
+            cb->setText(text, QClipboard::Clipboard);
+    }
+}
+
+void MainWindow::onTextReady(quint64 jobId, const QString &text)
+{
+    if (m_clipboardJobs.contains(jobId) || m_multiCaptureJobs.contains(jobId))
+        m_preview->setPlainText(text);
+
+    const CaptureInfo info = m_captures.take(jobId);
+    if (m_keepHistory && (m_clipboardJobs.contains(jobId) || m_multiCaptureJobs.contains(jobId)))
+        m_history->append(text, info.selection, info.frame, info.pixelRect);
+
+    if (m_clipboardJobs.remove(jobId)) {
+        const qint64 releasedAtNs = info.releasedAtNs;
+        if (!text.isEmpty()) {
+            {
+                LatencyScope scope(LatencyTrace::Stage::Clipboard, jobId);
+                if (QClipboard *cb = QGuiApplication::clipboard())
+                    cb->setText(text, QClipboard::Clipboard);
+            }
+            const qint64 copiedNs = LatencyTrace::now();
+            LatencyTrace::instance().record(LatencyTrace::Stage::ReleaseToClipboard, releasedAtNs, copiedNs, jobId);
+            const double latencyMs = (copiedNs - releasedAtNs) / 1e6;
+            statusBar()->showMessage(tr("Text copied %1 ms after selection").arg(latencyMs, 0, 'f', 0),
+                                     5000);
         }
+        return;
     }
 
-    if (m_saveScreenshot)
-        saveScreenshot(image);
+    // Results of a canceled or already reset session are simply dropped.
+    const int index = m_multiCaptureJobs.indexOf(jobId);
+    if (index < 0)
+        return;
+
+    m_multiCaptureTexts[index] = text;
+    --m_multiCapturePending;
+
+    if (m_multiCaptureFinishing && m_multiCapturePending == 0)
+        finalizeMultiCapture();
 }
 
 void MainWindow::finalizeMultiCapture()
 {
-    if (m_multiCaptureTexts.isEmpty())
+    // Wait for the remaining regions; the last result calls us again.
+    if (m_multiCapturePending > 0) {
+        m_multiCaptureFinishing = true;
         return;
+    }
 
-    const QString finalText = m_multiCaptureTexts.join("\n\n");
-    m_multiCaptureTexts.clear();
+    QStringList texts;
+    for (const QString &text : std::as_const(m_multiCaptureTexts)) {
+        if (!text.isEmpty())
+            texts.append(text);
+    }
+    resetMultiCapture();
 
+    const QString finalText = texts.join("\n\n");
     if (finalText.isEmpty())
         return;
 
@@ -234,21 +800,222 @@ void MainWindow::finalizeMultiCapture()
         cb->setText(finalText, QClipboard::Clipboard);
 }
 
-void MainWindow::saveScreenshot(const QImage &image)
+void MainWindow::resetMultiCapture()
+{
+    m_multiCaptureTexts.clear();
+    m_multiCaptureJobs.clear();
+    m_multiCapturePending = 0;
+    m_multiCaptureFinishing = false;
+    if (m_multiCaptureSnapshot != 0) {
+        m_ocrService->releaseSnapshot(m_multiCaptureSnapshot);
+        m_multiCaptureSnapshot = 0;
+    }
+}
+
+void MainWindow::saveScreenshot(const QImage &frame, const QRect &pixelRect)
 {
-    const QString fileName =
-        QString("snip_%1.png").arg(QDateTime::currentDateTime().toString("yyyyMMdd_HHmmss"));
-    QDir dir(m_dir);
-    if (!dir.exists())
-        dir.mkpath(".");
-    const QString filePath = dir.filePath(fileName);
-
-    if (!image.save(filePath, "PNG")) {
-        QMessageBox::critical(this, tr("Error"),
-                              tr("Failed to save screenshot to:\n%1").arg(filePath));
+    // Cropping and encoding happen on the writer thread; the outcome is
+    // reported through ScreenshotWriter::saved/saveFailed.
+    if (!m_screenshotWriter->enqueue(frame, pixelRect, m_dir)) {
+        QMessageBox::warning(this, tr("Warning"),
+                             tr("Screenshots are still being written; this one was not saved."));
     }
 }
 
+void MainWindow::applyLanguages()
+{
+    const QString primary = m_ocrLanguages.value(0, QStringLiteral("eng"));
+    // Script detection costs an OSD pass per capture, so it only runs when
+    // the user listed several languages or asked for it explicitly. Other
+    // languages only load once a capture in their script comes along.
+    QStringList languages;
+    if (m_ocrLanguages.size() > 1)
+        languages = m_ocrLanguages;
+    else if (m_detectScript)
+        languages = OcrService::installedLanguages(tessdataPath());
+    m_ocrService->setLanguages(languages);
+
+    if (primary != m_ocrLanguage || m_ocrService->state() == OcrService::State::Uninitialized) {
+        m_ocrLanguage = primary;
+        // Once an engine is up, captures keep using it until the new one has
+        // loaded in the background.
+        if (m_ocrService->isReady())
+            statusBar()->showMessage(tr("Loading \"%1\" in the background...").arg(m_ocrLanguage));
+        m_ocrService->initializeAsync(tessdataPath(), m_ocrLanguage);
+    }
+}
+
+void MainWindow::applyPreprocessOptions()
+{
+    m_ocrService->setPreprocessOptions(m_preprocess);
+
+    m_settings->beginGroup("preprocess");
+    m_settings->setValue("normalizeTextSize", m_preprocess.normalizeTextSize);
+    m_settings->setValue("normalizeContrast", m_preprocess.normalizeContrast);
+    m_settings->setValue("fixPolarity", m_preprocess.fixPolarity);
+    m_settings->setValue("denoise", m_preprocess.denoise);
+    m_settings->setValue("binarization", int(m_preprocess.binarization));
+    m_settings->endGroup();
+}
+
+void MainWindow::loadProfiles()
+{
+    m_profiles = OcrProfile::builtinProfiles();
+    m_builtinProfileCount = m_profiles.size();
+
+    const int count = m_settings->beginReadArray("profiles");
+    for (int i = 0; i < count; ++i) {
+        m_settings->setArrayIndex(i);
+        OcrProfile profile;
+        profile.name = m_settings->value("name").toString().trimmed();
+        if (profile.name.isEmpty())
+            continue;
+        profile.layout = OcrProfile::layoutFromName(m_settings->value("layout").toString());
+        profile.engineMode = OcrProfile::engineModeFromName(m_settings->value("engineMode").toString());
+        profile.whitelist = m_settings->value("whitelist").toString();
+        profile.dpi = qBound(0, m_settings->value("dpi").toInt(), 2400);
+        m_profiles.append(profile);
+    }
+    m_settings->endArray();
+}
+
+void MainWindow::saveUserProfiles()
+{
+    m_settings->beginWriteArray("profiles");
+    for (int i = m_builtinProfileCount; i < m_profiles.size(); ++i) {
+        const OcrProfile &profile = m_profiles.at(i);
+        m_settings->setArrayIndex(i - m_builtinProfileCount);
+        m_settings->setValue("name", profile.name);
+        m_settings->setValue("layout", OcrProfile::layoutName(profile.layout));
+        m_settings->setValue("engineMode", OcrProfile::engineModeName(profile.engineMode));
+        m_settings->setValue("whitelist", profile.whitelist);
+        m_settings->setValue("dpi", profile.dpi);
+    }
+    m_settings->endArray();
+}
+
+void MainWindow::populateProfileMenu()
+{
+    if (!m_profileMenu)
+        return;
+
+    // The old actions belong to their group, not to the menu.
+    qDeleteAll(m_profileMenu->findChildren<QActionGroup *>(QString(), Qt::FindDirectChildrenOnly));
+    m_profileMenu->clear();
+    auto profileGroup = new QActionGroup(m_profileMenu);
+    for (int i = 0; i < m_profiles.size(); ++i) {
+        if (i == m_builtinProfileCount)
+            m_profileMenu->addSeparator();
+
+        const QString name = m_profiles.at(i).name;
+        auto act = new QAction(name, profileGroup);
+        act->setCheckable(true);
+        act->setChecked(name == m_profileName);
+        connect(act, &QAction::triggered, this, [this, name]() {
+            selectProfile(name);
+        });
+        m_profileMenu->addAction(act);
+    }
+    m_profileMenu->addSeparator();
+
+    auto newProfileAct = new QAction(tr("New Profile..."), m_profileMenu);
+    connect(newProfileAct, &QAction::triggered, this, &MainWindow::editNewProfile);
+    m_profileMenu->addAction(newProfileAct);
+}
+
+void MainWindow::selectProfile(const QString &name)
+{
+    // Unknown names (e.g. a deleted profile) fall back to the first built-in.
+    const OcrProfile *selected = &m_profiles.first();
+    for (const OcrProfile &profile : std::as_const(m_profiles)) {
+        if (profile.name == name)
+            selected = &profile;
+    }
+
+    m_profileName = selected->name;
+    m_ocrService->setProfile(*selected);
+    m_settings->setValue("ocrProfile", m_profileName);
+}
+
+void MainWindow::editNewProfile()
+{
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("New OCR Profile"));
+
+    auto *layout = new QFormLayout(&dialog);
+    auto *nameEdit = new QLineEdit(&dialog);
+    layout->addRow(tr("Name:"), nameEdit);
+
+    auto *layoutBox = new QComboBox(&dialog);
+    const QPair<QString, OcrProfile::Layout> layouts[] = {
+        {tr("Automatic (from selection shape)"), OcrProfile::Layout::Auto},
+        {tr("Full page"), OcrProfile::Layout::Page},
+        {tr("Uniform block"), OcrProfile::Layout::Block},
+        {tr("Sparse text"), OcrProfile::Layout::Sparse},
+        {tr("Single line"), OcrProfile::Layout::SingleLine},
+        {tr("Single word"), OcrProfile::Layout::SingleWord},
+    };
+    for (const auto &entry : layouts)
+        layoutBox->addItem(entry.first, int(entry.second));
+    layout->addRow(tr("Layout:"), layoutBox);
+
+    auto *modeBox = new QComboBox(&dialog);
+    const QPair<QString, OcrProfile::EngineMode> modes[] = {
+        {tr("Default"), OcrProfile::EngineMode::Default},
+        {tr("LSTM only"), OcrProfile::EngineMode::LstmOnly},
+        {tr("Legacy only"), OcrProfile::EngineMode::LegacyOnly},
+        {tr("LSTM + legacy"), OcrProfile::EngineMode::Combined},
+    };
+    for (const auto &entry : modes)
+        modeBox->addItem(entry.first, int(entry.second));
+    layout->addRow(tr("Engine:"), modeBox);
+
+    auto *whitelistEdit = new QLineEdit(&dialog);
+    whitelistEdit->setPlaceholderText(tr("All characters"));
+    layout->addRow(tr("Allowed characters:"), whitelistEdit);
+
+    auto *dpiBox = new QSpinBox(&dialog);
+    dpiBox->setRange(0, 2400);
+    dpiBox->setSpecialValueText(tr("Automatic"));
+    layout->addRow(tr("DPI:"), dpiBox);
+
+    auto *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel,
+                                         Qt::Horizontal,
+                                         &dialog);
+    layout->addWidget(buttons);
+
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+
+    if (dialog.exec() != QDialog::Accepted)
+        return;
+
+    OcrProfile profile;
+    profile.name = nameEdit->text().trimmed();
+    if (profile.name.isEmpty())
+        return;
+    profile.layout = OcrProfile::Layout(layoutBox->currentData().toInt());
+    profile.engineMode = OcrProfile::EngineMode(modeBox->currentData().toInt());
+    profile.whitelist = whitelistEdit->text();
+    profile.dpi = dpiBox->value();
+
+    for (int i = 0; i < m_profiles.size(); ++i) {
+        if (m_profiles.at(i).name != profile.name)
+            continue;
+        if (i < m_builtinProfileCount) {
+            QMessageBox::warning(this, tr("Warning"),
+                                 tr("\"%1\" is a built-in profile.").arg(profile.name));
+            return;
+        }
+        m_profiles.removeAt(i);
+        break;
+    }
+    m_profiles.append(profile);
+    saveUserProfiles();
+    selectProfile(profile.name);
+    populateProfileMenu();
+}
+
 void MainWindow::handleCaptureError(const QString &errorMessage, bool fatal)
 {
     if (errorMessage.isEmpty())
@@ -263,14 +1030,25 @@ void MainWindow::handleCaptureError(const QString &errorMessage, bool fatal)
 CaptureSession *MainWindow::createCaptureSession()
 {
     auto *session = new CaptureSession(this);
+    session->setBackend(m_captureBackend.get());
     session->setOverlayColor(m_color);
     session->setCaptureDelay(m_captureDelayMs);
     session->setMultiSelectionEnabled(m_captureMultipleAreas);
+    session->setRetainSnapshot(m_saveScreenshot);
+    session->setShowFrameTimes(m_showOverlayFrameTimes);
+    session->setFreezeFrame(m_freezeFrame);
+
+    connect(session, &CaptureSession::snapshotReady,
+            this, [this](const QImage &frame) {
+                if (m_ocrService->acceptsJobs())
+                    m_multiCaptureSnapshot = m_ocrService->registerSnapshot(frame);
+            });
 
     connect(session, &CaptureSession::captureReady,
-            this, [this, session](const QImage &image) {
+            this, [this, session](const QImage &frame, const QRect &pixelRect) {
                 const bool multi = session->multiSelectionEnabled();
-                processCapturedImage(image, multi);
+                processCapturedImage(frame, pixelRect, multi, session->lastSelection(),
+                                     session->lastReleaseNs());
                 if (!multi)
                     session->deleteLater();
             });
@@ -278,7 +1056,7 @@ CaptureSession *MainWindow::createCaptureSession()
     connect(session, &CaptureSession::captureFailed,
             this, [this, session](const QString &error, bool fatal) {
                 if (session->multiSelectionEnabled())
-                    m_multiCaptureTexts.clear();
+                    resetMultiCapture();
                 session->deleteLater();
                 handleCaptureError(error, fatal);
             });
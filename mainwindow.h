@@ -2,43 +2,99 @@
 #define MAINWINDOW_H
 
 #include <QColor>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QImage>
+#include <QList>
 #include <QMainWindow>
+#include <QPointer>
+#include <QRect>
+#include <QSet>
 #include <QString>
 #include <QStringList>
 
+#include <memory>
+
+#include "imagepreprocessor.h"
+#include "ocrprofile.h"
+
+class QMenu;
+class QPlainTextEdit;
 class QPushButton;
-class QImage;
 class QSettings;
 class QShortcut;
 
+class CaptureBackend;
+class CaptureHistory;
 class CaptureSession;
 class OcrService;
+class HistoryWindow;
+class RegionWatcher;
+class ScreenshotWriter;
 
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
 
 public:
-    MainWindow(QWidget *parent = nullptr);
+    // startupTimer was started first thing in main(); startup metrics are
+    // measured from it.
+    explicit MainWindow(const QElapsedTimer &startupTimer, QWidget *parent = nullptr);
     ~MainWindow();
 
+protected:
+    void showEvent(QShowEvent *event) override;
+
 private slots:
     void onNewScreenshot();
+    void onWatchRegion();
+    void onTextReady(quint64 jobId, const QString &text);
+    void onPartialText(quint64 jobId, const QString &text);
+    void onOcrInitialized(bool ok, double elapsedMs);
 
 private:
-    void processCapturedImage(const QImage &image, bool multiCapture);
+    void processCapturedImage(const QImage &frame, const QRect &pixelRect, bool multiCapture,
+                              const QRect &selection, qint64 releasedAtNs);
     void handleCaptureError(const QString &errorMessage, bool fatal);
+    void stopWatching();
     CaptureSession* createCaptureSession();
     void finalizeMultiCapture();
-    void saveScreenshot(const QImage &image);
+    void resetMultiCapture();
+    void saveScreenshot(const QImage &frame, const QRect &pixelRect);
+    void applyLanguages();
+    void applyPreprocessOptions();
+    void loadProfiles();
+    void saveUserProfiles();
+    void populateProfileMenu();
+    void selectProfile(const QString &name);
+    void editNewProfile();
 
 private:
     QPushButton *m_newShotBtn;
+    QPushButton *m_watchBtn = nullptr;
+    // Text of the latest capture, filled in progressively while streaming.
+    QPlainTextEdit *m_preview = nullptr;
 
     // Defer time to let compositor remove the overlay from the frame.
     const int m_captureDelayMs = 180;
 
-    OcrService *m_ocrService;  // single API instance
+    OcrService *m_ocrService;  // asynchronous OCR front-end over an engine pool
+
+    // Reads screen pixels for every capture session; keeps grab timings.
+    std::unique_ptr<CaptureBackend> m_captureBackend;
+
+    // Watch mode: re-recognizes a pinned region whenever it changes.
+    RegionWatcher *m_watcher = nullptr;
+    int m_watchIntervalMs = 1000;
+
+    // Encodes and writes screenshots off the GUI thread.
+    ScreenshotWriter *m_screenshotWriter;
+
+    // Searchable log of recognized captures, written off the GUI thread.
+    CaptureHistory *m_history = nullptr;
+    QPointer<HistoryWindow> m_historyWindow;
+    bool m_keepHistory = false;
+    bool m_historyThumbnails = false;
 
     // Selection overlay color.
     QColor m_color;
@@ -49,13 +105,73 @@ private:
     // When true, allow capturing multiple regions before finishing.
     bool m_captureMultipleAreas;
 
+    // Tesseract languages; the first is loaded up front, the others only
+    // when script detection routes a capture to them. Empty means English
+    // plus whatever is installed.
+    QStringList m_ocrLanguages;
+    QString m_ocrLanguage;
+    bool m_detectScript = false;
+
+    // Image cleanup applied before recognition.
+    PreprocessOptions m_preprocess;
+
+    // Built-in OCR profiles followed by the user's own, and the active one.
+    QList<OcrProfile> m_profiles;
+    int m_builtinProfileCount = 0;
+    QString m_profileName;
+    QMenu *m_profileMenu = nullptr;
+
+    // When true, the screen is frozen while selecting and captures skip the
+    // compositor delay.
+    bool m_freezeFrame = false;
+
+    // When true, the selection overlay shows its frame times while dragging.
+    bool m_showOverlayFrameTimes = false;
+
+    // When true, large captures stream their text into the preview and clipboard.
+    bool m_streamOcr = true;
+
+    // When true, the OCR result cache is saved on exit and reloaded on start.
+    bool m_persistOcrCache;
+
     // The directory where screenshots will be saved if the user has toggled that action on.
     QString m_dir;
 
+    // Results of the current multi-capture session in selection order; each slot
+    // is filled in when the job with the id at the same index in m_multiCaptureJobs completes.
     QStringList m_multiCaptureTexts;
+    QList<quint64> m_multiCaptureJobs;
+    int m_multiCapturePending = 0;
+    // Grayscale snapshot the session's regions are recognized from; 0 when
+    // regions are submitted as ordinary captures.
+    quint64 m_multiCaptureSnapshot = 0;
+    // Set when the user finished the session while recognition is still running.
+    bool m_multiCaptureFinishing = false;
+
+    // Single-capture jobs whose text goes straight to the clipboard.
+    QSet<quint64> m_clipboardJobs;
+
+    // What a capture job's text is recorded with once it arrives.
+    struct CaptureInfo
+    {
+        // Selection in virtual desktop coordinates.
+        QRect selection;
+        // Kept only for the history thumbnail.
+        QImage frame;
+        QRect pixelRect;
+        // When the selection was released, on LatencyTrace's clock.
+        qint64 releasedAtNs = 0;
+    };
+    QHash<quint64, CaptureInfo> m_captures;
 
     void initGUI();
 
+    // Startup metrics, measured from the start of main().
+    QElapsedTimer m_startupTimer;
+    qint64 m_windowShownMs = -1;
+    qint64 m_engineReadyMs = -1;
+    QString startupReport() const;
+
     QSettings *m_settings;
     QString m_captureShortcut;
     QShortcut *m_shortcutHandler;
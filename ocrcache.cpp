@@ -0,0 +1,178 @@
+#include "ocrcache.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+
+namespace {
+
+constexpr quint32 kFileMagic = 0x534e4f43; // "SNOC"
+constexpr quint32 kFileVersion = 1;
+
+} // namespace
+
+OcrCache::OcrCache(qsizetype maxBytes)
+    : m_maxBytes(maxBytes)
+{
+}
+
+bool OcrCache::lookup(const Key &key, QString *text)
+{
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_index.constFind(key);
+    if (it == m_index.constEnd()) {
+        ++m_misses;
+        return false;
+    }
+
+    // Move to the front without reallocating the node.
+    m_entries.splice(m_entries.begin(), m_entries, it.value());
+    ++m_hits;
+    if (text)
+        *text = m_entries.front().text;
+    return true;
+}
+
+void OcrCache::insert(const Key &key, const QString &text)
+{
+    QMutexLocker locker(&m_mutex);
+    insertLocked(key, text, true);
+    evictLocked();
+}
+
+void OcrCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_entries.clear();
+    m_index.clear();
+    m_bytes = 0;
+    m_hits = 0;
+    m_misses = 0;
+}
+
+void OcrCache::setMaxBytes(qsizetype maxBytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maxBytes = qMax<qsizetype>(0, maxBytes);
+    evictLocked();
+}
+
+qsizetype OcrCache::maxBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_maxBytes;
+}
+
+qsizetype OcrCache::bytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_bytes;
+}
+
+int OcrCache::count() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_index.size();
+}
+
+quint64 OcrCache::hits() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_hits;
+}
+
+quint64 OcrCache::misses() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_misses;
+}
+
+bool OcrCache::load(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    in >> magic >> version;
+    if (magic != kFileMagic || version != kFileVersion)
+        return false;
+
+    in.setVersion(QDataStream::Qt_5_12);
+    quint32 count = 0;
+    in >> count;
+
+    QMutexLocker locker(&m_mutex);
+    // Entries are stored most recent first; appending keeps that order and
+    // leaves anything cached in this session in front.
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        Key key;
+        QString text;
+        in >> key.pixels >> key.config >> text;
+        if (in.status() != QDataStream::Ok)
+            break;
+        if (!m_index.contains(key))
+            insertLocked(key, text, false);
+    }
+    evictLocked();
+    return in.status() == QDataStream::Ok;
+}
+
+bool OcrCache::save(const QString &filePath) const
+{
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
+
+    // QSaveFile only replaces the old file once everything is written.
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream out(&file);
+    out << kFileMagic << kFileVersion;
+    out.setVersion(QDataStream::Qt_5_12);
+
+    {
+        QMutexLocker locker(&m_mutex);
+        out << quint32(m_entries.size());
+        for (const Entry &entry : m_entries)
+            out << entry.key.pixels << entry.key.config << entry.text;
+    }
+
+    return out.status() == QDataStream::Ok && file.commit();
+}
+
+qsizetype OcrCache::costOf(const QString &text)
+{
+    // Text payload plus a rough estimate of the list node and hash slot.
+    return text.size() * qsizetype(sizeof(QChar)) + 96;
+}
+
+void OcrCache::insertLocked(const Key &key, const QString &text, bool mostRecent)
+{
+    const auto existing = m_index.find(key);
+    if (existing != m_index.end()) {
+        m_bytes -= costOf(existing.value()->text);
+        m_entries.erase(existing.value());
+        m_index.erase(existing);
+    }
+
+    const auto it = m_entries.insert(mostRecent ? m_entries.begin() : m_entries.end(),
+                                     Entry{key, text});
+    m_index.insert(key, it);
+    m_bytes += costOf(text);
+}
+
+void OcrCache::evictLocked()
+{
+    while (m_bytes > m_maxBytes && !m_entries.empty()) {
+        const Entry &oldest = m_entries.back();
+        m_bytes -= costOf(oldest.text);
+        m_index.remove(oldest.key);
+        m_entries.pop_back();
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef OCRCACHE_H
+#define OCRCACHE_H
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+#include <list>
+
+// LRU cache of recognized text keyed by a hash of the grayscale pixels plus a
+// hash of the engine configuration (language, segmentation, preprocessing).
+// Re-snipping a pixel-identical region then skips recognition entirely.
+// Thread-safe; shared by all OCR workers.
+class OcrCache
+{
+public:
+    struct Key
+    {
+        quint64 pixels = 0;
+        quint64 config = 0;
+
+        bool operator==(const Key &other) const
+        {
+            return pixels == other.pixels && config == other.config;
+        }
+    };
+
+    explicit OcrCache(qsizetype maxBytes = 16 * 1024 * 1024);
+
+    bool lookup(const Key &key, QString *text);
+    void insert(const Key &key, const QString &text);
+    void clear();
+
+    // Least recently used entries are evicted once the estimated memory use
+    // exceeds maxBytes.
+    void setMaxBytes(qsizetype maxBytes);
+    qsizetype maxBytes() const;
+    qsizetype bytes() const;
+    int count() const;
+    quint64 hits() const;
+    quint64 misses() const;
+
+    // Optional persistence so hits survive restarts. load() merges the stored
+    // entries below the ones already cached.
+    bool load(const QString &filePath);
+    bool save(const QString &filePath) const;
+
+private:
+    struct Entry
+    {
+        Key key;
+        QString text;
+    };
+    using EntryList = std::list<Entry>;
+
+    static qsizetype costOf(const QString &text);
+    void insertLocked(const Key &key, const QString &text, bool mostRecent);
+    void evictLocked();
+
+    mutable QMutex m_mutex;
+    // Front is the most recently used entry.
+    EntryList m_entries;
+    QHash<Key, EntryList::iterator> m_index;
+    qsizetype m_bytes = 0;
+    qsizetype m_maxBytes;
+    quint64 m_hits = 0;
+    quint64 m_misses = 0;
+};
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+inline size_t qHash(const OcrCache::Key &key, size_t seed = 0)
+#else
+inline uint qHash(const OcrCache::Key &key, uint seed = 0)
+#endif
+{
+    // Both halves are already well-mixed hashes.
+    const quint64 mixed = key.pixels ^ (key.config * 0x9e3779b97f4a7c15ULL);
+    return decltype(seed)(mixed ^ (mixed >> 32)) ^ seed;
+}
+
+#endif // OCRCACHE_H
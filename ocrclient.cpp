@@ -0,0 +1,263 @@
+#include "ocrclient.h"
+
+#include "ocrprotocol.h"
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QImage>
+#include <QImageReader>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalSocket>
+#include <QSharedMemory>
+#include <QTextStream>
+
+#include <cstring>
+#include <memory>
+
+namespace {
+
+constexpr int kConnectTimeoutMs = 3000;
+constexpr int kDefaultTimeoutMs = 60000;
+
+double roundMs(double ms)
+{
+    return qRound(ms * 1000.0) / 1000.0;
+}
+
+struct Request
+{
+    QString path;
+    QElapsedTimer timer;
+    // Holds a shared image until the daemon has answered.
+    std::shared_ptr<QSharedMemory> memory;
+};
+
+QImage loadImage(const QString &path, QString *error)
+{
+    QImageReader reader(path);
+    reader.setAutoTransform(true);
+    QImage image = reader.read();
+    if (image.isNull()) {
+        *error = reader.errorString();
+        return image;
+    }
+    switch (image.format()) {
+    case QImage::Format_Grayscale8:
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+    case QImage::Format_RGB888:
+        return image;
+    default:
+        return image.convertToFormat(QImage::Format_RGB32);
+    }
+}
+
+// Serializes image as an Inline request, or copies its pixels into a new
+// shared memory segment and serializes a Shared request naming it.
+QByteArray imageRequest(quint32 requestId, const QImage &image, qint64 inlineMax,
+                        std::shared_ptr<QSharedMemory> *memory, QString *error)
+{
+    const qint64 bytes = image.sizeInBytes();
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(OcrProtocol::kStreamVersion);
+
+    const bool shared = bytes > inlineMax;
+    out << requestId << quint8(shared ? OcrProtocol::Kind::Shared : OcrProtocol::Kind::Inline)
+        << qint32(image.width()) << qint32(image.height()) << qint32(image.bytesPerLine())
+        << qint32(image.format());
+
+    if (!shared) {
+        out << QByteArray::fromRawData(reinterpret_cast<const char *>(image.constBits()), int(bytes));
+        return payload;
+    }
+
+    const QString key = QStringLiteral("sniptext-%1-%2").arg(QCoreApplication::applicationPid()).arg(requestId);
+    auto segment = std::make_shared<QSharedMemory>(key);
+    if (!segment->create(int(bytes))) {
+        *error = segment->errorString();
+        return QByteArray();
+    }
+    segment->lock();
+    std::memcpy(segment->data(), image.constBits(), size_t(bytes));
+    segment->unlock();
+    *memory = segment;
+    out << key;
+    return payload;
+}
+
+// Blocks until one whole response frame arrives, or fails once the daemon
+// has sent nothing for timeoutMs.
+bool readResponse(QLocalSocket *socket, int timeoutMs, QByteArray *buffer, quint32 *requestId,
+                  QJsonObject *response)
+{
+    QByteArray payload;
+    bool error = false;
+    while (!OcrProtocol::takeFrame(buffer, &payload, &error)) {
+        if (error || !socket->waitForReadyRead(timeoutMs))
+            return false;
+        buffer->append(socket->readAll());
+    }
+
+    QDataStream in(payload);
+    in.setVersion(OcrProtocol::kStreamVersion);
+    QByteArray json;
+    in >> *requestId >> json;
+    *response = QJsonDocument::fromJson(json).object();
+    return in.status() == QDataStream::Ok;
+}
+
+void printRecord(const QJsonObject &record)
+{
+    static QTextStream out(stdout);
+    out << QString::fromUtf8(QJsonDocument(record).toJson(QJsonDocument::Compact)) << Qt::endl;
+}
+
+} // namespace
+
+bool OcrClient::isRequested(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--ocr-client") == 0)
+            return true;
+    }
+    return false;
+}
+
+int OcrClient::run(const QStringList &arguments)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        QStringLiteral("Recognize image files with a running SnipText OCR daemon."));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("files"), QStringLiteral("Image files to recognize."),
+                                 QStringLiteral("<files...>"));
+
+    const QCommandLineOption clientOption(QStringLiteral("ocr-client"),
+        QStringLiteral("Run as a client of the OCR daemon."));
+    const QCommandLineOption socketOption(QStringLiteral("socket"),
+        QStringLiteral("Local socket name of the daemon (default: sniptext-ocr)."),
+        QStringLiteral("name"), OcrProtocol::defaultSocketName());
+    const QCommandLineOption statsOption(QStringLiteral("stats"),
+        QStringLiteral("Print the daemon's statistics and exit."));
+    const QCommandLineOption inlineOption(QStringLiteral("inline-max"),
+        QStringLiteral("Largest image in bytes sent over the socket; larger ones go through shared "
+                       "memory (default: 262144)."),
+        QStringLiteral("bytes"), QString::number(OcrProtocol::kDefaultInlineBytes));
+    const QCommandLineOption pipelineOption(QStringLiteral("pipeline"),
+        QStringLiteral("Requests kept in flight at once (default: 8)."),
+        QStringLiteral("N"), QStringLiteral("8"));
+    const QCommandLineOption timeoutOption(QStringLiteral("timeout"),
+        QStringLiteral("Give up when the daemon sends nothing for this many milliseconds "
+                       "(default: 60000)."),
+        QStringLiteral("ms"), QString::number(kDefaultTimeoutMs));
+
+    parser.addOptions({clientOption, socketOption, statsOption, inlineOption, pipelineOption, timeoutOption});
+    parser.process(arguments);
+
+    QTextStream err(stderr);
+
+    bool ok = false;
+    const qint64 inlineMax = parser.value(inlineOption).toLongLong(&ok);
+    if (!ok || inlineMax < 0) {
+        err << "SnipText: --inline-max expects a byte count" << Qt::endl;
+        return 1;
+    }
+    const int pipeline = parser.value(pipelineOption).toInt(&ok);
+    if (!ok || pipeline <= 0) {
+        err << "SnipText: --pipeline expects a positive number" << Qt::endl;
+        return 1;
+    }
+    const int timeoutMs = parser.value(timeoutOption).toInt(&ok);
+    if (!ok || timeoutMs <= 0) {
+        err << "SnipText: --timeout expects a positive number of milliseconds" << Qt::endl;
+        return 1;
+    }
+    const QStringList files = parser.positionalArguments();
+    if (files.isEmpty() && !parser.isSet(statsOption)) {
+        err << "SnipText: no image files given" << Qt::endl;
+        return 1;
+    }
+
+    QLocalSocket socket;
+    socket.connectToServer(parser.value(socketOption));
+    if (!socket.waitForConnected(kConnectTimeoutMs)) {
+        err << "SnipText: cannot reach the OCR daemon at " << parser.value(socketOption) << ": "
+            << socket.errorString() << " (is `SnipText --daemon` running?)" << Qt::endl;
+        return 1;
+    }
+
+    QByteArray buffer;
+    quint32 requestId = 0;
+    QJsonObject response;
+
+    if (parser.isSet(statsOption)) {
+        QByteArray payload;
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out.setVersion(OcrProtocol::kStreamVersion);
+        out << quint32(0) << quint8(OcrProtocol::Kind::Stats);
+        socket.write(OcrProtocol::frame(payload));
+        if (!readResponse(&socket, timeoutMs, &buffer, &requestId, &response)) {
+            err << "SnipText: no answer from the OCR daemon: " << socket.errorString() << Qt::endl;
+            return 1;
+        }
+        printRecord(response);
+        return 0;
+    }
+
+    // Up to `pipeline` requests are in flight, so the daemon's workers stay
+    // busy while this side decodes the next file.
+    QHash<quint32, Request> inFlight;
+    int next = 0;
+    int failed = 0;
+    while (next < files.size() || !inFlight.isEmpty()) {
+        while (next < files.size() && inFlight.size() < pipeline) {
+            const quint32 id = quint32(++next);
+            Request request;
+            request.path = files.at(id - 1);
+            request.timer.start();
+
+            QString error;
+            const QImage image = loadImage(request.path, &error);
+            const QByteArray payload = image.isNull()
+                ? QByteArray() : imageRequest(id, image, inlineMax, &request.memory, &error);
+            if (payload.isEmpty()) {
+                QJsonObject record;
+                record.insert(QStringLiteral("file"), request.path);
+                record.insert(QStringLiteral("error"), error);
+                printRecord(record);
+                ++failed;
+                continue;
+            }
+            socket.write(OcrProtocol::frame(payload));
+            inFlight.insert(id, request);
+        }
+        if (inFlight.isEmpty())
+            continue;
+
+        socket.flush();
+        if (!readResponse(&socket, timeoutMs, &buffer, &requestId, &response)) {
+            err << "SnipText: no answer from the OCR daemon: " << socket.errorString() << Qt::endl;
+            return 1;
+        }
+        const auto it = inFlight.constFind(requestId);
+        if (it == inFlight.constEnd())
+            continue;
+
+        QJsonObject record = response;
+        record.insert(QStringLiteral("file"), it->path);
+        record.insert(QStringLiteral("roundtrip_ms"), roundMs(it->timer.nsecsElapsed() / 1e6));
+        if (record.contains(QStringLiteral("error")))
+            ++failed;
+        printRecord(record);
+        inFlight.erase(it);
+    }
+    return failed == 0 ? 0 : 2;
+}
@@ -0,0 +1,19 @@
+#ifndef OCRCLIENT_H
+#define OCRCLIENT_H
+
+#include <QStringList>
+
+// Command-line client of the OCR daemon:
+// `SnipText --ocr-client [--socket NAME] [--inline-max BYTES] <files...>`
+// sends each image to a running `SnipText --daemon` and prints one JSON
+// record per image; `--stats` prints the daemon's counters instead. Images up
+// to --inline-max bytes travel on the socket, larger ones in a shared memory
+// segment the daemon reads in place.
+class OcrClient
+{
+public:
+    static bool isRequested(int argc, char *argv[]);
+    static int run(const QStringList &arguments);
+};
+
+#endif // OCRCLIENT_H
@@ -0,0 +1,332 @@
+#include "ocrdaemon.h"
+
+#include "ocrprotocol.h"
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QImage>
+#include <QJsonDocument>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QSharedMemory>
+#include <QTextStream>
+#include <QThread>
+
+#include <cstring>
+
+#ifndef DEFAULT_TESSDATA_PATH
+#define DEFAULT_TESSDATA_PATH ""
+#endif
+
+namespace {
+
+double roundMs(double ms)
+{
+    return qRound(ms * 1000.0) / 1000.0;
+}
+
+bool isSupportedFormat(QImage::Format format)
+{
+    switch (format) {
+    case QImage::Format_Grayscale8:
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+    case QImage::Format_RGB888:
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+bool OcrDaemon::isRequested(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--daemon") == 0)
+            return true;
+    }
+    return false;
+}
+
+int OcrDaemon::run(const QStringList &arguments)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        QStringLiteral("Keep OCR engines loaded and serve recognition requests over a local socket."));
+    parser.addHelpOption();
+
+    const QCommandLineOption daemonOption(QStringLiteral("daemon"),
+        QStringLiteral("Run the OCR daemon."));
+    const QCommandLineOption socketOption(QStringLiteral("socket"),
+        QStringLiteral("Local socket name to listen on (default: sniptext-ocr)."),
+        QStringLiteral("name"), OcrProtocol::defaultSocketName());
+    const QCommandLineOption jobsOption({QStringLiteral("j"), QStringLiteral("jobs")},
+        QStringLiteral("Number of OCR engines (default: cores)."),
+        QStringLiteral("N"));
+    const QCommandLineOption langOption(QStringLiteral("lang"),
+        QStringLiteral("Tesseract language (default: eng)."),
+        QStringLiteral("lang"), QStringLiteral("eng"));
+    const QCommandLineOption languagesOption(QStringLiteral("languages"),
+        QStringLiteral("Other languages the images may be in, comma-separated, or 'installed'. Each image's "
+                       "script picks one; needs osd.traineddata."),
+        QStringLiteral("list"));
+    const QCommandLineOption tessdataOption(QStringLiteral("tessdata"),
+        QStringLiteral("Directory containing the traineddata files."),
+        QStringLiteral("path"), QString::fromUtf8(DEFAULT_TESSDATA_PATH));
+
+    parser.addOptions({daemonOption, socketOption, jobsOption, langOption, languagesOption, tessdataOption});
+    parser.process(arguments);
+
+    QTextStream err(stderr);
+
+    int jobs = QThread::idealThreadCount();
+    if (parser.isSet(jobsOption)) {
+        bool ok = false;
+        jobs = parser.value(jobsOption).toInt(&ok);
+        if (!ok || jobs <= 0) {
+            err << "SnipText: --jobs expects a positive number" << Qt::endl;
+            return 1;
+        }
+    }
+
+    QStringList languages = parser.value(languagesOption).split(QLatin1Char(','), Qt::SkipEmptyParts);
+    if (languages == QStringList{QStringLiteral("installed")})
+        languages = OcrService::installedLanguages(parser.value(tessdataOption));
+
+    OcrDaemon daemon(jobs);
+    if (!daemon.start(parser.value(socketOption), parser.value(tessdataOption), parser.value(langOption),
+                      languages)) {
+        return 1;
+    }
+    return QCoreApplication::exec();
+}
+
+OcrDaemon::OcrDaemon(int jobs, QObject *parent)
+    : QObject(parent)
+    , m_ocr(jobs)
+    , m_server(new QLocalServer(this))
+{
+    connect(&m_ocr, &OcrService::jobTimings,
+            this, [this](quint64 jobId, const OcrJobTimings &timings) {
+                auto it = m_pending.find(jobId);
+                if (it != m_pending.end())
+                    it->timings = timings;
+            });
+    connect(&m_ocr, &OcrService::textReady, this, &OcrDaemon::onTextReady);
+    connect(m_server, &QLocalServer::newConnection, this, &OcrDaemon::onNewConnection);
+}
+
+bool OcrDaemon::start(const QString &socketName, const QString &dataPath, const QString &language,
+                      const QStringList &languages)
+{
+    QTextStream err(stderr);
+
+    m_uptime.start();
+    if (!m_ocr.initialize(dataPath, language)) {
+        err << "SnipText: failed to initialize Tesseract (tessdata '" << dataPath
+            << "', language '" << language << "')" << Qt::endl;
+        return false;
+    }
+    m_ocr.setLanguages(languages);
+
+    // Only the user running the daemon may connect. A socket file left behind
+    // by a daemon that crashed would make listen() fail.
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    if (!m_server->listen(socketName)) {
+        QLocalServer::removeServer(socketName);
+        if (!m_server->listen(socketName)) {
+            err << "SnipText: cannot listen on " << socketName << ": " << m_server->errorString() << Qt::endl;
+            return false;
+        }
+    }
+
+    err << "SnipText: OCR daemon ready on " << m_server->fullServerName() << " after "
+        << m_uptime.elapsed() << " ms (" << m_ocr.engineCount() << " engines)" << Qt::endl;
+    return true;
+}
+
+void OcrDaemon::onNewConnection()
+{
+    while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+        ++m_stats.connections;
+        m_buffers.insert(socket, QByteArray());
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() { onReadyRead(socket); });
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket]() {
+            // Jobs of the client still finish; their results are dropped.
+            m_buffers.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void OcrDaemon::onReadyRead(QLocalSocket *socket)
+{
+    auto it = m_buffers.find(socket);
+    if (it == m_buffers.end())
+        return;
+    it->append(socket->readAll());
+
+    // A client may pipeline any number of requests; each is submitted as soon
+    // as its frame is complete.
+    QByteArray payload;
+    bool error = false;
+    while (OcrProtocol::takeFrame(&*it, &payload, &error)) {
+        handleRequest(socket, payload);
+        it = m_buffers.find(socket);
+        if (it == m_buffers.end())
+            return;
+    }
+    if (error) {
+        ++m_stats.errors;
+        socket->disconnectFromServer();
+    }
+}
+
+void OcrDaemon::handleRequest(QLocalSocket *socket, const QByteArray &payload)
+{
+    QDataStream in(payload);
+    in.setVersion(OcrProtocol::kStreamVersion);
+
+    quint32 requestId = 0;
+    quint8 kind = 0;
+    in >> requestId >> kind;
+    ++m_stats.requests;
+
+    auto fail = [&](const QString &message) {
+        ++m_stats.errors;
+        QJsonObject response;
+        response.insert(QStringLiteral("error"), message);
+        reply(socket, requestId, response);
+    };
+
+    if (in.status() != QDataStream::Ok)
+        return fail(QStringLiteral("malformed request"));
+
+    if (OcrProtocol::Kind(kind) == OcrProtocol::Kind::Stats)
+        return reply(socket, requestId, statsObject());
+
+    if (OcrProtocol::Kind(kind) != OcrProtocol::Kind::Inline && OcrProtocol::Kind(kind) != OcrProtocol::Kind::Shared)
+        return fail(QStringLiteral("unknown request kind %1").arg(kind));
+
+    qint32 width = 0;
+    qint32 height = 0;
+    qint32 bytesPerLine = 0;
+    qint32 formatValue = 0;
+    in >> width >> height >> bytesPerLine >> formatValue;
+    const QImage::Format format = QImage::Format(formatValue);
+    const int depth = isSupportedFormat(format) ? QImage::toPixelFormat(format).bitsPerPixel() : 0;
+    if (in.status() != QDataStream::Ok || width <= 0 || height <= 0 || depth == 0
+        || qint64(bytesPerLine) < (qint64(width) * depth + 7) / 8) {
+        return fail(QStringLiteral("invalid image header"));
+    }
+    const qint64 imageBytes = qint64(bytesPerLine) * height;
+
+    QImage image;
+    const bool shared = OcrProtocol::Kind(kind) == OcrProtocol::Kind::Shared;
+    if (shared) {
+        QString key;
+        in >> key;
+        auto *memory = new QSharedMemory;
+        memory->setKey(key);
+        if (in.status() != QDataStream::Ok || !memory->attach(QSharedMemory::ReadOnly)) {
+            delete memory;
+            return fail(QStringLiteral("cannot attach shared memory '%1'").arg(key));
+        }
+        if (memory->size() < imageBytes) {
+            delete memory;
+            return fail(QStringLiteral("shared memory '%1' is smaller than the image").arg(key));
+        }
+        // The pixels are read where the client put them. The worker drops
+        // the image once it has converted it, which detaches the segment.
+        image = QImage(static_cast<const uchar *>(memory->constData()), width, height, bytesPerLine, format,
+                       [](void *info) { delete static_cast<QSharedMemory *>(info); }, memory);
+        ++m_stats.sharedImages;
+        m_stats.sharedBytes += imageBytes;
+    } else {
+        auto *pixels = new QByteArray;
+        in >> *pixels;
+        if (in.status() != QDataStream::Ok || pixels->size() < imageBytes) {
+            delete pixels;
+            return fail(QStringLiteral("truncated image data"));
+        }
+        image = QImage(reinterpret_cast<const uchar *>(pixels->constData()), width, height, bytesPerLine,
+                       format, [](void *info) { delete static_cast<QByteArray *>(info); }, pixels);
+        ++m_stats.inlineImages;
+        m_stats.inlineBytes += imageBytes;
+    }
+
+    Pending pending;
+    pending.socket = socket;
+    pending.requestId = requestId;
+    pending.shared = shared;
+    pending.timer.start();
+    // The service reports back through queued signals, so the answer cannot
+    // overtake this insert.
+    m_pending.insert(m_ocr.submit(image), pending);
+}
+
+void OcrDaemon::onTextReady(quint64 jobId, const QString &text)
+{
+    const auto it = m_pending.constFind(jobId);
+    if (it == m_pending.constEnd())
+        return;
+    const Pending pending = *it;
+    m_pending.erase(it);
+
+    const double elapsedMs = pending.timer.nsecsElapsed() / 1e6;
+    ++m_stats.completed;
+    m_stats.totalMs += elapsedMs;
+    if (pending.timings.failed)
+        ++m_stats.errors;
+    if (!pending.socket)
+        return;
+
+    QJsonObject response;
+    if (pending.timings.failed) {
+        response.insert(QStringLiteral("error"), QStringLiteral("recognition failed"));
+    } else {
+        response.insert(QStringLiteral("text"), text);
+    }
+    response.insert(QStringLiteral("transport"),
+                    pending.shared ? QStringLiteral("shared") : QStringLiteral("inline"));
+    response.insert(QStringLiteral("server_ms"), roundMs(elapsedMs));
+    response.insert(QStringLiteral("convert_ms"), roundMs(pending.timings.convertMs));
+    response.insert(QStringLiteral("preprocess_ms"), roundMs(pending.timings.preprocessMs));
+    response.insert(QStringLiteral("ocr_ms"), roundMs(pending.timings.recognizeMs));
+    response.insert(QStringLiteral("cache_hit"), pending.timings.cacheHit);
+    reply(pending.socket, pending.requestId, response);
+}
+
+void OcrDaemon::reply(QLocalSocket *socket, quint32 requestId, const QJsonObject &response)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(OcrProtocol::kStreamVersion);
+    out << requestId << QJsonDocument(response).toJson(QJsonDocument::Compact);
+    socket->write(OcrProtocol::frame(payload));
+}
+
+QJsonObject OcrDaemon::statsObject() const
+{
+    QJsonObject stats;
+    stats.insert(QStringLiteral("uptime_s"), qRound64(m_uptime.elapsed() / 1000.0));
+    stats.insert(QStringLiteral("engines"), m_ocr.engineCount());
+    stats.insert(QStringLiteral("clients"), m_buffers.size());
+    stats.insert(QStringLiteral("connections"), qint64(m_stats.connections));
+    stats.insert(QStringLiteral("requests"), qint64(m_stats.requests));
+    stats.insert(QStringLiteral("inline_images"), qint64(m_stats.inlineImages));
+    stats.insert(QStringLiteral("shared_images"), qint64(m_stats.sharedImages));
+    stats.insert(QStringLiteral("inline_bytes"), m_stats.inlineBytes);
+    stats.insert(QStringLiteral("shared_bytes"), m_stats.sharedBytes);
+    stats.insert(QStringLiteral("errors"), qint64(m_stats.errors));
+    stats.insert(QStringLiteral("completed"), qint64(m_stats.completed));
+    stats.insert(QStringLiteral("pending"), m_ocr.pendingJobs());
+    stats.insert(QStringLiteral("avg_server_ms"),
+                 roundMs(m_stats.completed ? m_stats.totalMs / double(m_stats.completed) : 0.0));
+    stats.insert(QStringLiteral("ocr"), m_ocr.statsReport());
+    return stats;
+}
@@ -0,0 +1,72 @@
+#ifndef OCRDAEMON_H
+#define OCRDAEMON_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonObject>
+#include <QObject>
+#include <QPointer>
+#include <QStringList>
+
+#include "ocrservice.h"
+
+class QLocalServer;
+class QLocalSocket;
+
+// Warm OCR server: `SnipText --daemon [--socket NAME] [--jobs N] [--lang eng]`.
+// Loads the engines once and serves recognition requests from any number of
+// local clients over a QLocalServer (see ocrprotocol.h). Small images arrive
+// inline; large ones are read in place from the client's shared memory
+// segment, so their pixels are never copied onto the socket. Runs on a
+// QCoreApplication like batch mode.
+class OcrDaemon : public QObject
+{
+    Q_OBJECT
+public:
+    static bool isRequested(int argc, char *argv[]);
+    static int run(const QStringList &arguments);
+
+private:
+    struct Pending
+    {
+        QPointer<QLocalSocket> socket;
+        quint32 requestId = 0;
+        bool shared = false;
+        QElapsedTimer timer;
+        OcrJobTimings timings;
+    };
+
+    struct Stats
+    {
+        quint64 connections = 0;
+        quint64 requests = 0;
+        quint64 inlineImages = 0;
+        quint64 sharedImages = 0;
+        quint64 errors = 0;
+        qint64 inlineBytes = 0;
+        qint64 sharedBytes = 0;
+        double totalMs = 0.0;
+        quint64 completed = 0;
+    };
+
+    OcrDaemon(int jobs, QObject *parent = nullptr);
+
+    bool start(const QString &socketName, const QString &dataPath, const QString &language,
+               const QStringList &languages);
+    void onNewConnection();
+    void onReadyRead(QLocalSocket *socket);
+    void handleRequest(QLocalSocket *socket, const QByteArray &payload);
+    void onTextReady(quint64 jobId, const QString &text);
+    void reply(QLocalSocket *socket, quint32 requestId, const QJsonObject &response);
+    QJsonObject statsObject() const;
+
+    OcrService m_ocr;
+    QLocalServer *m_server = nullptr;
+    // Bytes received from each client that do not form a whole frame yet.
+    QHash<QLocalSocket *, QByteArray> m_buffers;
+    QHash<quint64, Pending> m_pending;
+    Stats m_stats;
+    QElapsedTimer m_uptime;
+};
+
+#endif // OCRDAEMON_H
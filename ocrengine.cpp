@@ -0,0 +1,284 @@
+#include "ocrengine.h"
+
+#include "latencytrace.h"
+#include "traineddatastore.h"
+
+#include <tesseract/baseapi.h>
+
+#include <QStringList>
+
+#include <tesseract/publictypes.h>
+#include <tesseract/pageiterator.h>
+
+#include <limits>
+#include <vector>
+
+OcrEngine::OcrEngine() = default;
+
+OcrEngine::~OcrEngine()
+{
+    if (m_api) {
+        m_api->End(); // Release engine resources.
+        delete m_api;
+        m_api = nullptr;
+    }
+}
+
+static tesseract::OcrEngineMode toTesseract(OcrProfile::EngineMode mode)
+{
+    switch (mode) {
+    case OcrProfile::EngineMode::Default:
+        break;
+    case OcrProfile::EngineMode::LstmOnly:
+        return tesseract::OEM_LSTM_ONLY;
+    case OcrProfile::EngineMode::LegacyOnly:
+        return tesseract::OEM_TESSERACT_ONLY;
+    case OcrProfile::EngineMode::Combined:
+        return tesseract::OEM_TESSERACT_LSTM_COMBINED;
+    }
+    return tesseract::OEM_DEFAULT;
+}
+
+static tesseract::PageSegMode toTesseract(OcrProfile::Layout layout)
+{
+    switch (layout) {
+    case OcrProfile::Layout::Auto:
+    case OcrProfile::Layout::Page:
+        break;
+    case OcrProfile::Layout::Block:
+        return tesseract::PSM_SINGLE_BLOCK;
+    case OcrProfile::Layout::Sparse:
+        return tesseract::PSM_SPARSE_TEXT;
+    case OcrProfile::Layout::SingleLine:
+        return tesseract::PSM_SINGLE_LINE;
+    case OcrProfile::Layout::SingleWord:
+        return tesseract::PSM_SINGLE_WORD;
+    }
+    return tesseract::PSM_AUTO;
+}
+
+// Strips page-break leftovers and surrounding whitespace from GetUTF8Text().
+static QString takeUtf8Text(tesseract::TessBaseAPI *api)
+{
+    QString result;
+    if (char *utf8 = api->GetUTF8Text()) {
+        result = QString::fromUtf8(utf8);
+        delete [] utf8;
+        result.remove(QChar::fromLatin1('\f'));
+        result = result.trimmed();
+    }
+    return result;
+}
+
+bool OcrEngine::initialize(const QString &dataPath, const QString &language,
+                           OcrProfile::EngineMode mode)
+{
+    // Re-create the API so we can change languages or recover from failures.
+    if (m_api) {
+        m_api->End();
+        delete m_api;
+        m_api = nullptr;
+    }
+
+    m_mode = mode;
+    m_imageRect = QRect();
+    m_layout = OcrProfile::Layout::Auto;
+    m_whitelist.clear();
+    m_dpi = 0;
+
+    m_api = new tesseract::TessBaseAPI();
+    if (!m_api)
+        return false;
+
+    const QByteArray data = dataPath.toUtf8();
+    const QByteArray lang = language.toUtf8();
+
+    int status = -1;
+#if defined(TESSERACT_MAJOR_VERSION) && TESSERACT_MAJOR_VERSION >= 5
+    // The in-memory init path takes one language blob; combined languages
+    // ("eng+deu") and missing files fall back to loading from tessdata.
+    // Init copies what it needs, so the mapping is only held during the call,
+    // and dropped once no other engine is initializing from it.
+    if (!language.contains(QLatin1Char('+'))) {
+        std::shared_ptr<const TrainedData> trainedData =
+            TrainedDataStore::instance().acquire(dataPath, language);
+        if (trainedData && trainedData->size() <= std::numeric_limits<int>::max()) {
+            status = m_api->Init(trainedData->data(), int(trainedData->size()), lang.constData(),
+                                 toTesseract(mode), nullptr, 0, nullptr, nullptr, false, nullptr);
+        }
+        trainedData.reset();
+        TrainedDataStore::instance().releaseUnused();
+    }
+#endif
+    if (status != 0)
+        status = m_api->Init(data.constData(), lang.constData(), toTesseract(mode));
+
+    if (status != 0) {
+        delete m_api;
+        m_api = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+bool OcrEngine::isReady() const
+{
+    return m_api != nullptr;
+}
+
+void OcrEngine::applyProfile(const OcrProfile &profile, OcrProfile::Layout layout)
+{
+    if (!isReady())
+        return;
+
+    // These are plain engine variables, so switching profiles between two
+    // captures never reloads the model.
+    if (layout != m_layout) {
+        m_api->SetPageSegMode(toTesseract(layout));
+        m_layout = layout;
+    }
+    if (profile.whitelist != m_whitelist) {
+        m_api->SetVariable("tessedit_char_whitelist", profile.whitelist.toUtf8().constData());
+        m_whitelist = profile.whitelist;
+    }
+    if (profile.dpi != m_dpi) {
+        m_api->SetVariable("user_defined_dpi", QByteArray::number(profile.dpi).constData());
+        m_dpi = profile.dpi;
+    }
+}
+
+void OcrEngine::setImage(const GrayImage &gray, const QRect &rect)
+{
+    const QRect area = rect.isNull() ? gray.rect() : rect.intersected(gray.rect());
+    if (!isReady() || area.isEmpty())
+        return;
+
+    LatencyScope scope(LatencyTrace::Stage::SetImage);
+    m_api->SetImage(gray.constScanLine(area.top()) + area.left(),
+                    area.width(),
+                    area.height(),
+                    1,
+                    int(gray.bytesPerLine()));
+    m_imageRect = QRect(QPoint(0, 0), area.size());
+}
+
+QString OcrEngine::recognize(const QRect &rect)
+{
+    if (!isReady())
+        return {};
+
+    LatencyScope scope(LatencyTrace::Stage::Recognize);
+    // SetRectangle also drops the results of the previous rectangle.
+    if (!rect.isNull())
+        m_api->SetRectangle(rect.x(), rect.y(), rect.width(), rect.height());
+
+    const QString result = takeUtf8Text(m_api);
+    m_api->Clear();
+    return result;
+}
+
+QString OcrEngine::recognizeProgressively(const QRect &rect,
+                                          const std::function<void(const QString &)> &onChunk)
+{
+    if (!isReady())
+        return {};
+
+    const QRect area = rect.isNull() ? m_imageRect : rect.intersected(m_imageRect);
+    if (area.isEmpty())
+        return {};
+
+    // A single line or word has nothing to split.
+    if (m_layout == OcrProfile::Layout::SingleLine || m_layout == OcrProfile::Layout::SingleWord)
+        return recognize(rect);
+
+    LatencyScope scope(LatencyTrace::Stage::Recognize);
+
+    // Lines recognized per chunk: enough context for the recognizer, small
+    // enough that text keeps coming in on a full page.
+    constexpr int kLinesPerChunk = 6;
+    constexpr int kPadding = 3;
+
+    struct Chunk
+    {
+        QRect rect;
+        int lines = 0;
+        bool startsBlock = false;
+    };
+    std::vector<Chunk> chunks;
+
+    // Layout analysis only, which is a small part of the full recognition
+    // time. It runs in the layout's own mode, so it finds the same blocks
+    // and lines recognize() would.
+    const tesseract::PageSegMode layoutMode = toTesseract(m_layout);
+    m_api->SetPageSegMode(layoutMode);
+    m_api->SetRectangle(area.x(), area.y(), area.width(), area.height());
+    if (tesseract::PageIterator *it = m_api->AnalyseLayout()) {
+        do {
+            if (!PTIsTextType(it->BlockType()))
+                continue;
+            int left = 0, top = 0, right = 0, bottom = 0;
+            if (!it->BoundingBox(tesseract::RIL_TEXTLINE, &left, &top, &right, &bottom))
+                continue;
+
+            const QRect line = QRect(left, top, right - left, bottom - top)
+                                   .adjusted(-kPadding, -kPadding, kPadding, kPadding)
+                                   .intersected(area);
+            const bool newBlock = it->IsAtBeginningOf(tesseract::RIL_BLOCK);
+            if (chunks.empty() || newBlock || chunks.back().lines >= kLinesPerChunk)
+                chunks.push_back({line, 0, newBlock});
+            else
+                chunks.back().rect |= line;
+            ++chunks.back().lines;
+        } while (it->Next(tesseract::RIL_TEXTLINE));
+        delete it;
+    }
+
+    QString text;
+    if (chunks.empty()) {
+        text = takeUtf8Text(m_api);
+    } else {
+        // Each chunk is a run of lines from one block; sparse text stays
+        // sparse so scattered words are not forced into lines.
+        m_api->SetPageSegMode(layoutMode == tesseract::PSM_SPARSE_TEXT ? tesseract::PSM_SPARSE_TEXT
+                                                                       : tesseract::PSM_SINGLE_BLOCK);
+        for (const Chunk &chunk : chunks) {
+            m_api->SetRectangle(chunk.rect.x(), chunk.rect.y(), chunk.rect.width(), chunk.rect.height());
+            const QString part = takeUtf8Text(m_api);
+            if (part.isEmpty())
+                continue;
+            if (!text.isEmpty())
+                text += chunk.startsBlock ? QStringLiteral("\n\n") : QStringLiteral("\n");
+            text += part;
+            if (onChunk)
+                onChunk(text);
+        }
+        m_api->SetPageSegMode(layoutMode);
+    }
+
+    m_api->Clear();
+    return text;
+}
+
+bool OcrEngine::detectScript(const QRect &rect, QString *script, float *confidence)
+{
+    if (!isReady())
+        return false;
+
+    if (!rect.isNull())
+        m_api->SetRectangle(rect.x(), rect.y(), rect.width(), rect.height());
+
+    int orientation = 0;
+    float orientationConfidence = 0.0f;
+    const char *scriptName = nullptr;
+    float scriptConfidence = 0.0f;
+    const bool ok = m_api->DetectOrientationScript(&orientation, &orientationConfidence,
+                                                   &scriptName, &scriptConfidence);
+    if (ok && scriptName) {
+        *script = QString::fromLatin1(scriptName);
+        *confidence = scriptConfidence;
+    }
+
+    m_api->Clear();
+    return ok && scriptName;
+}
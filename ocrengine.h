@@ -0,0 +1,68 @@
+#ifndef OCRENGINE_H
+#define OCRENGINE_H
+
+#include "grayimage.h"
+#include "ocrprofile.h"
+
+#include <QRect>
+#include <QString>
+
+#include <functional>
+
+namespace tesseract {
+class TessBaseAPI;
+}
+
+// Thin RAII wrapper around a single TessBaseAPI instance. An engine is not
+// thread-safe: it must only be used by one thread at a time.
+class OcrEngine
+{
+public:
+    OcrEngine();
+    ~OcrEngine();
+
+    // (Re)initialize the engine with the given tessdata path and language.
+    // Single languages are initialized from a memory map of the traineddata
+    // file (TrainedDataStore); Tesseract copies the model out of it, so the
+    // map is released again before this returns.
+    bool initialize(const QString &dataPath, const QString &language,
+                    OcrProfile::EngineMode mode = OcrProfile::EngineMode::Default);
+    bool isReady() const;
+    OcrProfile::EngineMode engineMode() const { return m_mode; }
+    // Applies the per-capture settings of profile (page segmentation for
+    // layout, whitelist, DPI hint) to the loaded engine. Only settings that
+    // differ from the previous call are pushed to Tesseract.
+    void applyProfile(const OcrProfile &profile, OcrProfile::Layout layout);
+    // Hands rect of gray (null means all of it) to Tesseract, which copies
+    // those pixels, for the next recognize(), recognizeProgressively() or
+    // detectScript() call. Coordinates then start at the rect's corner.
+    void setImage(const GrayImage &gray, const QRect &rect = QRect());
+    // Recognizes rect of the current image (null means all of it); Tesseract
+    // thresholds only that rectangle. The image is dropped afterwards.
+    QString recognize(const QRect &rect = QRect());
+    // Progressive variant of recognize(): a quick layout pass in the mode set
+    // by applyProfile() finds the text lines of rect, which are then
+    // recognized in reading order a few lines at a time. onChunk receives the
+    // text recognized so far after each chunk. Returns the whole text. Single
+    // line and word layouts are recognized in one go.
+    QString recognizeProgressively(const QRect &rect,
+                                   const std::function<void(const QString &)> &onChunk);
+    // Orientation and script detection on rect of the current image (null
+    // means all of it); needs an engine loaded with the "osd" language.
+    // script receives Tesseract's script name, e.g. "Latin" or "Cyrillic".
+    bool detectScript(const QRect &rect, QString *script, float *confidence);
+
+private:
+    Q_DISABLE_COPY(OcrEngine)
+
+    tesseract::TessBaseAPI *m_api = nullptr;
+    OcrProfile::EngineMode m_mode = OcrProfile::EngineMode::Default;
+    QRect m_imageRect;
+
+    // Settings last pushed by applyProfile(); a layout of Auto means none yet.
+    OcrProfile::Layout m_layout = OcrProfile::Layout::Auto;
+    QString m_whitelist;
+    int m_dpi = 0;
+};
+
+#endif // OCRENGINE_H
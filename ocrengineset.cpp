@@ -0,0 +1,198 @@
+#include "ocrengineset.h"
+
+#include "grayimage.h"
+#include "ocrengine.h"
+
+namespace {
+
+// The script detector has its own slot; no engine mode is negative.
+constexpr int kDetectorMode = -1;
+
+// Tesseract reports about 1 and above for a clear script; below that the
+// capture is usually too short to tell, and the primary language is safer.
+constexpr float kMinScriptConfidence = 1.0f;
+
+// Detection samples blobs, so a slice of a large capture is as good as all of
+// it at a fraction of the cost.
+constexpr qint64 kMaxDetectPixels = 1024 * 512;
+
+// The most common tessdata languages of each script OSD tells apart.
+// "Japanese" and "Korean" are Han mixed with kana or Hangul.
+struct ScriptLanguages
+{
+    const char *script;
+    const char *languages;
+};
+const ScriptLanguages kScripts[] = {
+    {"Latin", "eng deu fra spa ita por nld pol ces slk swe dan nor fin hun ron tur vie ind cat hrv slv "
+              "est lav lit"},
+    {"Cyrillic", "rus ukr bel bul srp mkd kaz"},
+    {"Greek", "ell"},
+    {"Arabic", "ara fas urd"},
+    {"Hebrew", "heb"},
+    {"Han", "chi_sim chi_tra"},
+    {"Japanese", "jpn"},
+    {"Katakana", "jpn"},
+    {"Hiragana", "jpn"},
+    {"Korean", "kor"},
+    {"Hangul", "kor"},
+    {"Devanagari", "hin mar nep san"},
+    {"Bengali", "ben"},
+    {"Thai", "tha"},
+    {"Tamil", "tam"},
+    {"Telugu", "tel"},
+    {"Georgian", "kat"},
+    {"Armenian", "hye"},
+};
+
+} // namespace
+
+OcrEngineSet::OcrEngineSet()
+{
+    m_clock.start();
+}
+
+OcrEngineSet::~OcrEngineSet() = default;
+
+bool OcrEngineSet::load(const QString &dataPath, const QString &language)
+{
+    m_slots.clear();
+    m_dataPath = dataPath;
+    m_language = language;
+    return engine(language, OcrProfile::EngineMode::Default) != nullptr;
+}
+
+OcrEngine *OcrEngineSet::primary() const
+{
+    const auto it = m_slots.find({m_language, int(OcrProfile::EngineMode::Default)});
+    return it != m_slots.end() ? it->second.engine.get() : nullptr;
+}
+
+OcrEngineSet::Slot &OcrEngineSet::slot(const QString &language, OcrProfile::EngineMode mode)
+{
+    return m_slots[{language, int(mode)}];
+}
+
+OcrEngine *OcrEngineSet::engine(const QString &language, OcrProfile::EngineMode mode)
+{
+    const QString name = language.isEmpty() ? m_language : language;
+    Slot &entry = slot(name, mode);
+    if (!entry.engine && !entry.failed) {
+        auto loaded = std::make_unique<OcrEngine>();
+        if (loaded->initialize(m_dataPath, name, mode))
+            entry.engine = std::move(loaded);
+        else
+            entry.failed = true;
+    }
+    if (entry.engine) {
+        entry.lastUsedMs = m_clock.elapsed();
+        return entry.engine.get();
+    }
+
+    if (mode != OcrProfile::EngineMode::Default)
+        return engine(name, OcrProfile::EngineMode::Default);
+    if (name != m_language)
+        return engine(m_language, OcrProfile::EngineMode::Default);
+    return nullptr;
+}
+
+QString OcrEngineSet::detectLanguage(const GrayImage &gray, const QRect &rect, const QStringList &candidates,
+                                     QString *script)
+{
+    if (candidates.size() < 2)
+        return {};
+
+    QRect area = rect.isNull() ? gray.rect() : rect.intersected(gray.rect());
+    if (area.width() < 32 || area.height() < 16)
+        return {};
+    if (qint64(area.width()) * area.height() > kMaxDetectPixels)
+        area.setHeight(int(qMax<qint64>(16, kMaxDetectPixels / area.width())));
+
+    Slot &entry = m_slots[{QStringLiteral("osd"), kDetectorMode}];
+    if (!entry.engine && !entry.failed) {
+        auto detector = std::make_unique<OcrEngine>();
+        if (detector->initialize(m_dataPath, QStringLiteral("osd")))
+            entry.engine = std::move(detector);
+        else
+            entry.failed = true;
+    }
+    if (!entry.engine)
+        return {};
+    entry.lastUsedMs = m_clock.elapsed();
+
+    QString detected;
+    float confidence = 0.0f;
+    // Only the area that is analysed is handed to the detector.
+    entry.engine->setImage(gray, area);
+    if (!entry.engine->detectScript(QRect(), &detected, &confidence) || confidence < kMinScriptConfidence)
+        return {};
+    if (script)
+        *script = detected;
+
+    const QStringList languages = languagesForScript(detected);
+    for (const QString &candidate : candidates) {
+        if (languages.contains(candidate))
+            return candidate;
+    }
+    return {};
+}
+
+QStringList OcrEngineSet::languagesForScript(const QString &script)
+{
+    QStringList languages;
+    for (const ScriptLanguages &entry : kScripts) {
+        if (script == QLatin1String(entry.script))
+            languages += QString::fromLatin1(entry.languages).split(QLatin1Char(' '));
+    }
+    return languages;
+}
+
+QString OcrEngineSet::scriptForLanguage(const QString &language)
+{
+    for (const ScriptLanguages &entry : kScripts) {
+        if (QString::fromLatin1(entry.languages).split(QLatin1Char(' ')).contains(language))
+            return QString::fromLatin1(entry.script);
+    }
+    return {};
+}
+
+int OcrEngineSet::unloadIdle()
+{
+    const qint64 now = m_clock.elapsed();
+    const auto primaryKey = std::make_pair(m_language, int(OcrProfile::EngineMode::Default));
+    int unloaded = 0;
+    for (auto it = m_slots.begin(); it != m_slots.end();) {
+        if (it->first != primaryKey && it->second.engine && now - it->second.lastUsedMs >= kIdleUnloadMs) {
+            it = m_slots.erase(it);
+            ++unloaded;
+        } else {
+            ++it;
+        }
+    }
+    return unloaded;
+}
+
+qint64 OcrEngineSet::msUntilUnload() const
+{
+    const qint64 now = m_clock.elapsed();
+    const auto primaryKey = std::make_pair(m_language, int(OcrProfile::EngineMode::Default));
+    qint64 next = -1;
+    for (const auto &entry : m_slots) {
+        if (entry.first == primaryKey || !entry.second.engine)
+            continue;
+        const qint64 remaining = qMax<qint64>(0, entry.second.lastUsedMs + kIdleUnloadMs - now);
+        if (next < 0 || remaining < next)
+            next = remaining;
+    }
+    return next;
+}
+
+QList<OcrEngine *> OcrEngineSet::engines() const
+{
+    QList<OcrEngine *> loaded;
+    for (const auto &entry : m_slots) {
+        if (entry.second.engine)
+            loaded.append(entry.second.engine.get());
+    }
+    return loaded;
+}
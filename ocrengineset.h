@@ -0,0 +1,81 @@
+#ifndef OCRENGINESET_H
+#define OCRENGINESET_H
+
+#include "ocrprofile.h"
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QRect>
+#include <QString>
+#include <QStringList>
+
+#include <map>
+#include <memory>
+
+class GrayImage;
+class OcrEngine;
+
+// The engines one OcrService worker owns: one per language and engine mode.
+// The primary language is loaded up front; every other language, engine mode
+// and the script detector load on first use, and engines other than the
+// primary one are unloaded again after sitting idle. Like OcrEngine, a set is
+// only ever used by one thread.
+class OcrEngineSet
+{
+public:
+    OcrEngineSet();
+    ~OcrEngineSet();
+
+    // Drops every engine and loads the primary one for dataPath/language.
+    bool load(const QString &dataPath, const QString &language);
+    OcrEngine *primary() const;
+    QString primaryLanguage() const { return m_language; }
+
+    // The engine for language and mode, loaded on first use. A mode the
+    // traineddata has no model for falls back to the language's default
+    // engine, and a language that fails to load to the primary engine.
+    OcrEngine *engine(const QString &language, OcrProfile::EngineMode mode);
+
+    // Runs Tesseract's orientation and script detection on rect of gray and
+    // returns the first of candidates written in the detected script. Empty
+    // when osd.traineddata is missing, the script is uncertain or no
+    // candidate matches. Languages sharing a script (eng, deu, fra) cannot be
+    // told apart: the earlier candidate always wins.
+    QString detectLanguage(const GrayImage &gray, const QRect &rect, const QStringList &candidates,
+                           QString *script = nullptr);
+    // Tesseract's language codes written in script (an OSD script name).
+    static QStringList languagesForScript(const QString &script);
+    // The OSD script name of language; empty for languages not in the table.
+    static QString scriptForLanguage(const QString &language);
+
+    // Unloads non-primary engines idle for longer than kIdleUnloadMs. Returns
+    // the number unloaded.
+    int unloadIdle();
+    // Milliseconds until unloadIdle() has something to do; -1 for never.
+    qint64 msUntilUnload() const;
+
+    // Every loaded engine, including the script detector.
+    QList<OcrEngine *> engines() const;
+
+private:
+    Q_DISABLE_COPY(OcrEngineSet)
+
+    static constexpr qint64 kIdleUnloadMs = 5 * 60 * 1000;
+
+    struct Slot
+    {
+        std::unique_ptr<OcrEngine> engine;
+        bool failed = false;
+        qint64 lastUsedMs = 0;
+    };
+
+    Slot &slot(const QString &language, OcrProfile::EngineMode mode);
+
+    QString m_dataPath;
+    QString m_language;
+    // Keyed by language and engine mode; the script detector is "osd".
+    std::map<std::pair<QString, int>, Slot> m_slots;
+    QElapsedTimer m_clock;
+};
+
+#endif // OCRENGINESET_H
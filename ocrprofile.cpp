@@ -0,0 +1,202 @@
+#include "ocrprofile.h"
+
+#include "grayimage.h"
+#include "imagekernels.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+struct Run
+{
+    int begin = 0;
+    int end = 0; // exclusive
+    int length() const { return end - begin; }
+};
+
+// Runs of entries with at least minCount ink pixels; gaps of up to maxGap
+// entries (the dot of an "i", a broken glyph) do not split a run.
+std::vector<Run> inkRuns(const std::vector<quint32> &counts, quint32 minCount, int maxGap)
+{
+    std::vector<Run> runs;
+    const int n = int(counts.size());
+    for (int i = 0; i < n; ++i) {
+        if (counts[size_t(i)] < minCount)
+            continue;
+        if (!runs.empty() && i - runs.back().end <= maxGap)
+            runs.back().end = i + 1;
+        else
+            runs.push_back({i, i + 1});
+    }
+    return runs;
+}
+
+int medianLength(const std::vector<Run> &runs)
+{
+    std::vector<int> lengths;
+    lengths.reserve(runs.size());
+    for (const Run &run : runs)
+        lengths.push_back(run.length());
+    std::nth_element(lengths.begin(), lengths.begin() + lengths.size() / 2, lengths.end());
+    return lengths[lengths.size() / 2];
+}
+
+// Turns counts of dark pixels into counts of ink when the text is light.
+void flip(std::vector<quint32> &counts, quint32 total)
+{
+    for (quint32 &count : counts)
+        count = total - count;
+}
+
+} // namespace
+
+QList<OcrProfile> OcrProfile::builtinProfiles()
+{
+    QList<OcrProfile> profiles;
+    auto add = [&profiles](const QString &name, Layout layout, const QString &whitelist = QString()) {
+        OcrProfile profile;
+        profile.name = name;
+        profile.layout = layout;
+        profile.whitelist = whitelist;
+        profiles.append(profile);
+    };
+    add(QStringLiteral("Automatic"), Layout::Auto);
+    add(QStringLiteral("Full Page"), Layout::Page);
+    add(QStringLiteral("Text Block"), Layout::Block);
+    add(QStringLiteral("Single Line"), Layout::SingleLine);
+    add(QStringLiteral("Single Word"), Layout::SingleWord);
+    add(QStringLiteral("Numbers"), Layout::Auto, QStringLiteral("0123456789.,:;+-*/=%()$"));
+    return profiles;
+}
+
+QString OcrProfile::layoutName(Layout layout)
+{
+    switch (layout) {
+    case Layout::Auto:
+        return QStringLiteral("auto");
+    case Layout::Page:
+        return QStringLiteral("page");
+    case Layout::Block:
+        return QStringLiteral("block");
+    case Layout::Sparse:
+        return QStringLiteral("sparse");
+    case Layout::SingleLine:
+        return QStringLiteral("line");
+    case Layout::SingleWord:
+        return QStringLiteral("word");
+    }
+    return {};
+}
+
+OcrProfile::Layout OcrProfile::layoutFromName(const QString &name, Layout fallback)
+{
+    const Layout layouts[] = {Layout::Auto, Layout::Page, Layout::Block,
+                              Layout::Sparse, Layout::SingleLine, Layout::SingleWord};
+    for (const Layout layout : layouts) {
+        if (name.compare(layoutName(layout), Qt::CaseInsensitive) == 0)
+            return layout;
+    }
+    return fallback;
+}
+
+QString OcrProfile::engineModeName(EngineMode mode)
+{
+    switch (mode) {
+    case EngineMode::Default:
+        return QStringLiteral("default");
+    case EngineMode::LstmOnly:
+        return QStringLiteral("lstm");
+    case EngineMode::LegacyOnly:
+        return QStringLiteral("legacy");
+    case EngineMode::Combined:
+        return QStringLiteral("combined");
+    }
+    return {};
+}
+
+OcrProfile::EngineMode OcrProfile::engineModeFromName(const QString &name, EngineMode fallback)
+{
+    const EngineMode modes[] = {EngineMode::Default, EngineMode::LstmOnly,
+                                EngineMode::LegacyOnly, EngineMode::Combined};
+    for (const EngineMode mode : modes) {
+        if (name.compare(engineModeName(mode), Qt::CaseInsensitive) == 0)
+            return mode;
+    }
+    return fallback;
+}
+
+OcrProfile::Layout OcrProfile::detectLayout(const GrayImage &gray, const QRect &rect)
+{
+    const QRect area = rect.isNull() ? gray.rect() : rect.intersected(gray.rect());
+    if (area.isEmpty())
+        return Layout::Block;
+
+    const int width = area.width();
+    const int height = area.height();
+    const qsizetype stride = gray.bytesPerLine();
+    const uchar *origin = gray.constScanLine(area.top()) + area.left();
+
+    quint32 hist[256];
+    ImageKernels::histogram(origin, stride, width, height, hist);
+    const int threshold = ImageKernels::otsuThreshold(hist);
+
+    std::vector<quint32> rows(size_t(height));
+    std::vector<quint32> cols(size_t(width));
+    ImageKernels::inkProjection(origin, stride, width, height, threshold, rows.data(), cols.data());
+
+    // Ink is whichever class is the minority, so this works before and after
+    // the polarity fix.
+    quint64 dark = 0;
+    for (const quint32 count : rows)
+        dark += count;
+    const quint64 total = quint64(width) * quint64(height);
+    if (dark == 0 || dark == total)
+        return Layout::Block;
+    if (dark * 2 > total) {
+        flip(rows, quint32(width));
+        flip(cols, quint32(height));
+    }
+
+    // Text bands from the row projection; a few stray pixels do not count.
+    std::vector<Run> bands = inkRuns(rows, qMax<quint32>(1, quint32(width / 400)), 2);
+    if (bands.empty())
+        return Layout::Block;
+    const int tallest = std::max_element(bands.begin(), bands.end(), [](const Run &a, const Run &b) {
+        return a.length() < b.length();
+    })->length();
+    bands.erase(std::remove_if(bands.begin(), bands.end(), [tallest](const Run &band) {
+                    return band.length() < qMax(3, tallest / 4);
+                }),
+                bands.end());
+    if (bands.empty())
+        return Layout::Block;
+
+    if (bands.size() == 1) {
+        // Word spaces are roughly a quarter of the line height; gaps between
+        // letters are much narrower.
+        const Run band = bands.front();
+        std::vector<quint32> bandCols(size_t(width));
+        ImageKernels::inkProjection(origin + band.begin * stride, stride, width,
+                                    band.length(), threshold, nullptr, bandCols.data());
+        if (dark * 2 > total)
+            flip(bandCols, quint32(band.length()));
+        const std::vector<Run> glyphs = inkRuns(bandCols, 1, qMax(1, band.length() / 4));
+        return glyphs.size() > 1 ? Layout::SingleLine : Layout::SingleWord;
+    }
+
+    const int lineHeight = medianLength(bands);
+
+    // A blank vertical gutter between inked columns means several columns.
+    const std::vector<Run> columns = inkRuns(cols, 1, 2 * lineHeight);
+    if (columns.size() > 1)
+        return Layout::Page;
+
+    std::vector<Run> gaps;
+    for (size_t i = 1; i < bands.size(); ++i)
+        gaps.push_back({bands[i - 1].end, bands[i].begin});
+    if (medianLength(gaps) > 2 * lineHeight)
+        return Layout::Sparse;
+
+    return Layout::Block;
+}
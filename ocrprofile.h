@@ -0,0 +1,55 @@
+#ifndef OCRPROFILE_H
+#define OCRPROFILE_H
+
+#include <QList>
+#include <QRect>
+#include <QString>
+
+class GrayImage;
+
+// How Tesseract is run on one capture. The layout picks the page
+// segmentation mode; everything else is applied to the engine per job, except
+// the engine mode, which selects a separately loaded engine.
+struct OcrProfile
+{
+    enum class Layout {
+        Auto,       // picked per capture from the selection geometry
+        Page,       // fully automatic page segmentation
+        Block,      // one uniform block of text
+        Sparse,     // scattered text in no particular order
+        SingleLine,
+        SingleWord
+    };
+
+    enum class EngineMode {
+        Default,
+        LstmOnly,
+        LegacyOnly, // needs traineddata with the legacy model
+        Combined
+    };
+
+    QString name;
+    Layout layout = Layout::Auto;
+    EngineMode engineMode = EngineMode::Default;
+    // Characters Tesseract may output; empty allows all.
+    QString whitelist;
+    // Resolution hint for captures without one; 0 lets Tesseract guess.
+    int dpi = 0;
+
+    // The profiles shipped with the app; the first one is the default.
+    static QList<OcrProfile> builtinProfiles();
+
+    static QString layoutName(Layout layout);
+    static Layout layoutFromName(const QString &name, Layout fallback = Layout::Auto);
+    static QString engineModeName(EngineMode mode);
+    static EngineMode engineModeFromName(const QString &name, EngineMode fallback = EngineMode::Default);
+
+    // Guesses the layout of a (preprocessed) capture from its ink projections:
+    // one text band is a line, or a word when it has no word gaps; several
+    // bands are a block, a page when a blank gutter splits them into columns,
+    // or sparse text when they cover little of the selection. A null rect
+    // looks at the whole image.
+    static Layout detectLayout(const GrayImage &gray, const QRect &rect = QRect());
+};
+
+#endif // OCRPROFILE_H
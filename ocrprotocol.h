@@ -0,0 +1,69 @@
+#ifndef OCRPROTOCOL_H
+#define OCRPROTOCOL_H
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QString>
+#include <QtEndian>
+
+// Wire format between `SnipText --daemon` and its clients over a local socket.
+// Every message is a frame: a big-endian u32 length followed by that many
+// bytes, serialized with QDataStream.
+//
+// Request:  u32 requestId, u8 kind, then for Inline and Shared images
+//           i32 width, height, bytesPerLine, QImage::Format, and either the
+//           pixels as a QByteArray (Inline) or the QSharedMemory key holding
+//           them as a QString (Shared). Stats carries nothing more.
+// Response: u32 requestId, QByteArray with a compact JSON object.
+//
+// Requests may be pipelined; responses come back as jobs finish, not in
+// request order. A shared segment must stay alive until its response arrives.
+namespace OcrProtocol {
+
+enum class Kind : quint8 {
+    Inline = 1,
+    Shared = 2,
+    Stats = 3
+};
+
+constexpr QDataStream::Version kStreamVersion = QDataStream::Qt_5_12;
+// Larger frames are a protocol error; big images go through shared memory.
+constexpr quint32 kMaxFrameBytes = 64 * 1024 * 1024;
+// Clients send images up to this size inline by default.
+constexpr qint64 kDefaultInlineBytes = 256 * 1024;
+
+inline QString defaultSocketName()
+{
+    return QStringLiteral("sniptext-ocr");
+}
+
+inline QByteArray frame(const QByteArray &payload)
+{
+    QByteArray out(4, Qt::Uninitialized);
+    qToBigEndian<quint32>(quint32(payload.size()), out.data());
+    out += payload;
+    return out;
+}
+
+// Moves the first complete frame out of buffer into payload. Returns false
+// while the frame is incomplete; *error is set when its length is invalid.
+inline bool takeFrame(QByteArray *buffer, QByteArray *payload, bool *error)
+{
+    *error = false;
+    if (buffer->size() < 4)
+        return false;
+    const quint32 size = qFromBigEndian<quint32>(buffer->constData());
+    if (size > kMaxFrameBytes) {
+        *error = true;
+        return false;
+    }
+    if (quint32(buffer->size()) - 4 < size)
+        return false;
+    *payload = buffer->mid(4, int(size));
+    buffer->remove(0, int(size) + 4);
+    return true;
+}
+
+} // namespace OcrProtocol
+
+#endif // OCRPROTOCOL_H
@@ -1,75 +1,1006 @@
 #include "ocrservice.h"
 
-#include <QImage>
+#include "grayimage.h"
+#include "hashing.h"
+#include "latencytrace.h"
+#include "ocrengine.h"
+#include "ocrengineset.h"
+#include "textbands.h"
 
-#include <tesseract/baseapi.h>
+#include <QDeadlineTimer>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QStringList>
+#include <QThread>
 
-OcrService::OcrService() = default;
+#include <utility>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+// Bands are cut no shorter than this, so each one still holds a few lines
+// and the per-call overhead of Tesseract stays small against the work.
+constexpr int kMinBandHeight = 160;
+
+bool isTextBody(OcrProfile::Layout layout)
+{
+    return layout == OcrProfile::Layout::Page
+        || layout == OcrProfile::Layout::Block
+        || layout == OcrProfile::Layout::Sparse;
+}
+
+} // namespace
+
+struct OcrService::Snapshot
+{
+    quint64 id = 0;
+    QMutex mutex;
+    // Color pixels, dropped as soon as they are converted.
+    QImage frame;
+    GrayImage gray;
+    bool converted = false;
+
+    // Converts on first use; concurrent callers wait for the first one. The
+    // result never changes afterwards, so it is read without the lock.
+    const GrayImage &grayImage()
+    {
+        QMutexLocker locker(&mutex);
+        if (!converted) {
+            gray.loadFrom(frame, QRect());
+            frame = QImage();
+            converted = true;
+        }
+        return gray;
+    }
+};
+
+struct OcrService::BandGroup
+{
+    OcrProfile profile;
+    OcrProfile::Layout layout = OcrProfile::Layout::Block;
+    // Picked by script detection; empty for the initialized language.
+    QString language;
+    bool streaming = false;
+
+    // Pixels the bands are cut from: the worker's preprocessed buffer moved
+    // into owned. Each band hands only its own rows to an engine.
+    GrayImage owned;
+    const GrayImage *pixels = nullptr;
+    QList<TextBands::Band> bands;
+
+    // Guarded by OcrService::m_mutex.
+    std::vector<QString> texts;
+    std::vector<bool> done;
+    int remaining = 0;
+    // Leading bands already reported through partialText().
+    int streamed = 0;
+    // Set when a band ran on a worker without an engine.
+    bool failed = false;
+    // Sum of the bands' recognition times, queue waits excluded.
+    double recognizeMs = 0.0;
+
+    // Reported with the job once the last band is done.
+    bool cacheResult = false;
+    OcrCache::Key key;
+    double convertMs = 0.0;
+    PreprocessTimings timings;
+    double detectMs = 0.0;
+    double scriptMs = 0.0;
+    QString script;
+    double scale = 1.0;
+    double megapixels = 0.0;
+
+    // Text of the first count bands in reading order.
+    QString join(int count) const
+    {
+        QString text;
+        for (int band = 0; band < count; ++band) {
+            const QString &part = texts[size_t(band)];
+            if (part.isEmpty())
+                continue;
+            if (!text.isEmpty())
+                text += bands.at(band).startsParagraph ? QStringLiteral("\n\n") : QStringLiteral("\n");
+            text += part;
+        }
+        return text;
+    }
+};
+
+OcrService::OcrService(int engineCount, QObject *parent)
+    : QObject(parent)
+{
+    qRegisterMetaType<OcrJobTimings>();
+
+    if (engineCount <= 0)
+        engineCount = qMax(1, QThread::idealThreadCount());
+
+    for (int i = 0; i < engineCount; ++i) {
+        QThread *thread = QThread::create([this]() { workerLoop(); });
+        thread->setObjectName(QStringLiteral("OcrWorker%1").arg(i));
+        m_threads.append(thread);
+    }
+    for (QThread *thread : std::as_const(m_threads))
+        thread->start();
+}
 
 OcrService::~OcrService()
 {
-    if (m_api) {
-        m_api->End(); // Release engine resources.
-        delete m_api;
-        m_api = nullptr;
+    QList<QThread *> builders;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_jobs.clear();
+        m_wakeUp.wakeAll();
+        builders = m_builders;
+        m_builders.clear();
+    }
+    for (QThread *thread : std::as_const(m_threads)) {
+        thread->wait();
+        delete thread;
+    }
+    m_threads.clear();
+    for (QThread *builder : std::as_const(builders)) {
+        builder->wait();
+        delete builder;
+    }
+}
+
+void OcrService::initializeAsync(const QString &dataPath, const QString &language)
+{
+    std::vector<std::unique_ptr<OcrEngineSet>> superseded;
+    QList<QThread *> finished;
+    {
+        QMutexLocker locker(&m_mutex);
+        ++m_generation;
+        m_initTimer.start();
+        superseded.swap(m_builtSets);
+        for (QThread *builder : std::as_const(m_builders)) {
+            if (builder->isFinished())
+                finished.append(builder);
+        }
+        for (QThread *builder : std::as_const(finished))
+            m_builders.removeOne(builder);
+
+        if (m_state != State::Ready) {
+            // Nothing is in service yet, so the workers load the engines
+            // themselves, all in parallel.
+            m_dataPath = dataPath;
+            m_language = language;
+            m_activeGeneration = m_generation;
+            m_buildsPending = 0;
+            m_loadFailures = 0;
+            m_state = State::Initializing;
+            m_wakeUp.wakeAll();
+        } else {
+            // Hot swap: the current engines keep serving while one new set
+            // per worker loads at low priority.
+            m_pendingDataPath = dataPath;
+            m_pendingLanguage = language;
+            m_buildsPending = int(m_threads.size());
+            m_buildFailed = false;
+            const quint64 generation = m_generation;
+            for (int i = 0; i < m_threads.size(); ++i) {
+                QThread *builder = QThread::create([this, generation, dataPath, language]() {
+                    buildEngineSet(generation, dataPath, language);
+                });
+                builder->setObjectName(QStringLiteral("OcrBuilder%1").arg(i));
+                m_builders.append(builder);
+                builder->start(QThread::LowPriority);
+            }
+        }
+    }
+    // Engines and finished threads go away outside the lock.
+    superseded.clear();
+    for (QThread *builder : std::as_const(finished)) {
+        builder->wait();
+        delete builder;
+    }
+}
+
+void OcrService::buildEngineSet(quint64 generation, const QString &dataPath, const QString &language)
+{
+    auto set = std::make_unique<OcrEngineSet>();
+    const bool ok = set->load(dataPath, language);
+
+    bool report = false;
+    bool swapped = false;
+    double elapsedMs = 0.0;
+    std::vector<std::unique_ptr<OcrEngineSet>> discarded;
+    {
+        QMutexLocker locker(&m_mutex);
+        // A newer configuration was requested meanwhile.
+        if (m_stopping || generation != m_generation)
+            return;
+
+        if (ok)
+            m_builtSets.push_back(std::move(set));
+        else
+            m_buildFailed = true;
+        if (--m_buildsPending > 0)
+            return;
+
+        elapsedMs = m_initTimer.nsecsElapsed() / 1e6;
+        report = true;
+        swapped = !m_buildFailed;
+        m_lastInitOk = swapped;
+        if (m_buildFailed) {
+            discarded.swap(m_builtSets);
+        } else {
+            // The swap itself: workers adopt a set between two jobs.
+            m_dataPath = m_pendingDataPath;
+            m_language = m_pendingLanguage;
+            m_readySets.swap(m_builtSets);
+            discarded.swap(m_builtSets);
+            m_activeGeneration = generation;
+            ++m_swaps;
+            m_swapMs += elapsedMs;
+            m_wakeUp.wakeAll();
+        }
+        m_initDone.wakeAll();
     }
+    discarded.clear();
+    if (report)
+        emit initialized(swapped, elapsedMs);
 }
 
 bool OcrService::initialize(const QString &dataPath, const QString &language)
 {
-    // Re-create the API so we can change languages or recover from failures.
-    if (m_api) {
-        m_api->End();
-        delete m_api;
-        m_api = nullptr;
+    initializeAsync(dataPath, language);
+    return waitForInitialized();
+}
+
+bool OcrService::waitForInitialized(int timeoutMs)
+{
+    QDeadlineTimer deadline(timeoutMs < 0 ? QDeadlineTimer(QDeadlineTimer::Forever)
+                                          : QDeadlineTimer(timeoutMs));
+    QMutexLocker locker(&m_mutex);
+    while (m_state == State::Initializing || m_buildsPending > 0) {
+        if (!m_initDone.wait(&m_mutex, deadline))
+            break;
     }
+    return m_state == State::Ready && m_lastInitOk;
+}
 
-    m_api = new tesseract::TessBaseAPI();
-    if (!m_api)
-        return false;
+bool OcrService::isSwapping() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_buildsPending > 0;
+}
 
-    const QByteArray data = dataPath.toUtf8();
-    const QByteArray lang = language.toUtf8();
-    if (m_api->Init(data.constData(), lang.constData()) != 0) {
-        delete m_api;
-        m_api = nullptr;
-        return false;
+QString OcrService::language() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_language;
+}
+
+void OcrService::setLanguages(const QStringList &languages)
+{
+    QMutexLocker locker(&m_mutex);
+    m_languages = languages;
+}
+
+QStringList OcrService::languages() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_languages;
+}
+
+QStringList OcrService::installedLanguages(const QString &dataPath)
+{
+    QStringList languages;
+    const QStringList files = QDir(dataPath).entryList({QStringLiteral("*.traineddata")}, QDir::Files,
+                                                       QDir::Name);
+    for (const QString &file : files) {
+        const QString language = file.chopped(int(qstrlen(".traineddata")));
+        if (language != QLatin1String("osd") && language != QLatin1String("equ"))
+            languages.append(language);
+    }
+    return languages;
+}
+
+QStringList OcrService::detectionLanguages(const QString &primary, const QStringList &languages)
+{
+    // Detection only tells scripts apart, so it is worth its cost only when
+    // some candidate is written in another script than the main language.
+    const QString primaryScript = OcrEngineSet::scriptForLanguage(primary);
+    QStringList candidates{primary};
+    bool otherScript = false;
+    for (const QString &language : languages) {
+        if (language.isEmpty() || candidates.contains(language))
+            continue;
+        candidates.append(language);
+        otherScript = otherScript || OcrEngineSet::scriptForLanguage(language) != primaryScript;
+    }
+    return otherScript ? candidates : QStringList();
+}
+
+OcrService::State OcrService::state() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_state;
+}
+
+bool OcrService::acceptsJobs() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_state == State::Initializing || m_state == State::Ready;
+}
+
+quint64 OcrService::submit(const QImage &image, const QRect &rect)
+{
+    QMutexLocker locker(&m_mutex);
+    Job job;
+    job.id = m_nextJobId++;
+    job.image = image;
+    job.rect = rect;
+    job.preprocess = m_preprocess;
+    job.profile = m_profile;
+    job.languages = m_languages;
+    job.streaming = m_streaming;
+    job.useCache = m_cacheEnabled;
+    m_jobs.enqueue(job);
+    m_wakeUp.wakeOne();
+    return job.id;
+}
+
+quint64 OcrService::registerSnapshot(const QImage &frame)
+{
+    if (frame.isNull())
+        return 0;
+
+    auto snapshot = std::make_shared<Snapshot>();
+    snapshot->frame = frame;
+
+    QMutexLocker locker(&m_mutex);
+    snapshot->id = m_nextSnapshotId++;
+    m_snapshots.insert(snapshot->id, snapshot);
+
+    Job job;
+    job.snapshot = snapshot;
+    job.prepareOnly = true;
+    m_jobs.enqueue(job);
+    m_wakeUp.wakeOne();
+    return snapshot->id;
+}
+
+quint64 OcrService::submitRegion(quint64 snapshotId, const QRect &rect)
+{
+    QMutexLocker locker(&m_mutex);
+    const auto snapshot = m_snapshots.value(snapshotId);
+    if (!snapshot)
+        return 0;
+
+    Job job;
+    job.id = m_nextJobId++;
+    job.snapshot = snapshot;
+    job.rect = rect;
+    job.preprocess = m_preprocess;
+    job.profile = m_profile;
+    job.languages = m_languages;
+    job.streaming = m_streaming;
+    job.useCache = m_cacheEnabled;
+    m_jobs.enqueue(job);
+    m_wakeUp.wakeOne();
+    return job.id;
+}
+
+void OcrService::releaseSnapshot(quint64 snapshotId)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_snapshots.remove(snapshotId) > 0) {
+        // Idle workers drop the engine's copy of it.
+        m_wakeUp.wakeAll();
     }
+}
+
+bool OcrService::shouldStream(const QRect &region, OcrProfile::Layout layout)
+{
+    // Below roughly a third of a 1080p screen, the whole capture is done
+    // before the first chunk would be.
+    constexpr qint64 kMinPixels = 640 * 480;
+    if (qint64(region.width()) * region.height() < kMinPixels)
+        return false;
+    return isTextBody(layout);
+}
+
+int OcrService::pendingJobs() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_jobs.size() + m_busyJobs;
+}
+
+void OcrService::setPreprocessOptions(const PreprocessOptions &options)
+{
+    QMutexLocker locker(&m_mutex);
+    m_preprocess = options;
+}
 
-    return true;
+PreprocessOptions OcrService::preprocessOptions() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_preprocess;
+}
+
+void OcrService::setProfile(const OcrProfile &profile)
+{
+    QMutexLocker locker(&m_mutex);
+    m_profile = profile;
 }
 
-bool OcrService::isReady() const
+OcrProfile OcrService::profile() const
 {
-    return m_api != nullptr;
+    QMutexLocker locker(&m_mutex);
+    return m_profile;
 }
 
-QString OcrService::extractText(const QImage &image)
+void OcrService::setStreamingEnabled(bool enabled)
 {
-    if (!isReady())
-        return {};
+    QMutexLocker locker(&m_mutex);
+    m_streaming = enabled;
+}
 
-    // Tesseract performs best on grayscale data, so convert before feeding it.
-    QImage gray = image.convertToFormat(QImage::Format_Grayscale8);
-    if (gray.isNull())
-        return {};
+bool OcrService::streamingEnabled() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_streaming;
+}
 
-    m_api->SetImage(gray.constBits(),
-                    gray.width(),
-                    gray.height(),
-                    1,
-                    gray.bytesPerLine());
+void OcrService::setCacheEnabled(bool enabled)
+{
+    QMutexLocker locker(&m_mutex);
+    m_cacheEnabled = enabled;
+}
 
-    QString result;
-    if (char *utf8 = m_api->GetUTF8Text()) {
-        result = QString::fromUtf8(utf8);
-        delete [] utf8;
+bool OcrService::cacheEnabled() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_cacheEnabled;
+}
+
+QString OcrService::statsReport() const
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_stats.jobs == 0 && m_stats.cacheHits == 0)
+        return tr("No captures recognized yet.");
+
+    QStringList lines;
+    if (m_state == State::Ready)
+        lines << tr("Engine startup: %1 ms").arg(m_initMs, 0, 'f', 0);
+    if (m_swaps > 0) {
+        lines << tr("Engine swaps: %1, %2 ms avg to load in the background")
+                     .arg(m_swaps)
+                     .arg(m_swapMs / double(m_swaps), 0, 'f', 0);
+    }
+    lines << tr("Result cache: %1 hits (%2 ms avg), %3 misses, %4 entries, %5 KiB")
+                 .arg(m_cache.hits())
+                 .arg(m_stats.cacheHits ? m_stats.cacheHitMs / double(m_stats.cacheHits) : 0.0, 0, 'f', 3)
+                 .arg(m_cache.misses())
+                 .arg(m_cache.count())
+                 .arg(m_cache.bytes() / 1024);
+    if (m_stats.jobs == 0)
+        return lines.join('\n');
+
+    const double jobs = double(m_stats.jobs);
+    lines << tr("Recognized captures: %1 (%2 engines)").arg(m_stats.jobs).arg(m_threads.size());
+    lines << tr("Crop + grayscale: %1 ms avg").arg(m_stats.convertMs / jobs, 0, 'f', 2);
+    if (m_stats.snapshots > 0) {
+        lines << tr("Multi-capture snapshot to grayscale: %1 ms avg over %2 sessions")
+                     .arg(m_stats.snapshotMs / double(m_stats.snapshots), 0, 'f', 2)
+                     .arg(m_stats.snapshots);
+    }
+    for (int step = 0; step < PreprocessTimings::StepCount; ++step) {
+        const quint64 runs = m_stats.preprocessRuns[step];
+        if (runs == 0)
+            continue;
+        lines << tr("Preprocess %1: %2 ms avg over %3 runs")
+                     .arg(PreprocessTimings::stepName(PreprocessTimings::Step(step)))
+                     .arg(m_stats.preprocessMs[step] / double(runs), 0, 'f', 2)
+                     .arg(runs);
+    }
+    if (m_stats.upscaled + m_stats.downscaled > 0) {
+        lines << tr("Text size normalized: %1 captures upscaled, %2 downscaled")
+                     .arg(m_stats.upscaled)
+                     .arg(m_stats.downscaled);
+    }
+    lines << tr("Recognition: %1 ms avg").arg(m_stats.recognizeMs / jobs, 0, 'f', 1);
+    if (m_stats.layoutDetections > 0) {
+        lines << tr("Layout detection: %1 ms avg over %2 runs")
+                     .arg(m_stats.layoutDetectMs / double(m_stats.layoutDetections), 0, 'f', 2)
+                     .arg(m_stats.layoutDetections);
+    }
+    if (m_stats.scriptDetections > 0) {
+        QStringList scripts;
+        for (auto it = m_stats.byScript.cbegin(); it != m_stats.byScript.cend(); ++it)
+            scripts << QStringLiteral("%1 %2").arg(it.key()).arg(it.value());
+        scripts.sort();
+        lines << tr("Script detection: %1 ms avg over %2 runs (%3)")
+                     .arg(m_stats.scriptDetectMs / double(m_stats.scriptDetections), 0, 'f', 2)
+                     .arg(m_stats.scriptDetections)
+                     .arg(scripts.join(QStringLiteral(", ")));
+    }
+    if (m_stats.byLanguage.size() > 1) {
+        QStringList languages;
+        for (auto it = m_stats.byLanguage.cbegin(); it != m_stats.byLanguage.cend(); ++it)
+            languages << QStringLiteral("%1 %2").arg(it.key()).arg(it.value());
+        languages.sort();
+        lines << tr("Captures per language: %1").arg(languages.join(QStringLiteral(", ")));
+    }
 
-        // Remove page-break leftovers to avoid polluting clipboard text.
-        result.remove(QChar::fromLatin1('\f'));
-        result = result.trimmed();
+    // Time per megapixel makes captures of different sizes comparable; the
+    // gain is relative to full automatic page segmentation when it has run.
+    const RecognitionStats &page = m_stats.byLayout[size_t(OcrProfile::Layout::Page)];
+    const double pageMsPerMp = page.megapixels > 0.0 ? page.ms / page.megapixels : 0.0;
+    auto describe = [pageMsPerMp](const RecognitionStats &stats) {
+        const double msPerMp = stats.megapixels > 0.0 ? stats.ms / stats.megapixels : 0.0;
+        QString line = tr("%1 runs, %2 ms avg, %3 ms/MP")
+                           .arg(stats.runs)
+                           .arg(stats.ms / double(stats.runs), 0, 'f', 1)
+                           .arg(msPerMp, 0, 'f', 0);
+        if (pageMsPerMp > 0.0 && msPerMp > 0.0 && msPerMp != pageMsPerMp)
+            line += tr(" (%1% vs. page)").arg(100.0 * (msPerMp / pageMsPerMp - 1.0), 0, 'f', 0);
+        return line;
+    };
+    for (size_t layout = 0; layout < m_stats.byLayout.size(); ++layout) {
+        const RecognitionStats &stats = m_stats.byLayout[layout];
+        if (stats.runs == 0)
+            continue;
+        lines << tr("Layout %1: %2").arg(OcrProfile::layoutName(OcrProfile::Layout(layout)),
+                                         describe(stats));
     }
+    for (auto it = m_stats.byProfile.cbegin(); it != m_stats.byProfile.cend(); ++it)
+        lines << tr("Profile \"%1\": %2").arg(it.key(), describe(it.value()));
+    return lines.join('\n');
+}
+
+quint64 OcrService::configFingerprint(const QString &language, const PreprocessOptions &preprocess,
+                                      const OcrProfile &profile, bool streaming)
+{
+    Xxh64 hash;
+    const QByteArray lang = language.toUtf8();
+    hash.update(lang.constData(), size_t(lang.size()));
+    hash.updateValue(quint8(preprocess.normalizeContrast));
+    hash.updateValue(quint8(preprocess.fixPolarity));
+    hash.updateValue(quint8(preprocess.denoise));
+    hash.updateValue(qint32(preprocess.binarization));
+    hash.updateValue(qint32(preprocess.sauvolaWindow));
+    hash.updateValue(preprocess.sauvolaK);
+    hash.updateValue(quint8(preprocess.normalizeTextSize));
+    hash.updateValue(qint32(preprocess.targetXHeight));
+    // The profile name is only a label; what it sets is what matters.
+    hash.updateValue(qint32(profile.layout));
+    hash.updateValue(qint32(profile.engineMode));
+    const QByteArray whitelist = profile.whitelist.toUtf8();
+    hash.updateValue(qint32(whitelist.size()));
+    hash.update(whitelist.constData(), size_t(whitelist.size()));
+    hash.updateValue(qint32(profile.dpi));
+    // Streamed text is recognized chunk by chunk and can differ slightly
+    // from a single pass over the same pixels.
+    hash.updateValue(quint8(streaming));
+    // Never 0, which marks jobs that bypass the cache.
+    return hash.digest() | 1;
+}
+
+void OcrService::workerLoop()
+{
+#ifdef _OPENMP
+    // Parallelism comes from the pool; Tesseract's own OpenMP threads would
+    // only oversubscribe the cores. The OpenMP runtime reads OMP_THREAD_LIMIT
+    // when it is loaded, long before anything here runs, and the thread count
+    // set below applies to the calling thread only, so each worker sets it.
+    omp_set_num_threads(1);
+#endif
+
+    // Each worker is the only thread that ever touches the engines it holds.
+    // The engine for the initialized language is loaded with the
+    // configuration; engines for other languages and OCR engine modes are
+    // loaded when a capture first asks for them.
+    auto engines = std::make_unique<OcrEngineSet>();
+    quint64 engineGeneration = 0;
+    QString dataPath;
+    QString language;
+
+    // Per-worker buffers, reused across jobs.
+    GrayImage gray;
+    ImagePreprocessor preprocessor;
+
+    // A worker whose engine failed to load leaves the jobs to the others;
+    // only when every worker failed does it take them, to fail them fast.
+    // Called with m_mutex held.
+    auto takesJobs = [&]() {
+        return engines->primary() || (m_state != State::Initializing && m_state != State::Ready);
+    };
+
+    for (;;) {
+        Job job;
+        bool rebuild = false;
+        bool unload = false;
+        std::unique_ptr<OcrEngineSet> adopted;
+        {
+            QMutexLocker locker(&m_mutex);
+            while (!m_stopping && (m_jobs.isEmpty() || !takesJobs())
+                   && engineGeneration == m_activeGeneration) {
+                // Wake up in time to unload engines nothing has used lately.
+                const qint64 unloadInMs = engines->msUntilUnload();
+                if (unloadInMs < 0) {
+                    m_wakeUp.wait(&m_mutex);
+                } else if (!m_wakeUp.wait(&m_mutex, QDeadlineTimer(unloadInMs))) {
+                    unload = true;
+                    break;
+                }
+            }
+            if (m_stopping)
+                break;
+
+            // Refresh engines only between jobs so a running job always
+            // finishes on the engine it started on. Until a worker has an
+            // engine it does not take jobs, so early captures simply wait in
+            // the queue for the first worker that finishes loading, and a
+            // worker whose engine failed to load never takes any. After a
+            // hot swap the new engines are already loaded and only change
+            // hands here.
+            if (engineGeneration != m_activeGeneration) {
+                engineGeneration = m_activeGeneration;
+                dataPath = m_dataPath;
+                language = m_language;
+                if (!m_readySets.empty()) {
+                    adopted = std::move(m_readySets.back());
+                    m_readySets.pop_back();
+                } else {
+                    rebuild = true;
+                }
+            }
+
+            if (!rebuild && !unload && !adopted) {
+                if (m_jobs.isEmpty() || !takesJobs())
+                    continue;
+                job = m_jobs.dequeue();
+                ++m_busyJobs;
+            }
+        }
+
+        if (adopted) {
+            // The previous engines are destroyed outside the lock.
+            std::swap(engines, adopted);
+            adopted.reset();
+            continue;
+        }
+
+        if (unload && !rebuild) {
+            // Rarely used languages give their memory back.
+            engines->unloadIdle();
+            continue;
+        }
 
-    m_api->Clear();
-    return result;
+        if (rebuild) {
+            // Build outside the lock so all workers initialize in parallel.
+            const bool ok = engines->load(dataPath, language);
+
+            // The first worker to load its engine makes the service ready;
+            // it fails only once every worker has failed, since one can run
+            // out of memory where the others did not.
+            bool report = false;
+            double initMs = 0.0;
+            {
+                QMutexLocker locker(&m_mutex);
+                if (engineGeneration == m_activeGeneration && m_state == State::Initializing
+                    && (ok || ++m_loadFailures == m_threads.size())) {
+                    m_state = ok ? State::Ready : State::Failed;
+                    m_lastInitOk = ok;
+                    m_initMs = m_initTimer.nsecsElapsed() / 1e6;
+                    initMs = m_initMs;
+                    report = true;
+                    m_initDone.wakeAll();
+                    // Queued jobs fail fast instead of waiting for an engine
+                    // that will never load.
+                    if (!ok)
+                        m_wakeUp.wakeAll();
+                }
+            }
+            if (report)
+                emit initialized(ok, initMs);
+            continue;
+        }
+
+        if (!job.group && !job.prepareOnly) {
+            // The language key follows the engines that actually run the job,
+            // which after a swap can be newer than at submission.
+            const QString primaryLanguage = engines->primaryLanguage();
+            job.languages = detectionLanguages(primaryLanguage, job.languages);
+            if (job.useCache) {
+                const QString languages = job.languages.isEmpty() ? primaryLanguage
+                                                                  : job.languages.join(QLatin1Char('|'));
+                job.configKey = configFingerprint(languages, job.preprocess, job.profile, job.streaming);
+            }
+        }
+
+        if (job.prepareOnly) {
+            // Convert the snapshot while the user is still selecting, so the
+            // first region does not wait for it.
+            QElapsedTimer timer;
+            timer.start();
+            job.snapshot->grayImage();
+            const double convertMs = timer.nsecsElapsed() / 1e6;
+
+            QMutexLocker locker(&m_mutex);
+            --m_busyJobs;
+            ++m_stats.snapshots;
+            m_stats.snapshotMs += convertMs;
+            continue;
+        }
+
+        QString text;
+        bool recognized = false;
+        bool cacheHit = false;
+        double convertMs = 0.0;
+        double recognizeMs = 0.0;
+        double detectMs = 0.0;
+        double scriptMs = 0.0;
+        QString script;
+        // Empty for the initialized language.
+        QString jobLanguage;
+        // Factor the text was resampled by before recognition.
+        double scale = 1.0;
+        double megapixels = 0.0;
+        OcrProfile::Layout layout = OcrProfile::Layout::Auto;
+        PreprocessTimings timings;
+        OcrEngine *primary = engines->primary();
+        if (job.group) {
+            // One band of a tiled capture. The worker that finishes the last
+            // band stitches the text and reports the whole job.
+            BandGroup &group = *job.group;
+            QString bandText;
+            double bandMs = 0.0;
+            if (primary) {
+                // Only the band's rows are handed to Tesseract, which copies
+                // whatever it is given.
+                QElapsedTimer timer;
+                timer.start();
+                OcrEngine *runner = engines->engine(group.language, group.profile.engineMode);
+                runner->applyProfile(group.profile, group.layout);
+                runner->setImage(*group.pixels, group.bands.at(job.band).rect);
+                bandText = runner->recognize();
+                bandMs = timer.nsecsElapsed() / 1e6;
+            }
+
+            QString partial;
+            bool finished = false;
+            {
+                QMutexLocker locker(&m_mutex);
+                // Workers without an engine only take jobs once every engine
+                // failed to load; a band without text fails the whole group.
+                if (!primary)
+                    group.failed = true;
+                group.recognizeMs += bandMs;
+                group.texts[size_t(job.band)] = bandText;
+                group.done[size_t(job.band)] = true;
+                const int streamedBefore = group.streamed;
+                while (group.streamed < int(group.bands.size()) && group.done[size_t(group.streamed)])
+                    ++group.streamed;
+                finished = --group.remaining == 0;
+                if (!finished) {
+                    --m_busyJobs;
+                    if (group.streaming && !group.failed && group.streamed > streamedBefore)
+                        partial = group.join(group.streamed);
+                }
+            }
+            if (!partial.isEmpty())
+                emit partialText(job.id, partial);
+            if (!finished)
+                continue;
+
+            recognized = !group.failed;
+            if (recognized)
+                text = group.join(int(group.bands.size()));
+            convertMs = group.convertMs;
+            timings = group.timings;
+            detectMs = group.detectMs;
+            scriptMs = group.scriptMs;
+            script = group.script;
+            scale = group.scale;
+            jobLanguage = group.language;
+            layout = group.layout;
+            megapixels = group.megapixels;
+            recognizeMs = group.recognizeMs;
+            if (recognized && group.cacheResult)
+                m_cache.insert(group.key, text);
+        } else if (primary) {
+            QElapsedTimer timer;
+            timer.start();
+            const qint64 convertStartNs = LatencyTrace::now();
+
+            // A snapshot is already grayscale, so its regions are hashed in
+            // place and only copied out on a cache miss; single captures are
+            // cropped and converted into the worker's buffer.
+            const GrayImage *source = nullptr;
+            QRect region;
+            if (job.snapshot) {
+                const GrayImage &snapshotGray = job.snapshot->grayImage();
+                if (!job.rect.isEmpty() && snapshotGray.rect().contains(job.rect)) {
+                    source = &snapshotGray;
+                    region = job.rect;
+                }
+            } else if (gray.loadFrom(job.image, job.rect)) {
+                source = &gray;
+                region = gray.rect();
+            }
+            job.image = QImage();
+
+            bool tiled = false;
+            if (source) {
+                // The key uses the pixels before preprocessing, so a hit also
+                // skips the preprocessing steps.
+                OcrCache::Key key;
+                if (job.configKey != 0) {
+                    key.pixels = source->contentHash(region);
+                    key.config = job.configKey;
+                    cacheHit = m_cache.lookup(key, &text);
+                }
+                convertMs = timer.nsecsElapsed() / 1e6;
+                LatencyTrace::instance().record(LatencyTrace::Stage::Convert, convertStartNs,
+                                                LatencyTrace::now(), job.id);
+                megapixels = double(region.width()) * double(region.height()) / 1e6;
+
+                if (!cacheHit) {
+                    // Snapshot regions get the same preprocessing as single
+                    // captures, so a cached text never depends on the path
+                    // that produced it, and engines only ever hold a region.
+                    double scaleMs = 0.0;
+                    if (job.preprocess.normalizeTextSize) {
+                        timer.start();
+                        scale = ImagePreprocessor::textScale(*source, region, job.preprocess.targetXHeight);
+                        scaleMs = timer.nsecsElapsed() / 1e6;
+                    }
+                    if (source != &gray) {
+                        gray.copyFrom(*source, region);
+                        source = &gray;
+                    }
+                    preprocessor.setOptions(job.preprocess);
+                    timings = preprocessor.process(gray, scale);
+                    region = gray.rect();
+                    megapixels = double(region.width()) * double(region.height()) / 1e6;
+                    timings.ms[PreprocessTimings::Scale] += scaleMs;
+
+                    layout = job.profile.layout;
+                    if (layout == OcrProfile::Layout::Auto) {
+                        timer.start();
+                        layout = OcrProfile::detectLayout(*source, region);
+                        detectMs = timer.nsecsElapsed() / 1e6;
+                    }
+
+                    // The script decides which language's engine reads the
+                    // capture, tiled or not.
+                    if (!job.languages.isEmpty()) {
+                        timer.start();
+                        jobLanguage = engines->detectLanguage(*source, region, job.languages, &script);
+                        scriptMs = timer.nsecsElapsed() / 1e6;
+                    }
+
+                    // Tall text is cut into bands at blank gutters and the
+                    // bands are queued ahead of everything else, so idle
+                    // workers pick them up right away.
+                    QList<TextBands::Band> bands;
+                    if (m_threads.size() > 1 && isTextBody(layout) && region.height() >= 2 * kMinBandHeight)
+                        bands = TextBands::split(*source, region, int(m_threads.size()), kMinBandHeight);
+                    if (bands.size() > 1) {
+                        auto group = std::make_shared<BandGroup>();
+                        group->profile = job.profile;
+                        group->layout = layout;
+                        group->language = jobLanguage;
+                        group->streaming = job.streaming;
+                        group->bands = bands;
+                        group->texts.resize(size_t(bands.size()));
+                        group->done.assign(size_t(bands.size()), false);
+                        group->remaining = int(bands.size());
+                        group->cacheResult = job.configKey != 0;
+                        group->key = key;
+                        group->convertMs = convertMs;
+                        group->timings = timings;
+                        group->detectMs = detectMs;
+                        group->scriptMs = scriptMs;
+                        group->script = script;
+                        group->scale = scale;
+                        group->megapixels = megapixels;
+                        // Other workers read the bands, so the buffer moves
+                        // into the group.
+                        group->owned = std::move(gray);
+                        gray.release();
+                        group->pixels = &group->owned;
+
+                        QMutexLocker locker(&m_mutex);
+                        for (int band = int(bands.size()) - 1; band >= 0; --band) {
+                            Job bandJob;
+                            bandJob.id = job.id;
+                            bandJob.profile = job.profile;
+                            bandJob.group = group;
+                            bandJob.band = band;
+                            m_jobs.prepend(bandJob);
+                        }
+                        --m_busyJobs;
+                        m_wakeUp.wakeAll();
+                        tiled = true;
+                    } else {
+                        OcrEngine *runner = engines->engine(jobLanguage, job.profile.engineMode);
+
+                        timer.start();
+                        runner->applyProfile(job.profile, layout);
+                        runner->setImage(*source);
+                        if (job.streaming && shouldStream(region, layout)) {
+                            const quint64 jobId = job.id;
+                            text = runner->recognizeProgressively(region, [this, jobId](const QString &soFar) {
+                                emit partialText(jobId, soFar);
+                            });
+                        } else {
+                            text = runner->recognize();
+                        }
+                        recognizeMs = timer.nsecsElapsed() / 1e6;
+                        recognized = true;
+
+                        if (job.configKey != 0)
+                            m_cache.insert(key, text);
+                    }
+                }
+            }
+            if (tiled)
+                continue;
+        }
+        job.image = QImage();
+        job.snapshot.reset();
+        job.group.reset();
+
+        {
+            QMutexLocker locker(&m_mutex);
+            --m_busyJobs;
+            if (cacheHit) {
+                ++m_stats.cacheHits;
+                m_stats.cacheHitMs += convertMs;
+            }
+            if (recognized) {
+                ++m_stats.jobs;
+                m_stats.convertMs += convertMs;
+                m_stats.recognizeMs += recognizeMs;
+                if (detectMs > 0.0) {
+                    ++m_stats.layoutDetections;
+                    m_stats.layoutDetectMs += detectMs;
+                }
+                if (scriptMs > 0.0) {
+                    ++m_stats.scriptDetections;
+                    m_stats.scriptDetectMs += scriptMs;
+                    ++m_stats.byScript[script.isEmpty() ? QStringLiteral("uncertain") : script];
+                }
+                if (scale > 1.0)
+                    ++m_stats.upscaled;
+                else if (scale < 1.0)
+                    ++m_stats.downscaled;
+                ++m_stats.byLanguage[jobLanguage.isEmpty() ? engines->primaryLanguage() : jobLanguage];
+                for (RecognitionStats *stats : {&m_stats.byLayout[size_t(layout)],
+                                                &m_stats.byProfile[job.profile.name]}) {
+                    ++stats->runs;
+                    stats->ms += recognizeMs;
+                    stats->megapixels += megapixels;
+                }
+                for (int step = 0; step < PreprocessTimings::StepCount; ++step) {
+                    if (timings.ms[step] > 0.0) {
+                        m_stats.preprocessMs[step] += timings.ms[step];
+                        ++m_stats.preprocessRuns[step];
+                    }
+                }
+            }
+        }
+        OcrJobTimings summary;
+        summary.convertMs = convertMs;
+        summary.recognizeMs = recognizeMs;
+        summary.cacheHit = cacheHit;
+        summary.failed = !recognized && !cacheHit;
+        summary.layout = layout;
+        for (const double ms : timings.ms)
+            summary.preprocessMs += ms;
+
+        // Cross-thread emission: receivers in the GUI thread get it queued.
+        emit jobTimings(job.id, summary);
+        emit textReady(job.id, text);
+    }
 }
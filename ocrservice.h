@@ -1,30 +1,277 @@
 #ifndef OCRSERVICE_H
 #define OCRSERVICE_H
 
+#include <QElapsedTimer>
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QQueue>
+#include <QRect>
 #include <QString>
+#include <QStringList>
+#include <QWaitCondition>
 
-class QImage;
+#include "imagepreprocessor.h"
+#include "ocrcache.h"
+#include "ocrprofile.h"
 
-namespace tesseract {
-class TessBaseAPI;
-}
+#include <array>
+#include <memory>
+#include <vector>
 
-// Thin RAII wrapper that keeps a single TessBaseAPI instance alive for the
-// duration of the application.
-class OcrService
+class QThread;
+class OcrEngine;
+class OcrEngineSet;
+
+// Where the time of one job went, in milliseconds.
+struct OcrJobTimings
+{
+    double convertMs = 0.0;
+    double preprocessMs = 0.0;
+    double recognizeMs = 0.0;
+    bool cacheHit = false;
+    // No engine read the job, e.g. none could be loaded or the region was
+    // empty; its text is empty.
+    bool failed = false;
+    // Layout the job was recognized with; Auto for cache hits.
+    OcrProfile::Layout layout = OcrProfile::Layout::Auto;
+};
+Q_DECLARE_METATYPE(OcrJobTimings)
+
+// Asynchronous front-end to a pool of OCR engines. Images are queued with
+// submit() and recognized on worker threads that each own one Tesseract
+// engine, so several regions are recognized concurrently. Results come back
+// through textReady() on the thread that owns the service, so the GUI thread
+// never blocks on recognition.
+class OcrService : public QObject
 {
+    Q_OBJECT
 public:
-    OcrService();
-    ~OcrService();
+    // engineCount <= 0 sizes the pool to the number of cores.
+    explicit OcrService(int engineCount = 0, QObject *parent = nullptr);
+    ~OcrService() override;
 
-    // (Re)initialize the engine with the given tessdata path and language.
+    enum class State {
+        Uninitialized,
+        Initializing,
+        Ready,
+        Failed
+    };
+
+    // (Re)initialize the engines with the given tessdata path and language.
+    // Returns immediately. The first time, every worker loads its engine on
+    // its own thread and initialized() reports success once the first engine
+    // is up, or failure once every worker's has failed; jobs submitted in
+    // the meantime stay queued and run as soon as one is. Once ready, the
+    // new engines are built on background threads while the current ones
+    // keep serving, and every worker swaps to its new engines between two
+    // jobs once all of them have loaded; a job always finishes on the engines
+    // it started on. If loading fails, the current engines stay in service.
+    void initializeAsync(const QString &dataPath, const QString &language);
+    // Blocking variant for headless callers.
     bool initialize(const QString &dataPath, const QString &language);
-    bool isReady() const;
-    // Run OCR on the provided image and return UTF-8 text.
-    QString extractText(const QImage &image);
+    // Waits until the current initialization or swap has succeeded or failed.
+    bool waitForInitialized(int timeoutMs = -1);
+    // True while engines for a new configuration are loading in the background.
+    bool isSwapping() const;
+    // Language of the engines in service.
+    QString language() const;
+
+    // Languages captures may be written in besides the one given to
+    // initialize. With any of a different script, every capture first goes
+    // through Tesseract's script detection and is recognized in the first of
+    // these languages that uses the detected script; the initialized language
+    // comes first and handles uncertain captures. Each worker loads an engine
+    // for a language the first time a capture needs it and unloads it after a
+    // few idle minutes. Needs osd.traineddata; applies to jobs submitted after
+    // the call.
+    void setLanguages(const QStringList &languages);
+    QStringList languages() const;
+    // Languages with a <language>.traineddata in dataPath, except the OSD and
+    // equation models.
+    static QStringList installedLanguages(const QString &dataPath);
+
+    State state() const;
+    bool isReady() const { return state() == State::Ready; }
+    // True while captures can still produce text, i.e. ready or loading.
+    bool acceptsJobs() const;
+    int engineCount() const { return m_threads.size(); }
+
+    // Queue rect of image (in image pixels; null means the whole image) for
+    // recognition and return the id of the job. The image is shared, not
+    // copied; the worker crops and converts it in one pass. The text is
+    // delivered through textReady() carrying the same id. Jobs may finish out
+    // of submission order.
+    quint64 submit(const QImage &image, const QRect &rect = QRect());
+    int pendingJobs() const;
+
+    // Multi-capture sessions recognize many regions of one frozen frame.
+    // registerSnapshot() converts the frame to grayscale once, in the
+    // background, and drops the service's reference to the color pixels right
+    // after. submitRegion() queues rect (in frame pixels) of the snapshot;
+    // the region is copied out of the grayscale snapshot and preprocessed
+    // like any other capture. Returns 0 for an unknown snapshot.
+    quint64 registerSnapshot(const QImage &frame);
+    quint64 submitRegion(quint64 snapshotId, const QRect &rect);
+    // Queued regions still finish; the memory goes once they have.
+    void releaseSnapshot(quint64 snapshotId);
+
+    // Preprocessing applied to jobs submitted after the call.
+    void setPreprocessOptions(const PreprocessOptions &options);
+    PreprocessOptions preprocessOptions() const;
+
+    // Engine profile applied to jobs submitted after the call. Profiles with
+    // a non-default engine mode load an extra engine per worker on first use.
+    void setProfile(const OcrProfile &profile);
+    OcrProfile profile() const;
+
+    // Large captures with a page or block layout are recognized a few lines
+    // at a time and report their text so far through partialText().
+    void setStreamingEnabled(bool enabled);
+    bool streamingEnabled() const;
+
+    // Results are looked up by pixel + configuration hash before recognition.
+    void setCacheEnabled(bool enabled);
+    bool cacheEnabled() const;
+    OcrCache &cache() { return m_cache; }
+
+    // Human-readable summary of the average time spent per stage so far.
+    QString statsReport() const;
+
+signals:
+    // elapsedMs runs from initializeAsync() until the first engine is usable.
+    void initialized(bool ok, double elapsedMs);
+    // Emitted right before textReady() for the same job.
+    void jobTimings(quint64 jobId, const OcrJobTimings &timings);
+    // Streaming jobs only: the text recognized so far, in reading order.
+    // Each emission extends the previous one; textReady() still follows.
+    void partialText(quint64 jobId, const QString &text);
+    void textReady(quint64 jobId, const QString &text);
 
 private:
-    tesseract::TessBaseAPI *m_api = nullptr;
+    struct Snapshot;
+    struct BandGroup;
+
+    struct Job
+    {
+        quint64 id = 0;
+        QImage image;
+        QRect rect;
+        // Set for regions of a registered snapshot instead of image.
+        std::shared_ptr<Snapshot> snapshot;
+        // Only converts the snapshot; produces no text.
+        bool prepareOnly = false;
+        // Set for one band of a tiled capture; id is the capture's.
+        std::shared_ptr<BandGroup> group;
+        int band = -1;
+        PreprocessOptions preprocess;
+        OcrProfile profile;
+        // Languages set with setLanguages() when the job was submitted. The
+        // worker narrows them down to what script detection picks from, since
+        // only it knows which language its engines were loaded for.
+        QStringList languages;
+        bool streaming = false;
+        bool useCache = false;
+        // Hash of everything besides the pixels that affects the text; 0
+        // when the cache is disabled. Set by the worker.
+        quint64 configKey = 0;
+    };
+
+    // Recognition time of the jobs run with one layout or profile.
+    struct RecognitionStats
+    {
+        quint64 runs = 0;
+        double ms = 0.0;
+        double megapixels = 0.0;
+    };
+
+    // Accumulated stage timings, in milliseconds.
+    struct Stats
+    {
+        quint64 jobs = 0;
+        double convertMs = 0.0;
+        std::array<double, PreprocessTimings::StepCount> preprocessMs{};
+        std::array<quint64, PreprocessTimings::StepCount> preprocessRuns{};
+        double recognizeMs = 0.0;
+        quint64 cacheHits = 0;
+        double cacheHitMs = 0.0;
+        quint64 snapshots = 0;
+        double snapshotMs = 0.0;
+        quint64 layoutDetections = 0;
+        double layoutDetectMs = 0.0;
+        quint64 scriptDetections = 0;
+        double scriptDetectMs = 0.0;
+        quint64 upscaled = 0;
+        quint64 downscaled = 0;
+        QHash<QString, quint64> byScript;
+        QHash<QString, quint64> byLanguage;
+        // Indexed by OcrProfile::Layout.
+        std::array<RecognitionStats, 6> byLayout{};
+        QHash<QString, RecognitionStats> byProfile;
+    };
+
+    static quint64 configFingerprint(const QString &language, const PreprocessOptions &preprocess,
+                                     const OcrProfile &profile, bool streaming);
+    // The languages script detection chooses from with primary loaded; empty
+    // when every candidate shares the script of primary.
+    static QStringList detectionLanguages(const QString &primary, const QStringList &languages);
+    // Loads one worker's engines for a hot swap to generation.
+    void buildEngineSet(quint64 generation, const QString &dataPath, const QString &language);
+    // Whether a job of this size and layout is worth streaming.
+    static bool shouldStream(const QRect &region, OcrProfile::Layout layout);
+    void workerLoop();
+
+    QList<QThread *> m_threads;
+
+    // Guards everything below; m_wakeUp is signalled on new jobs/engines,
+    // m_initDone when the state leaves Initializing.
+    mutable QMutex m_mutex;
+    QWaitCondition m_wakeUp;
+    QWaitCondition m_initDone;
+    QQueue<Job> m_jobs;
+    quint64 m_nextJobId = 1;
+    QHash<quint64, std::shared_ptr<Snapshot>> m_snapshots;
+    quint64 m_nextSnapshotId = 1;
+    int m_busyJobs = 0;
+    bool m_stopping = false;
+
+    // Configuration of the engines in service. Workers compare
+    // m_activeGeneration with the one their engines were built for and
+    // refresh them between two jobs: by loading them themselves on the first
+    // initialization, or by adopting one of m_readySets after a hot swap.
+    QString m_dataPath;
+    QString m_language;
+    QStringList m_languages;
+    quint64 m_activeGeneration = 0;
+    std::vector<std::unique_ptr<OcrEngineSet>> m_readySets;
+    State m_state = State::Uninitialized;
+    bool m_lastInitOk = false;
+    QElapsedTimer m_initTimer;
+    double m_initMs = 0.0;
+    // Workers whose engine failed to load while initializing.
+    int m_loadFailures = 0;
+
+    // Latest requested configuration; ahead of m_activeGeneration while a hot
+    // swap builds its engines. Builds for an older generation are discarded.
+    quint64 m_generation = 0;
+    QList<QThread *> m_builders;
+    std::vector<std::unique_ptr<OcrEngineSet>> m_builtSets;
+    int m_buildsPending = 0;
+    bool m_buildFailed = false;
+    QString m_pendingDataPath;
+    QString m_pendingLanguage;
+    quint64 m_swaps = 0;
+    double m_swapMs = 0.0;
+
+    PreprocessOptions m_preprocess;
+    OcrProfile m_profile;
+    Stats m_stats;
+
+    bool m_streaming = true;
+    bool m_cacheEnabled = true;
+    OcrCache m_cache;
 };
 
 #endif // OCRSERVICE_H
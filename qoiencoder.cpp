@@ -0,0 +1,145 @@
+#include "qoiencoder.h"
+
+#include <QImage>
+
+#include <cstring>
+
+namespace {
+
+constexpr uchar kOpIndex = 0x00;
+constexpr uchar kOpDiff  = 0x40;
+constexpr uchar kOpLuma  = 0x80;
+constexpr uchar kOpRun   = 0xc0;
+constexpr uchar kOpRgb   = 0xfe;
+constexpr uchar kOpRgba  = 0xff;
+
+struct Pixel
+{
+    uchar r = 0;
+    uchar g = 0;
+    uchar b = 0;
+    uchar a = 255;
+
+    bool operator==(const Pixel &other) const
+    {
+        return r == other.r && g == other.g && b == other.b && a == other.a;
+    }
+};
+
+int hashIndex(const Pixel &px)
+{
+    return (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+}
+
+void putBigEndian32(uchar *out, quint32 value)
+{
+    out[0] = uchar(value >> 24);
+    out[1] = uchar(value >> 16);
+    out[2] = uchar(value >> 8);
+    out[3] = uchar(value);
+}
+
+} // namespace
+
+QByteArray Qoi::encode(const QImage &source)
+{
+    if (source.isNull())
+        return {};
+
+    // Screenshots are opaque, so only keep the alpha channel when it exists.
+    const bool hasAlpha = source.hasAlphaChannel();
+    const QImage image = source.convertToFormat(hasAlpha ? QImage::Format_ARGB32
+                                                         : QImage::Format_RGB32);
+    const int width = image.width();
+    const int height = image.height();
+    const int channels = hasAlpha ? 4 : 3;
+
+    // Worst case is one tag byte plus all channels per pixel.
+    const qsizetype maxSize = 14 + qsizetype(width) * height * (channels + 1) + 8;
+    QByteArray out(maxSize, Qt::Uninitialized);
+    uchar *dst = reinterpret_cast<uchar *>(out.data());
+    qsizetype pos = 0;
+
+    std::memcpy(dst, "qoif", 4);
+    putBigEndian32(dst + 4, quint32(width));
+    putBigEndian32(dst + 8, quint32(height));
+    dst[12] = uchar(channels);
+    dst[13] = 0; // sRGB with linear alpha
+    pos = 14;
+
+    // The spec starts with an all-zero index (alpha included) and an opaque
+    // black previous pixel.
+    Pixel index[64];
+    for (Pixel &entry : index)
+        entry.a = 0;
+    Pixel prev;
+    int run = 0;
+    const qsizetype lastPixel = qsizetype(width) * height - 1;
+    qsizetype pixelNo = 0;
+
+    for (int y = 0; y < height; ++y) {
+        const QRgb *line = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+        for (int x = 0; x < width; ++x, ++pixelNo) {
+            Pixel px;
+            px.r = uchar(qRed(line[x]));
+            px.g = uchar(qGreen(line[x]));
+            px.b = uchar(qBlue(line[x]));
+            px.a = hasAlpha ? uchar(qAlpha(line[x])) : uchar(255);
+
+            if (px == prev) {
+                ++run;
+                if (run == 62 || pixelNo == lastPixel) {
+                    dst[pos++] = uchar(kOpRun | (run - 1));
+                    run = 0;
+                }
+                continue;
+            }
+
+            if (run > 0) {
+                dst[pos++] = uchar(kOpRun | (run - 1));
+                run = 0;
+            }
+
+            const int slot = hashIndex(px);
+            if (index[slot] == px) {
+                dst[pos++] = uchar(kOpIndex | slot);
+            } else {
+                index[slot] = px;
+
+                if (px.a == prev.a) {
+                    const signed char vr = static_cast<signed char>(px.r - prev.r);
+                    const signed char vg = static_cast<signed char>(px.g - prev.g);
+                    const signed char vb = static_cast<signed char>(px.b - prev.b);
+                    const signed char vgr = static_cast<signed char>(vr - vg);
+                    const signed char vgb = static_cast<signed char>(vb - vg);
+
+                    if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                        dst[pos++] = uchar(kOpDiff | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+                    } else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8) {
+                        dst[pos++] = uchar(kOpLuma | (vg + 32));
+                        dst[pos++] = uchar((vgr + 8) << 4 | (vgb + 8));
+                    } else {
+                        dst[pos++] = kOpRgb;
+                        dst[pos++] = px.r;
+                        dst[pos++] = px.g;
+                        dst[pos++] = px.b;
+                    }
+                } else {
+                    dst[pos++] = kOpRgba;
+                    dst[pos++] = px.r;
+                    dst[pos++] = px.g;
+                    dst[pos++] = px.b;
+                    dst[pos++] = px.a;
+                }
+            }
+            prev = px;
+        }
+    }
+
+    static const uchar padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+    std::memcpy(dst + pos, padding, sizeof(padding));
+    pos += sizeof(padding);
+
+    out.truncate(pos);
+    return out;
+}
@@ -0,0 +1,18 @@
+#ifndef QOIENCODER_H
+#define QOIENCODER_H
+
+#include <QByteArray>
+
+class QImage;
+
+// Encoder for the "Quite OK Image" format (https://qoiformat.org): lossless
+// like PNG, but a single pass over the pixels without entropy coding, which
+// makes it several times faster to write large screenshots.
+namespace Qoi {
+
+// Returns the encoded file contents, or an empty array if the image is null.
+QByteArray encode(const QImage &image);
+
+} // namespace Qoi
+
+#endif // QOIENCODER_H
@@ -0,0 +1,225 @@
+#include "regionwatcher.h"
+
+#include "capturebackend.h"
+#include "grayimage.h"
+#include "hashing.h"
+#include "ocrservice.h"
+
+#include <QElapsedTimer>
+#include <QLoggingCategory>
+
+// QT_LOGGING_RULES="sniptext.watch.info=true" logs every text change.
+Q_LOGGING_CATEGORY(lcWatch, "sniptext.watch", QtWarningMsg)
+
+namespace {
+
+// Edge of the tiles compared between two grabs, in pixels.
+const int kTileSize = 32;
+
+// Bands are cut no shorter than one line of UI text, in logical pixels.
+const int kMinBandHeight = 16;
+
+} // namespace
+
+RegionWatcher::RegionWatcher(CaptureBackend *backend, OcrService *ocrService, QObject *parent)
+    : QObject(parent)
+    , m_backend(backend)
+    , m_ocrService(ocrService)
+{
+    m_timer.setInterval(1000);
+    m_timer.setTimerType(Qt::CoarseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &RegionWatcher::poll);
+    m_startTimer.setSingleShot(true);
+    connect(&m_startTimer, &QTimer::timeout, this, [this]() {
+        m_timer.start();
+        poll();
+    });
+    // jobTimings() arrives right before the textReady() of the same job.
+    connect(m_ocrService, &OcrService::jobTimings,
+            this, [this](quint64 jobId, const OcrJobTimings &timings) {
+                const auto it = m_pendingJobs.constFind(jobId);
+                if (it != m_pendingJobs.constEnd() && timings.failed)
+                    m_failedBands.insert(it.value());
+            });
+    connect(m_ocrService, &OcrService::textReady, this, &RegionWatcher::onTextReady);
+}
+
+void RegionWatcher::setInterval(int intervalMs)
+{
+    m_timer.setInterval(qMax(100, intervalMs));
+}
+
+void RegionWatcher::start(const QRect &region, int delayMs)
+{
+    stop();
+    m_region = region;
+    m_startTimer.start(qMax(0, delayMs));
+}
+
+void RegionWatcher::stop()
+{
+    m_startTimer.stop();
+    m_timer.stop();
+    // Results still in flight are ignored when they arrive.
+    m_pendingJobs.clear();
+    m_failedBands.clear();
+    m_imageSize = QSize();
+    m_tileHashes.clear();
+    m_bands.clear();
+    m_bandTexts.clear();
+    m_text.clear();
+}
+
+std::vector<quint64> RegionWatcher::hashTiles(const QImage &image)
+{
+    const int columns = (image.width() + kTileSize - 1) / kTileSize;
+    const int rows = (image.height() + kTileSize - 1) / kTileSize;
+    const int bytesPerPixel = image.depth() / 8;
+    std::vector<quint64> hashes(size_t(columns) * size_t(rows));
+
+    // One streaming hash per tile of the current tile row, fed scanline by
+    // scanline so the image is read in memory order.
+    std::vector<Xxh64> tiles(size_t(columns));
+    for (int ty = 0; ty < rows; ++ty) {
+        for (Xxh64 &tile : tiles)
+            tile.reset();
+
+        const int top = ty * kTileSize;
+        const int bottom = qMin(image.height(), top + kTileSize);
+        for (int y = top; y < bottom; ++y) {
+            const uchar *line = image.constScanLine(y);
+            for (int tx = 0; tx < columns; ++tx) {
+                const int left = tx * kTileSize;
+                const int width = qMin(kTileSize, image.width() - left);
+                tiles[size_t(tx)].update(line + left * bytesPerPixel, size_t(width) * bytesPerPixel);
+            }
+        }
+
+        for (int tx = 0; tx < columns; ++tx)
+            hashes[size_t(ty) * columns + tx] = tiles[size_t(tx)].digest();
+    }
+    return hashes;
+}
+
+void RegionWatcher::poll()
+{
+    // The previous change is still being recognized; the next poll catches up.
+    if (!m_pendingJobs.isEmpty())
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    qreal dpr = 1.0;
+    QImage image = m_backend->grabArea(m_region, &dpr);
+    if (image.isNull()) {
+        stop();
+        emit watchFailed(tr("Failed to capture the watched region."));
+        return;
+    }
+    if (image.format() != QImage::Format_RGB32)
+        image = image.convertToFormat(QImage::Format_RGB32);
+
+    std::vector<quint64> hashes = hashTiles(image);
+    const int columns = (image.width() + kTileSize - 1) / kTileSize;
+    const int rows = (image.height() + kTileSize - 1) / kTileSize;
+
+    // Tile rows with at least one changed tile; all of them on the first poll.
+    const bool sameSize = image.size() == m_imageSize;
+    std::vector<bool> changedRows(size_t(rows), !sameSize);
+    bool changed = !sameSize;
+    if (sameSize) {
+        for (size_t i = 0; i < hashes.size(); ++i) {
+            if (hashes[i] != m_tileHashes[i]) {
+                changedRows[i / size_t(columns)] = true;
+                changed = true;
+            }
+        }
+    }
+
+    ++m_stats.polls;
+    if (!changed && m_failedBands.isEmpty()) {
+        ++m_stats.unchangedPolls;
+        m_stats.pollMs += timer.nsecsElapsed() / 1e6;
+        return;
+    }
+
+    bool sameBands = true;
+    if (changed) {
+        m_imageSize = image.size();
+        m_tileHashes = std::move(hashes);
+
+        GrayImage gray;
+        gray.loadFrom(image, image.rect());
+        const int minHeight = qMax(1, qRound(kMinBandHeight * dpr));
+        const QList<TextBands::Band> bands = TextBands::split(gray, gray.rect(), gray.height() / minHeight,
+                                                              minHeight);
+
+        // A different cut means lines moved; every band is recognized again.
+        sameBands = bands.size() == m_bands.size();
+        for (int i = 0; sameBands && i < bands.size(); ++i)
+            sameBands = bands[i].rect == m_bands[i].rect;
+        if (!sameBands) {
+            m_bands = bands;
+            m_bandTexts.clear();
+            for (int i = 0; i < m_bands.size(); ++i)
+                m_bandTexts.append(QString());
+            m_failedBands.clear();
+        }
+    }
+
+    for (int i = 0; i < m_bands.size(); ++i) {
+        const QRect &rect = m_bands[i].rect;
+        bool dirty = !sameBands || m_failedBands.contains(i);
+        for (int ty = rect.top() / kTileSize; !dirty && ty <= rect.bottom() / kTileSize; ++ty)
+            dirty = changedRows[size_t(ty)];
+        if (!dirty)
+            continue;
+
+        m_failedBands.remove(i);
+        m_pendingJobs.insert(m_ocrService->submit(image, rect), i);
+        ++m_stats.bandsRecognized;
+    }
+    m_stats.pollMs += timer.nsecsElapsed() / 1e6;
+}
+
+void RegionWatcher::onTextReady(quint64 jobId, const QString &text)
+{
+    const auto it = m_pendingJobs.find(jobId);
+    if (it == m_pendingJobs.end())
+        return;
+    const int band = it.value();
+    m_pendingJobs.erase(it);
+    // A band no engine could read keeps its previous text until it is
+    // recognized again on a later poll.
+    if (!m_failedBands.contains(band))
+        m_bandTexts[band] = text;
+    if (!m_pendingJobs.isEmpty())
+        return;
+
+    QString joined;
+    for (int i = 0; i < m_bands.size(); ++i) {
+        if (m_bandTexts[i].isEmpty())
+            continue;
+        if (!joined.isEmpty())
+            joined += m_bands[i].startsParagraph ? QStringLiteral("\n\n") : QStringLiteral("\n");
+        joined += m_bandTexts[i];
+    }
+
+    if (joined == m_text)
+        return;
+    m_text = joined;
+    qCInfo(lcWatch, "text changed: %s", qUtf8Printable(QString(m_text).replace('\n', QStringLiteral(" / "))));
+    emit textChanged(m_text);
+}
+
+QString RegionWatcher::statsReport() const
+{
+    if (m_stats.polls == 0)
+        return tr("Watch mode: not used yet");
+    return tr("Watch mode: %1 polls, %2 unchanged, %3 bands recognized, avg poll %4 ms")
+        .arg(m_stats.polls)
+        .arg(m_stats.unchangedPolls)
+        .arg(m_stats.bandsRecognized)
+        .arg(m_stats.pollMs / m_stats.polls, 0, 'f', 2);
+}
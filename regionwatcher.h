@@ -0,0 +1,88 @@
+#ifndef REGIONWATCHER_H
+#define REGIONWATCHER_H
+
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QObject>
+#include <QRect>
+#include <QSet>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+
+#include "textbands.h"
+
+#include <vector>
+
+class CaptureBackend;
+class OcrService;
+
+// Watch mode: re-grabs a pinned region of the desktop at a fixed interval and
+// keeps its text up to date. Every grab is cut into fixed-size tiles whose
+// hashes are compared with the previous grab; an unchanged region costs one
+// small grab and a hash pass, and only the text bands containing changed
+// tiles are recognized again. textChanged() fires only when the text differs.
+class RegionWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    RegionWatcher(CaptureBackend *backend, OcrService *ocrService, QObject *parent = nullptr);
+
+    void setInterval(int intervalMs);
+    int interval() const { return m_timer.interval(); }
+
+    // region is in virtual desktop coordinates, e.g. a capture's selection.
+    // The first grab happens after delayMs; the watcher is active, and stop()
+    // cancels it, from the call on.
+    void start(const QRect &region, int delayMs = 0);
+    void stop();
+    bool isActive() const { return m_timer.isActive() || m_startTimer.isActive(); }
+    QRect region() const { return m_region; }
+    QString text() const { return m_text; }
+
+    // Polls, how many found nothing changed, bands recognized and the average
+    // cost of a poll.
+    QString statsReport() const;
+
+signals:
+    void textChanged(const QString &text);
+    void watchFailed(const QString &errorMessage);
+
+private:
+    struct Stats
+    {
+        quint64 polls = 0;
+        quint64 unchangedPolls = 0;
+        quint64 bandsRecognized = 0;
+        double pollMs = 0.0;
+    };
+
+    void poll();
+    void onTextReady(quint64 jobId, const QString &text);
+    // Hash of every kTileSize x kTileSize tile of image, row by row.
+    static std::vector<quint64> hashTiles(const QImage &image);
+
+    CaptureBackend *m_backend;
+    OcrService *m_ocrService;
+    QTimer m_timer;
+    QTimer m_startTimer;
+
+    QRect m_region;
+    QSize m_imageSize;
+    std::vector<quint64> m_tileHashes;
+
+    // Bands of the latest grab and their text; jobs in flight map to a band.
+    QList<TextBands::Band> m_bands;
+    QStringList m_bandTexts;
+    QHash<quint64, int> m_pendingJobs;
+    // Bands whose last job no engine could read (OcrJobTimings::failed);
+    // recognized again on the next poll even if their tiles did not change.
+    QSet<int> m_failedBands;
+
+    QString m_text;
+    Stats m_stats;
+};
+
+#endif // REGIONWATCHER_H
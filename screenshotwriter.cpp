@@ -0,0 +1,211 @@
+#include "screenshotwriter.h"
+
+#include "latencytrace.h"
+#include "qoiencoder.h"
+
+#include <QBuffer>
+#include <QDeadlineTimer>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QImageWriter>
+#include <QMutexLocker>
+#include <QThread>
+
+ScreenshotWriter::ScreenshotWriter(QObject *parent)
+    : QObject(parent)
+{
+    m_thread = QThread::create([this]() { writerLoop(); });
+    m_thread->setObjectName(QStringLiteral("ScreenshotWriter"));
+    m_thread->start();
+}
+
+ScreenshotWriter::~ScreenshotWriter()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_notEmpty.wakeAll();
+        m_notFull.wakeAll();
+    }
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+}
+
+void ScreenshotWriter::setFormat(Format format)
+{
+    QMutexLocker locker(&m_mutex);
+    m_format = format;
+}
+
+ScreenshotWriter::Format ScreenshotWriter::format() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_format;
+}
+
+void ScreenshotWriter::setPngCompression(int level)
+{
+    QMutexLocker locker(&m_mutex);
+    m_pngCompression = qBound(0, level, 9);
+}
+
+int ScreenshotWriter::pngCompression() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_pngCompression;
+}
+
+void ScreenshotWriter::setQueueLimit(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_limitBytes = qMax<qint64>(0, bytes);
+    m_notFull.wakeAll();
+}
+
+bool ScreenshotWriter::hasRoomFor(const QImage &image) const
+{
+    if (m_queue.isEmpty() || m_queuedFrames.contains(image.cacheKey()))
+        return true;
+    return m_queuedBytes + image.sizeInBytes() <= m_limitBytes;
+}
+
+bool ScreenshotWriter::enqueue(const QImage &image, const QRect &rect, const QString &directory,
+                               int timeoutMs)
+{
+    if (image.isNull())
+        return false;
+
+    QMutexLocker locker(&m_mutex);
+    if (!hasRoomFor(image) && timeoutMs > 0) {
+        QDeadlineTimer deadline(timeoutMs);
+        while (!m_stopping && !hasRoomFor(image)) {
+            if (!m_notFull.wait(&m_mutex, deadline))
+                break;
+        }
+    }
+    if (m_stopping || !hasRoomFor(image))
+        return false;
+
+    Request request;
+    request.image = image;
+    request.rect = rect;
+    request.directory = directory;
+    request.timestamp = QDateTime::currentDateTime();
+    request.format = m_format;
+    request.pngCompression = m_pngCompression;
+    if (m_queuedFrames[image.cacheKey()]++ == 0)
+        m_queuedBytes += image.sizeInBytes();
+    m_queue.enqueue(request);
+    m_notEmpty.wakeOne();
+    return true;
+}
+
+QString ScreenshotWriter::formatName(Format format)
+{
+    switch (format) {
+    case Format::Png:
+        return QStringLiteral("PNG");
+    case Format::Qoi:
+        return QStringLiteral("QOI");
+    }
+    return {};
+}
+
+void ScreenshotWriter::writerLoop()
+{
+    for (;;) {
+        Request request;
+        {
+            QMutexLocker locker(&m_mutex);
+            while (!m_stopping && m_queue.isEmpty())
+                m_notEmpty.wait(&m_mutex);
+            // Drain what was already accepted before shutting down.
+            if (m_queue.isEmpty())
+                break;
+            request = m_queue.dequeue();
+        }
+        write(request);
+
+        // The frame counts against the limit until its last screenshot is written.
+        QMutexLocker locker(&m_mutex);
+        const auto it = m_queuedFrames.find(request.image.cacheKey());
+        if (it != m_queuedFrames.end() && --it.value() == 0) {
+            m_queuedFrames.erase(it);
+            m_queuedBytes -= request.image.sizeInBytes();
+        }
+        m_notFull.wakeAll();
+    }
+}
+
+void ScreenshotWriter::write(const Request &request)
+{
+    LatencyScope scope(LatencyTrace::Stage::SaveScreenshot);
+
+    QDir dir(request.directory);
+    if (!dir.exists())
+        dir.mkpath(".");
+
+    const QString extension = request.format == Format::Qoi ? QStringLiteral("qoi")
+                                                            : QStringLiteral("png");
+    const QString baseName =
+        QString("snip_%1").arg(request.timestamp.toString("yyyyMMdd_HHmmss_zzz"));
+
+    const QImage image = request.rect.isNull() || request.rect == request.image.rect()
+                             ? request.image
+                             : request.image.copy(request.rect);
+
+    // Encode into memory first, so a failing encoder never leaves an empty
+    // or partial file behind.
+    QElapsedTimer timer;
+    timer.start();
+
+    QByteArray encoded;
+    bool ok = false;
+    if (request.format == Format::Qoi) {
+        encoded = Qoi::encode(image);
+        ok = !encoded.isEmpty();
+    } else {
+        QBuffer buffer(&encoded);
+        buffer.open(QIODevice::WriteOnly);
+        QImageWriter writer(&buffer, "PNG");
+        // Qt's PNG handler maps quality 100..0 onto zlib levels 0..9.
+        writer.setQuality(100 - (request.pngCompression * 91 + 8) / 9);
+        ok = writer.write(image);
+    }
+
+    const double encodeMs = timer.nsecsElapsed() / 1e6;
+
+    QString filePath = dir.filePath(QString("%1.%2").arg(baseName, extension));
+    if (!ok) {
+        emit saveFailed(filePath);
+        return;
+    }
+
+    // NewOnly makes the existence check and the creation atomic, so two saves
+    // in the same millisecond (or another process) never overwrite each other.
+    QFile file;
+    for (int suffix = 1; ; ++suffix) {
+        file.setFileName(filePath);
+        if (file.open(QIODevice::WriteOnly | QIODevice::NewOnly))
+            break;
+        if (!file.exists() || suffix > 999) {
+            emit saveFailed(filePath);
+            return;
+        }
+        filePath = dir.filePath(QString("%1_%2.%3").arg(baseName).arg(suffix).arg(extension));
+    }
+
+    ok = file.write(encoded) == encoded.size();
+    file.close();
+
+    // A short write (e.g. a full disk) removes the partial file.
+    if (!ok) {
+        file.remove();
+        emit saveFailed(filePath);
+        return;
+    }
+
+    emit saved(filePath, encodeMs, encoded.size());
+}
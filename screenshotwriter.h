@@ -0,0 +1,90 @@
+#ifndef SCREENSHOTWRITER_H
+#define SCREENSHOTWRITER_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QQueue>
+#include <QRect>
+#include <QString>
+#include <QWaitCondition>
+
+class QThread;
+
+// Encodes and writes screenshots on a background thread. The queue is bounded
+// by the bytes of the frames it keeps alive: when the writer falls behind,
+// enqueue() refuses (or waits for) new images instead of letting
+// full-resolution frames pile up in memory.
+class ScreenshotWriter : public QObject
+{
+    Q_OBJECT
+public:
+    enum class Format {
+        Png,
+        Qoi
+    };
+
+    explicit ScreenshotWriter(QObject *parent = nullptr);
+    // Finishes the screenshots that are already queued before returning.
+    ~ScreenshotWriter() override;
+
+    void setFormat(Format format);
+    Format format() const;
+    // zlib level 0 (store) .. 9 (smallest); lower levels encode much faster.
+    void setPngCompression(int level);
+    int pngCompression() const;
+    // Most bytes of frames the queue may hold; a frame shared by several
+    // queued screenshots counts once. An empty queue always accepts one.
+    void setQueueLimit(qint64 bytes);
+
+    // Queue rect of image (null means the whole image) to be written into
+    // directory as snip_<timestamp>.<ext>; names never collide with existing
+    // files. The crop happens on the writer thread, so the whole image stays
+    // queued until then. Waits up to timeoutMs for room and returns false if
+    // the queue is still full.
+    bool enqueue(const QImage &image, const QRect &rect, const QString &directory,
+                 int timeoutMs = 0);
+
+    static QString formatName(Format format);
+
+signals:
+    // Emitted from the writer thread; encodeMs covers the encoding only.
+    void saved(const QString &filePath, double encodeMs, qint64 bytes);
+    void saveFailed(const QString &filePath);
+
+private:
+    struct Request
+    {
+        QImage image;
+        QRect rect;
+        QString directory;
+        QDateTime timestamp;
+        Format format = Format::Png;
+        int pngCompression = 0;
+    };
+
+    void writerLoop();
+    void write(const Request &request);
+    // Called with m_mutex held.
+    bool hasRoomFor(const QImage &image) const;
+
+    QThread *m_thread = nullptr;
+
+    // Guards everything below. m_notEmpty wakes the writer, m_notFull the producers.
+    mutable QMutex m_mutex;
+    QWaitCondition m_notEmpty;
+    QWaitCondition m_notFull;
+    QQueue<Request> m_queue;
+    // Queued requests per frame (QImage::cacheKey()) and the bytes of those frames.
+    QHash<qint64, int> m_queuedFrames;
+    qint64 m_queuedBytes = 0;
+    qint64 m_limitBytes = 256 * 1024 * 1024;
+    bool m_stopping = false;
+
+    Format m_format = Format::Png;
+    int m_pngCompression = 1;
+};
+
+#endif // SCREENSHOTWRITER_H
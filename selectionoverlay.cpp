@@ -7,6 +7,28 @@
 #include <QRegion>
 #include <QPushButton>
 #include <QResizeEvent>
+#include <QPaintEvent>
+#include <QScreen>
+#include <QtMath>
+#include <QLoggingCategory>
+
+// QT_LOGGING_RULES="sniptext.overlay.info=true" logs each drag's frame times.
+Q_LOGGING_CATEGORY(lcOverlay, "sniptext.overlay", QtWarningMsg)
+
+// Width of the selection border plus antialiasing slack; everything a border
+// touches lies within this distance of its rectangle.
+static const int kBorderMargin = 3;
+
+static const QColor kDimColor(0, 0, 0, 120);
+
+// The pixels a selection border covers.
+static QRegion borderRegion(const QRect &r)
+{
+    if (r.isNull())
+        return {};
+    return QRegion(r.adjusted(-kBorderMargin, -kBorderMargin, kBorderMargin, kBorderMargin))
+        .subtracted(QRegion(r.adjusted(kBorderMargin, kBorderMargin, -kBorderMargin, -kBorderMargin)));
+}
 
 SelectionOverlay::SelectionOverlay(QWidget *parent)
     : QWidget(parent)
@@ -29,6 +51,11 @@ SelectionOverlay::SelectionOverlay(QWidget *parent)
             emit finishRequested();
         close();
     });
+
+    m_repaintTimer.setSingleShot(true);
+    m_repaintTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_repaintTimer, &QTimer::timeout, this, &SelectionOverlay::flushRepaint);
+    m_sinceFlush.start();
 }
 
 void SelectionOverlay::mousePressEvent(QMouseEvent *e)
@@ -39,6 +66,7 @@ void SelectionOverlay::mousePressEvent(QMouseEvent *e)
     m_origin    = e->pos();
     m_selection = QRect(m_origin, QSize());
     m_dragging  = true;
+    m_frameStats = FrameStats();
     update();
 }
 
@@ -47,8 +75,47 @@ void SelectionOverlay::mouseMoveEvent(QMouseEvent *e)
     if (!m_dragging)
         return;
 
-    m_selection = QRect(m_origin, e->pos());
-    update();
+    setLiveSelection(QRect(m_origin, e->pos()));
+    emit selectionChanged(m_selection.normalized().translated(geometry().topLeft()));
+}
+
+void SelectionOverlay::setLiveSelection(const QRect &selection)
+{
+    const QRect previous = m_selection.normalized();
+    m_selection = selection;
+    const QRect current = m_selection.normalized();
+
+    // Only the area whose dimming flips and the two borders change.
+    scheduleRepaint(QRegion(previous).xored(QRegion(current))
+                        .united(borderRegion(previous))
+                        .united(borderRegion(current)));
+}
+
+void SelectionOverlay::addCompletedSelection(const QRect &selection)
+{
+    m_completedSelections.append(selection);
+    m_completedRegion = m_completedRegion.united(selection);
+}
+
+void SelectionOverlay::showPeerSelection(const QRect &rect)
+{
+    if (m_dragging)
+        return;
+    setLiveSelection(rect.isNull() ? QRect() : rect.translated(-geometry().topLeft()));
+}
+
+void SelectionOverlay::addPeerSelection(const QRect &rect)
+{
+    const QRect previous = m_selection.normalized();
+    const QRect local = rect.translated(-geometry().topLeft());
+    // Repaint what the last moves dirtied now rather than dropping it.
+    m_repaintTimer.stop();
+    flushRepaint();
+    m_selection = QRect();
+    if (m_multiSelection)
+        addCompletedSelection(local);
+    update(QRegion(previous).united(borderRegion(previous))
+               .united(borderRegion(local)).united(local));
 }
 
 void SelectionOverlay::mouseReleaseEvent(QMouseEvent *e)
@@ -57,16 +124,23 @@ void SelectionOverlay::mouseReleaseEvent(QMouseEvent *e)
         return;
 
     m_dragging = false;
+    // Repaint what the last moves dirtied now rather than dropping it.
+    m_repaintTimer.stop();
+    flushRepaint();
+    reportFrameTimes();
+
+    const QRect previous = m_selection.normalized();
     m_selection = QRect(m_origin, e->pos()).normalized();
 
     if (m_selection.width() > 0 && m_selection.height() > 0) {
-        m_completedSelections.append(m_selection);
-        emit selectionFinished(m_selection);
+        addCompletedSelection(m_selection);
+        emit selectionFinished(m_selection.translated(geometry().topLeft()));
         if (!m_multiSelection) {
             close();
         } else {
+            update(QRegion(previous).united(borderRegion(previous))
+                       .united(borderRegion(m_selection)).united(m_selection));
             m_selection = QRect();
-            update();
         }
     } else {
         if (!m_multiSelection) {
@@ -75,6 +149,7 @@ void SelectionOverlay::mouseReleaseEvent(QMouseEvent *e)
         } else {
             m_selection = QRect();
             update();
+            emit selectionChanged(QRect());
         }
     }
 }
@@ -95,31 +170,29 @@ void SelectionOverlay::resizeEvent(QResizeEvent *event)
     updateFinishButtonPosition();
 }
 
-void SelectionOverlay::paintEvent(QPaintEvent *)
+void SelectionOverlay::paintEvent(QPaintEvent *event)
 {
+    QElapsedTimer paintTimer;
+    paintTimer.start();
+
+    // Everything outside the event region is still on screen from the last
+    // frame, so only that part is painted.
+    const QRegion dirty = event->region();
     QPainter p(this);
+    p.setClipRegion(dirty);
     p.setRenderHint(QPainter::Antialiasing, true);
 
+    if (!m_background.isNull())
+        p.drawImage(0, 0, m_background);
+
     // Show the live desktop dimmed everywhere except the selected rectangles so
     // the user can keep track of areas they've already captured.
-    QRegion clearRegion;
     const QRect sel = m_selection.normalized();
+    QRegion dimmed = dirty.subtracted(m_completedRegion);
     if (!sel.isNull())
-        clearRegion = clearRegion.united(QRegion(sel));
-
-    for (const QRect &stored : m_completedSelections)
-        clearRegion = clearRegion.united(QRegion(stored));
-
-    if (clearRegion.isEmpty()) {
-        p.fillRect(rect(), QColor(0, 0, 0, 120));
-    } else {
-        QRegion outside(rect());
-        outside = outside.subtracted(clearRegion);
-        p.save();
-        p.setClipRegion(outside);
-        p.fillRect(rect(), QColor(0, 0, 0, 120));
-        p.restore();
-    }
+        dimmed = dimmed.subtracted(QRegion(sel));
+    for (const QRect &r : dimmed)
+        p.fillRect(r, kDimColor);
 
     auto drawRect = [&p, this](const QRect &r) {
         if (r.isNull())
@@ -129,10 +202,100 @@ void SelectionOverlay::paintEvent(QPaintEvent *)
         p.drawRect(r.adjusted(0, 0, -1, -1));
     };
 
-    for (const QRect &stored : m_completedSelections)
-        drawRect(stored);
+    const QRect bounds = dirty.boundingRect().adjusted(-kBorderMargin, -kBorderMargin,
+                                                       kBorderMargin, kBorderMargin);
+    for (const QRect &stored : std::as_const(m_completedSelections)) {
+        if (stored.intersects(bounds))
+            drawRect(stored);
+    }
 
     drawRect(sel);
+
+    if (m_dragging) {
+        if (m_frameStats.sinceFrame.isValid()) {
+            const double interval = m_frameStats.sinceFrame.nsecsElapsed() / 1e6;
+            ++m_frameStats.frames;
+            m_frameStats.totalIntervalMs += interval;
+            m_frameStats.worstIntervalMs = qMax(m_frameStats.worstIntervalMs, interval);
+        }
+        m_frameStats.sinceFrame.start();
+        m_frameStats.totalPaintMs += paintTimer.nsecsElapsed() / 1e6;
+    }
+
+    if (m_showFrameTimes && dirty.intersects(frameTimesRect())) {
+        const int frames = qMax(1, m_frameStats.frames);
+        const QString text = tr("%1 frames, avg %2 ms, worst %3 ms, paint %4 ms")
+                                 .arg(m_frameStats.frames)
+                                 .arg(m_frameStats.totalIntervalMs / frames, 0, 'f', 1)
+                                 .arg(m_frameStats.worstIntervalMs, 0, 'f', 1)
+                                 .arg(m_frameStats.totalPaintMs / frames, 0, 'f', 2);
+        p.fillRect(frameTimesRect(), QColor(0, 0, 0, 200));
+        p.setPen(Qt::white);
+        p.drawText(frameTimesRect().adjusted(8, 0, -8, 0), Qt::AlignVCenter | Qt::AlignLeft, text);
+    }
+}
+
+void SelectionOverlay::scheduleRepaint(const QRegion &dirty)
+{
+    m_pendingDirty = m_pendingDirty.united(dirty);
+    if (m_showFrameTimes)
+        m_pendingDirty = m_pendingDirty.united(frameTimesRect());
+
+    // Mouse events can arrive far faster than the display refreshes; collect
+    // them and repaint once per refresh interval.
+    if (m_repaintTimer.isActive())
+        return;
+    const qint64 wait = frameIntervalMs() - m_sinceFlush.elapsed();
+    if (wait <= 0)
+        flushRepaint();
+    else
+        m_repaintTimer.start(int(wait));
+}
+
+void SelectionOverlay::flushRepaint()
+{
+    if (m_pendingDirty.isEmpty())
+        return;
+    update(m_pendingDirty);
+    m_pendingDirty = QRegion();
+    m_sinceFlush.restart();
+}
+
+int SelectionOverlay::frameIntervalMs() const
+{
+    const QScreen *s = screen();
+    const qreal hz = s ? s->refreshRate() : 60.0;
+    return qMax(1, qFloor(1000.0 / (hz > 1.0 ? hz : 60.0)));
+}
+
+QRect SelectionOverlay::frameTimesRect() const
+{
+    return QRect(16, 16, 420, 28);
+}
+
+void SelectionOverlay::reportFrameTimes()
+{
+    if (!m_showFrameTimes || m_frameStats.frames == 0)
+        return;
+
+    const int frames = m_frameStats.frames;
+    qCInfo(lcOverlay, "%d frames, avg %.1f ms, worst %.1f ms, paint avg %.2f ms",
+           frames, m_frameStats.totalIntervalMs / frames, m_frameStats.worstIntervalMs,
+           m_frameStats.totalPaintMs / frames);
+}
+
+void SelectionOverlay::setShowFrameTimes(bool show)
+{
+    m_showFrameTimes = show;
+    update(frameTimesRect());
+}
+
+void SelectionOverlay::setBackground(const QImage &background)
+{
+    m_background = background;
+    setAttribute(Qt::WA_TranslucentBackground, m_background.isNull());
+    setAttribute(Qt::WA_OpaquePaintEvent, !m_background.isNull());
+    update();
 }
 
 void SelectionOverlay::setColor(const QColor &newColor)
@@ -146,6 +309,7 @@ void SelectionOverlay::setMultiSelectionEnabled(bool enabled)
     m_finishButton->setVisible(enabled);
     updateFinishButtonPosition();
     m_completedSelections.clear();
+    m_completedRegion = QRegion();
     m_selection = QRect();
     update();
 }
@@ -154,8 +318,12 @@ void SelectionOverlay::removeLastSelection()
 {
     if (m_completedSelections.isEmpty())
         return;
-    m_completedSelections.removeLast();
-    update();
+    const QRect removed = m_completedSelections.takeLast();
+    // Overlapping selections make subtraction wrong; removal is rare, so rebuild.
+    m_completedRegion = QRegion();
+    for (const QRect &stored : std::as_const(m_completedSelections))
+        m_completedRegion = m_completedRegion.united(stored);
+    update(QRegion(removed).united(borderRegion(removed)));
 }
 
 void SelectionOverlay::updateFinishButtonPosition()
@@ -5,7 +5,11 @@
 #include <QRect>
 #include <QPoint>
 #include <QColor>
+#include <QElapsedTimer>
+#include <QImage>
 #include <QList>
+#include <QRegion>
+#include <QTimer>
 
 class QPushButton;
 class SelectionOverlay : public QWidget
@@ -17,8 +21,21 @@ public:
     void setMultiSelectionEnabled(bool enabled);
     bool multiSelectionEnabled() const { return m_multiSelection; }
     void removeLastSelection();
+    // Draws frame-time statistics of the current drag in the top-left corner.
+    void setShowFrameTimes(bool show);
+    // Paints this frame under the dimming instead of letting the live desktop
+    // show through. A null image restores the translucent overlay.
+    void setBackground(const QImage &background);
+
+    // An overlay covers one screen. Selections dragged on another screen's
+    // overlay are mirrored here so a selection can span monitors; rects are in
+    // virtual desktop coordinates and a null rect clears the live selection.
+    void showPeerSelection(const QRect &rect);
+    void addPeerSelection(const QRect &rect);
 
 signals:
+    // Rects are in virtual desktop coordinates.
+    void selectionChanged(const QRect &rect);
     void selectionFinished(const QRect &rect);
     void selectionCanceled();
     void finishRequested();
@@ -39,8 +56,38 @@ private:
     QPushButton *m_finishButton;
     bool m_multiSelection;
     QList<QRect> m_completedSelections;
+    // Union of m_completedSelections, kept up to date as selections are
+    // added so painting never rebuilds it.
+    QRegion m_completedRegion;
+    QImage m_background;
+
+    // Repaints during a drag cover only what changed and are flushed at most
+    // once per display refresh.
+    QRegion m_pendingDirty;
+    QTimer m_repaintTimer;
+    QElapsedTimer m_sinceFlush;
+
+    // Frame-time counter for the current drag.
+    struct FrameStats
+    {
+        int frames = 0;
+        double totalIntervalMs = 0.0;
+        double worstIntervalMs = 0.0;
+        double totalPaintMs = 0.0;
+        QElapsedTimer sinceFrame;
+    };
+    FrameStats m_frameStats;
+    bool m_showFrameTimes = false;
 
     void updateFinishButtonPosition();
+    void setLiveSelection(const QRect &selection);
+    void addCompletedSelection(const QRect &selection);
+    void scheduleRepaint(const QRegion &dirty);
+    void flushRepaint();
+    int frameIntervalMs() const;
+    QRect frameTimesRect() const;
+    // Logs the drag's frame times to sniptext.overlay when they are shown.
+    void reportFrameTimes();
 };
 
 #endif // SELECTIONOVERLAY_H
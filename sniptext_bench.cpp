@@ -0,0 +1,444 @@
+// Microbenchmarks for the capture -> conversion -> OCR -> encode path.
+//
+// Renders synthetic text frames offscreen with QPainter at 1080p/4K/5K and
+// device pixel ratios 1/2/3, then times every stage on its own and prints the
+// results as JSON so two runs can be diffed. Runs headless on Linux: the
+// offscreen platform is selected automatically when no display is available.
+// With --capture it times the screen-capture backends instead, which needs a
+// display (e.g. xvfb-run).
+
+#include "capturebackend.h"
+#include "grayimage.h"
+#include "imagekernels.h"
+#include "imagepreprocessor.h"
+#include "qoiencoder.h"
+
+#include <QBuffer>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFont>
+#include <QGuiApplication>
+#include <QImage>
+#include <QImageWriter>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPainter>
+#include <QRect>
+#include <QScreen>
+#include <QSysInfo>
+#include <QTextStream>
+
+#include <tesseract/baseapi.h>
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifndef DEFAULT_TESSDATA_PATH
+#define DEFAULT_TESSDATA_PATH ""
+#endif
+
+namespace {
+
+struct Resolution
+{
+    const char *name;
+    int width;
+    int height;
+};
+
+const Resolution kResolutions[] = {
+    {"1080p", 1920, 1080},
+    {"4k", 3840, 2160},
+    {"5k", 5120, 2880},
+};
+
+const int kDprs[] = {1, 2, 3};
+
+const char *const kSampleLines[] = {
+    "The quick brown fox jumps over the lazy dog 0123456789.",
+    "error: undefined reference to `OcrService::extractText(QImage const&)'",
+    "Settings > Preprocessing > Sauvola Binarization (window 25, k 0.2)",
+    "[2026-10-17 09:41:07] INFO capture finished in 184 ms, 3 regions",
+    "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod.",
+    "$ cmake --build build -j16 && ctest --output-on-failure",
+};
+
+// Desktop-like frame: light background covered with lines of UI-sized text.
+// Glyphs are 14 logical pixels high, i.e. 14 * dpr physical pixels.
+QImage renderFrame(int width, int height, int dpr)
+{
+    QImage frame(width, height, QImage::Format_RGB32);
+    frame.fill(QColor(250, 250, 247));
+
+    QPainter painter(&frame);
+    painter.setRenderHint(QPainter::TextAntialiasing, true);
+    QFont font(QStringLiteral("Sans Serif"));
+    font.setPixelSize(14 * dpr);
+    painter.setFont(font);
+    painter.setPen(QColor(30, 30, 30));
+
+    const int lineHeight = 22 * dpr;
+    const int lineCount = int(sizeof(kSampleLines) / sizeof(kSampleLines[0]));
+    int line = 0;
+    for (int y = lineHeight; y < height; y += lineHeight, ++line) {
+        for (int x = 12 * dpr; x < width; x += width / 2)
+            painter.drawText(x, y, QString::fromLatin1(kSampleLines[(line + x) % lineCount]));
+    }
+    return frame;
+}
+
+struct Timing
+{
+    int iterations = 0;
+    double minMs = 0.0;
+    double medianMs = 0.0;
+    double meanMs = 0.0;
+    double maxMs = 0.0;
+};
+
+// Runs fn at least minIterations times and until minSeconds have passed.
+// fn returns the time of the part that should be measured, in ms.
+Timing measure(const std::function<double()> &fn, int minIterations, double minSeconds)
+{
+    std::vector<double> samples;
+    QElapsedTimer total;
+    total.start();
+    while (int(samples.size()) < minIterations || total.nsecsElapsed() / 1e9 < minSeconds) {
+        samples.push_back(fn());
+        if (samples.size() >= 1000)
+            break;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    Timing t;
+    t.iterations = int(samples.size());
+    t.minMs = samples.front();
+    t.maxMs = samples.back();
+    t.medianMs = samples[samples.size() / 2];
+    double sum = 0.0;
+    for (double s : samples)
+        sum += s;
+    t.meanMs = sum / samples.size();
+    return t;
+}
+
+template <typename Fn>
+double timed(Fn &&fn)
+{
+    QElapsedTimer timer;
+    timer.start();
+    fn();
+    return timer.nsecsElapsed() / 1e6;
+}
+
+class Bench
+{
+public:
+    Bench(int minIterations, double minSeconds)
+        : m_minIterations(minIterations)
+        , m_minSeconds(minSeconds)
+    {
+    }
+
+    void setContext(const Resolution &resolution, int dpr, const QString &selection, const QSize &size)
+    {
+        m_resolution = resolution;
+        m_dpr = dpr;
+        m_selection = selection;
+        m_size = size;
+    }
+
+    void run(const QString &stage, const std::function<double()> &fn, int minIterations = 0)
+    {
+        const Timing t = measure(fn, minIterations > 0 ? minIterations : m_minIterations, m_minSeconds);
+        QJsonObject result;
+        result.insert(QStringLiteral("stage"), stage);
+        result.insert(QStringLiteral("resolution"), QString::fromLatin1(m_resolution.name));
+        result.insert(QStringLiteral("dpr"), m_dpr);
+        result.insert(QStringLiteral("selection"), m_selection);
+        result.insert(QStringLiteral("width"), m_size.width());
+        result.insert(QStringLiteral("height"), m_size.height());
+        result.insert(QStringLiteral("iterations"), t.iterations);
+        result.insert(QStringLiteral("min_ms"), t.minMs);
+        result.insert(QStringLiteral("median_ms"), t.medianMs);
+        result.insert(QStringLiteral("mean_ms"), t.meanMs);
+        result.insert(QStringLiteral("max_ms"), t.maxMs);
+        m_results.append(result);
+
+        QTextStream(stderr) << m_resolution.name << " dpr" << m_dpr << ' ' << m_selection << ' '
+                            << stage << ": " << QString::number(t.medianMs, 'f', 3) << " ms median"
+                            << Qt::endl;
+    }
+
+    QJsonArray results() const { return m_results; }
+
+private:
+    int m_minIterations;
+    double m_minSeconds;
+    Resolution m_resolution = kResolutions[0];
+    int m_dpr = 1;
+    QString m_selection;
+    QSize m_size;
+    QJsonArray m_results;
+};
+
+void benchImageStages(Bench &bench, const QImage &frame, const QRect &rect)
+{
+    QImage sink;
+    GrayImage gray;
+
+    bench.run(QStringLiteral("crop_qimage_copy"), [&]() {
+        return timed([&]() { sink = frame.copy(rect); });
+    });
+    const QImage cropped = frame.copy(rect);
+
+    bench.run(QStringLiteral("gray_qimage_convert"), [&]() {
+        return timed([&]() { sink = cropped.convertToFormat(QImage::Format_Grayscale8); });
+    });
+    bench.run(QStringLiteral("crop_gray_fused"), [&]() {
+        return timed([&]() { gray.loadFrom(frame, rect); });
+    });
+
+    gray.loadFrom(frame, rect);
+    GrayImage work;
+    ImagePreprocessor preprocessor;
+    PreprocessOptions options;
+    options.normalizeContrast = true;
+    options.fixPolarity = true;
+    options.denoise = true;
+    for (const auto binarization : {PreprocessOptions::Binarization::Otsu,
+                                    PreprocessOptions::Binarization::Sauvola}) {
+        options.binarization = binarization;
+        preprocessor.setOptions(options);
+        const QString name = binarization == PreprocessOptions::Binarization::Otsu
+                                 ? QStringLiteral("preprocess_otsu")
+                                 : QStringLiteral("preprocess_sauvola");
+        bench.run(name, [&]() {
+            work.resize(gray.width(), gray.height());
+            for (int y = 0; y < gray.height(); ++y)
+                std::copy_n(gray.constScanLine(y), gray.width(), work.scanLine(y));
+            return timed([&]() { preprocessor.process(work); });
+        });
+    }
+
+    bench.run(QStringLiteral("text_scale_estimate"), [&]() {
+        return timed([&]() { ImagePreprocessor::estimateXHeight(gray, gray.rect()); });
+    });
+    for (const double scale : {0.5, 2.0}) {
+        bench.run(QStringLiteral("resample_x%1").arg(scale), [&]() {
+            work.resize(qRound(gray.width() * scale), qRound(gray.height() * scale));
+            return timed([&]() {
+                ImageKernels::resample(gray.constBits(), gray.bytesPerLine(), gray.width(), gray.height(),
+                                       work.bits(), work.bytesPerLine(), work.width(), work.height());
+            });
+        });
+    }
+
+    for (const int level : {1, 6}) {
+        bench.run(QStringLiteral("encode_png_z%1").arg(level), [&]() {
+            QByteArray bytes;
+            QBuffer buffer(&bytes);
+            buffer.open(QIODevice::WriteOnly);
+            QImageWriter writer(&buffer, "PNG");
+            writer.setQuality(100 - (level * 91 + 8) / 9);
+            return timed([&]() { writer.write(cropped); });
+        }, 3);
+    }
+    bench.run(QStringLiteral("encode_qoi"), [&]() {
+        return timed([&]() { Qoi::encode(cropped); });
+    }, 3);
+}
+
+void benchOcrStages(Bench &bench, tesseract::TessBaseAPI &api, const QImage &frame, const QRect &rect,
+                    int ocrIterations)
+{
+    GrayImage gray;
+    gray.loadFrom(frame, rect);
+
+    bench.run(QStringLiteral("tess_set_image"), [&]() {
+        const double ms = timed([&]() {
+            api.SetImage(gray.constBits(), gray.width(), gray.height(), 1, int(gray.bytesPerLine()));
+        });
+        api.Clear();
+        return ms;
+    });
+
+    bench.run(QStringLiteral("tess_get_utf8_text"), [&]() {
+        api.SetImage(gray.constBits(), gray.width(), gray.height(), 1, int(gray.bytesPerLine()));
+        const double ms = timed([&]() { delete [] api.GetUTF8Text(); });
+        api.Clear();
+        return ms;
+    }, ocrIterations);
+}
+
+// Times every available capture backend on the primary screen, for a
+// paragraph-sized region and the whole screen. Returns false if a backend's
+// region differs from what the Qt backend reads.
+bool benchCapture(Bench &bench)
+{
+    QScreen *screen = QGuiApplication::primaryScreen();
+    if (!screen)
+        return false;
+
+    const QRect full(QPoint(0, 0), screen->geometry().size());
+    const QSize regionSize(qMin(full.width(), 400), qMin(full.height(), 120));
+    const QRect region(QPoint((full.width() - regionSize.width()) / 2,
+                              (full.height() - regionSize.height()) / 2),
+                       regionSize);
+    const QByteArray screenName = QStringLiteral("screen_%1x%2").arg(full.width()).arg(full.height()).toLatin1();
+    const Resolution resolution = {screenName.constData(), full.width(), full.height()};
+    const int dpr = qRound(screen->devicePixelRatio());
+
+    const QImage reference = QtCaptureBackend::grabScreen(screen, region)
+                                 .convertToFormat(QImage::Format_RGB32);
+    bool match = true;
+    const QStringList names = CaptureBackend::availableBackends();
+    for (const QString &name : names) {
+        const std::unique_ptr<CaptureBackend> backend = CaptureBackend::create(name);
+        QImage sink;
+
+        bench.setContext(resolution, dpr, QStringLiteral("region"), region.size());
+        bench.run(QStringLiteral("grab_") + name, [&]() {
+            return timed([&]() { sink = backend->grab(screen, region); });
+        });
+        if (sink.convertToFormat(QImage::Format_RGB32) != reference) {
+            QTextStream(stderr) << "sniptext_bench: " << name << " grab differs from qt" << Qt::endl;
+            match = false;
+        }
+
+        bench.setContext(resolution, dpr, QStringLiteral("full"), full.size());
+        bench.run(QStringLiteral("grab_") + name, [&]() {
+            return timed([&]() { sink = backend->grab(screen, full); });
+        });
+    }
+    return match;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+#if defined(Q_OS_LINUX)
+    // Render fonts without a display server unless a platform was requested.
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")
+        && !qEnvironmentVariableIsSet("DISPLAY")
+        && !qEnvironmentVariableIsSet("WAYLAND_DISPLAY")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+#endif
+#ifdef _OPENMP
+    // Measure single-threaded Tesseract, as each OcrService engine runs.
+    omp_set_num_threads(1);
+#endif
+
+    QGuiApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("SnipText stage microbenchmarks (JSON output)."));
+    parser.addHelpOption();
+    const QCommandLineOption outOption({QStringLiteral("o"), QStringLiteral("out")},
+        QStringLiteral("Write the JSON report to <file> instead of stdout."), QStringLiteral("file"));
+    const QCommandLineOption quickOption(QStringLiteral("quick"),
+        QStringLiteral("Only 1080p at DPR 1 and 2."));
+    const QCommandLineOption noOcrOption(QStringLiteral("no-ocr"),
+        QStringLiteral("Skip the Tesseract stages."));
+    const QCommandLineOption tessdataOption(QStringLiteral("tessdata"),
+        QStringLiteral("Directory containing the traineddata files."),
+        QStringLiteral("path"), QString::fromUtf8(DEFAULT_TESSDATA_PATH));
+    const QCommandLineOption langOption(QStringLiteral("lang"),
+        QStringLiteral("Tesseract language (default: eng)."), QStringLiteral("lang"), QStringLiteral("eng"));
+    const QCommandLineOption iterationsOption(QStringLiteral("iterations"),
+        QStringLiteral("Minimum iterations per stage (default: 5)."), QStringLiteral("N"), QStringLiteral("5"));
+    const QCommandLineOption captureOption(QStringLiteral("capture"),
+        QStringLiteral("Time the screen-capture backends on the primary screen instead (needs a display)."));
+    parser.addOptions({outOption, quickOption, noOcrOption, tessdataOption, langOption, iterationsOption,
+                       captureOption});
+    parser.process(app);
+
+    const int minIterations = qMax(1, parser.value(iterationsOption).toInt());
+    Bench bench(minIterations, 0.2);
+
+    const bool capture = parser.isSet(captureOption);
+    bool captureMatch = true;
+    if (capture)
+        captureMatch = benchCapture(bench);
+
+    tesseract::TessBaseAPI api;
+    bool ocr = !capture && !parser.isSet(noOcrOption);
+    if (ocr) {
+        const QByteArray dataPath = parser.value(tessdataOption).toUtf8();
+        const QByteArray lang = parser.value(langOption).toUtf8();
+        if (api.Init(dataPath.constData(), lang.constData()) != 0) {
+            QTextStream(stderr) << "sniptext_bench: Tesseract init failed, skipping OCR stages" << Qt::endl;
+            ocr = false;
+        }
+    }
+
+    for (const Resolution &resolution : kResolutions) {
+        if (capture)
+            break;
+        for (const int dpr : kDprs) {
+            if (parser.isSet(quickOption) && (resolution.width > 1920 || dpr > 2))
+                continue;
+
+            const QImage frame = renderFrame(resolution.width, resolution.height, dpr);
+
+            // A typical snip: a paragraph of 400x120 logical pixels near the middle.
+            const QSize regionSize(qMin(frame.width(), 400 * dpr), qMin(frame.height(), 120 * dpr));
+            const QRect region(QPoint((frame.width() - regionSize.width()) / 2,
+                                      (frame.height() - regionSize.height()) / 2),
+                               regionSize);
+
+            bench.setContext(resolution, dpr, QStringLiteral("region"), region.size());
+            benchImageStages(bench, frame, region);
+            if (ocr)
+                benchOcrStages(bench, api, frame, region, minIterations);
+
+            // The whole screen, once per resolution: the DPR only changes the text size.
+            if (dpr == 1) {
+                bench.setContext(resolution, dpr, QStringLiteral("full"), frame.size());
+                benchImageStages(bench, frame, frame.rect());
+                if (ocr)
+                    benchOcrStages(bench, api, frame, frame.rect(), 1);
+            }
+        }
+    }
+    if (ocr)
+        api.End();
+
+    QJsonObject report;
+    report.insert(QStringLiteral("benchmark"), QStringLiteral("sniptext_bench"));
+    report.insert(QStringLiteral("isa"), QString::fromLatin1(ImageKernels::instructionSet()));
+    report.insert(QStringLiteral("cpu"), QSysInfo::currentCpuArchitecture());
+    report.insert(QStringLiteral("os"), QSysInfo::prettyProductName());
+    report.insert(QStringLiteral("qt"), QString::fromLatin1(qVersion()));
+    report.insert(QStringLiteral("tesseract"), QString::fromLatin1(tesseract::TessBaseAPI::Version()));
+    if (capture) {
+        report.insert(QStringLiteral("capture_backends"),
+                      QJsonArray::fromStringList(CaptureBackend::availableBackends()));
+        report.insert(QStringLiteral("capture_match"), captureMatch);
+    }
+    report.insert(QStringLiteral("results"), bench.results());
+    const QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+
+    if (parser.isSet(outOption)) {
+        QFile out(parser.value(outOption));
+        if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            QTextStream(stderr) << "sniptext_bench: cannot write " << out.fileName() << Qt::endl;
+            return 1;
+        }
+        out.write(json);
+    } else {
+        QFile out;
+        out.open(stdout, QIODevice::WriteOnly);
+        out.write(json);
+    }
+    return captureMatch ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+#include "textbands.h"
+
+#include "grayimage.h"
+#include "imagekernels.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+struct Gutter
+{
+    int begin = 0;
+    int end = 0; // exclusive
+    int height() const { return end - begin; }
+    int center() const { return (begin + end) / 2; }
+};
+
+} // namespace
+
+QList<TextBands::Band> TextBands::split(const GrayImage &gray, const QRect &region,
+                                        int maxBands, int minHeight)
+{
+    const QRect area = region.isNull() ? gray.rect() : region.intersected(gray.rect());
+    QList<Band> bands;
+    bands.append({area, false});
+
+    minHeight = qMax(1, minHeight);
+    const int count = qMin(maxBands, area.height() / minHeight);
+    if (count < 2)
+        return bands;
+
+    const int width = area.width();
+    const int height = area.height();
+    const qsizetype stride = gray.bytesPerLine();
+    const uchar *origin = gray.constScanLine(area.top()) + area.left();
+
+    quint32 hist[256];
+    ImageKernels::histogram(origin, stride, width, height, hist);
+    const int threshold = ImageKernels::otsuThreshold(hist);
+
+    std::vector<quint32> rows(size_t(height));
+    ImageKernels::inkProjection(origin, stride, width, height, threshold, rows.data(), nullptr);
+
+    // Ink is the minority class, whatever the polarity.
+    quint64 dark = 0;
+    for (const quint32 ink : rows)
+        dark += ink;
+    if (dark * 2 > quint64(width) * quint64(height)) {
+        for (quint32 &ink : rows)
+            ink = quint32(width) - ink;
+    }
+
+    // Blank runs between the first and the last inked row. A single ink pixel
+    // makes a row part of a line, so cuts never touch a glyph.
+    std::vector<Gutter> gutters;
+    int lastInk = -1;
+    for (int y = 0; y < height; ++y) {
+        if (rows[size_t(y)] == 0)
+            continue;
+        if (lastInk >= 0 && y - lastInk > 1)
+            gutters.push_back({lastInk + 1, y});
+        lastInk = y;
+    }
+    if (gutters.empty())
+        return bands;
+
+    // Wider than the usual gap between two lines means a paragraph break.
+    std::vector<int> heights;
+    heights.reserve(gutters.size());
+    for (const Gutter &gutter : gutters)
+        heights.push_back(gutter.height());
+    std::nth_element(heights.begin(), heights.begin() + heights.size() / 2, heights.end());
+    const int lineGap = heights[heights.size() / 2];
+
+    // One cut per even split point, at the nearest gutter that keeps both
+    // neighbours at least minHeight tall.
+    std::vector<const Gutter *> cuts;
+    int previous = 0;
+    for (int k = 1; k < count; ++k) {
+        const int target = k * height / count;
+        const Gutter *best = nullptr;
+        for (const Gutter &gutter : gutters) {
+            const int cut = gutter.center();
+            if (cut - previous < minHeight || height - cut < minHeight)
+                continue;
+            if (!best || qAbs(cut - target) < qAbs(best->center() - target))
+                best = &gutter;
+        }
+        if (!best)
+            break;
+        cuts.push_back(best);
+        previous = best->center();
+    }
+    if (cuts.empty())
+        return bands;
+
+    bands.clear();
+    int top = 0;
+    bool paragraph = false;
+    for (const Gutter *cut : cuts) {
+        bands.append({QRect(area.left(), area.top() + top, width, cut->center() - top), paragraph});
+        top = cut->center();
+        paragraph = cut->height() > lineGap + lineGap / 2;
+    }
+    bands.append({QRect(area.left(), area.top() + top, width, height - top), paragraph});
+    return bands;
+}
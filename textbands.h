@@ -0,0 +1,29 @@
+#ifndef TEXTBANDS_H
+#define TEXTBANDS_H
+
+#include <QList>
+#include <QRect>
+
+class GrayImage;
+
+// Splits tall captures into horizontal bands that can be recognized
+// independently. Cuts are only made through rows without any ink, so no text
+// line is ever divided between two bands.
+namespace TextBands {
+
+struct Band
+{
+    QRect rect;
+    // The gap above the band is wider than the usual line spacing.
+    bool startsParagraph = false;
+};
+
+// Cuts region of gray into at most maxBands bands of roughly equal height,
+// none shorter than minHeight, at the blank gutter nearest to each even split
+// point. Returns the whole region as a single band when there is no usable
+// gutter.
+QList<Band> split(const GrayImage &gray, const QRect &region, int maxBands, int minHeight);
+
+} // namespace TextBands
+
+#endif // TEXTBANDS_H
@@ -0,0 +1,66 @@
+#include "traineddatastore.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+TrainedData::~TrainedData()
+{
+    if (m_file && m_data)
+        m_file->unmap(m_data);
+}
+
+QString TrainedData::filePath() const
+{
+    return m_file ? m_file->fileName() : QString();
+}
+
+TrainedDataStore &TrainedDataStore::instance()
+{
+    static TrainedDataStore store;
+    return store;
+}
+
+std::shared_ptr<const TrainedData> TrainedDataStore::acquire(const QString &dataPath,
+                                                             const QString &language)
+{
+    const QString filePath = QDir(dataPath).filePath(language + QStringLiteral(".traineddata"));
+    const QFileInfo info(filePath);
+    if (!info.isFile())
+        return nullptr;
+
+    QMutexLocker locker(&m_mutex);
+    const QString key = info.absoluteFilePath();
+    const auto it = m_files.constFind(key);
+    if (it != m_files.constEnd()) {
+        const std::shared_ptr<TrainedData> &cached = it.value();
+        if (cached->m_size == info.size() && cached->m_modified == info.lastModified())
+            return cached;
+    }
+
+    std::shared_ptr<TrainedData> mapped(new TrainedData);
+    mapped->m_file = std::make_unique<QFile>(key);
+    if (!mapped->m_file->open(QIODevice::ReadOnly))
+        return nullptr;
+    mapped->m_size = mapped->m_file->size();
+    mapped->m_data = mapped->m_file->map(0, mapped->m_size);
+    if (!mapped->m_data)
+        return nullptr;
+    mapped->m_modified = info.lastModified();
+
+    // Engines still holding an outdated mapping keep it alive until they are done.
+    m_files.insert(key, mapped);
+    return mapped;
+}
+
+void TrainedDataStore::releaseUnused()
+{
+    QMutexLocker locker(&m_mutex);
+    for (auto it = m_files.begin(); it != m_files.end();) {
+        if (it.value().use_count() == 1)
+            it = m_files.erase(it);
+        else
+            ++it;
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef TRAINEDDATASTORE_H
+#define TRAINEDDATASTORE_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+#include <memory>
+
+class QFile;
+
+// Read-only memory map of one <language>.traineddata file.
+class TrainedData
+{
+public:
+    ~TrainedData();
+
+    const char *data() const { return reinterpret_cast<const char *>(m_data); }
+    qint64 size() const { return m_size; }
+    QString filePath() const;
+
+private:
+    friend class TrainedDataStore;
+    TrainedData() = default;
+    Q_DISABLE_COPY(TrainedData)
+
+    std::unique_ptr<QFile> m_file;
+    uchar *m_data = nullptr;
+    qint64 m_size = 0;
+    QDateTime m_modified;
+};
+
+// Process-wide cache of memory-mapped traineddata files. Engines that
+// initialize the same language at the same time, like the workers of the pool
+// at startup, get the same mapping instead of each reading the file. Tesseract
+// copies the model into every engine during Init, so an engine holds the
+// mapping only while it initializes.
+class TrainedDataStore
+{
+public:
+    static TrainedDataStore &instance();
+
+    // Returns the mapping for dataPath/language.traineddata, creating it on
+    // first use, or nullptr if the file cannot be mapped. A file that changed
+    // on disk since it was mapped is mapped again.
+    std::shared_ptr<const TrainedData> acquire(const QString &dataPath, const QString &language);
+
+    // Unmaps files no initializing engine holds any more.
+    void releaseUnused();
+
+private:
+    TrainedDataStore() = default;
+
+    QMutex m_mutex;
+    QHash<QString, std::shared_ptr<TrainedData>> m_files;
+};
+
+#endif // TRAINEDDATASTORE_H